@@ -0,0 +1,172 @@
+#ifndef BEAM_EFFECTS_H
+#define BEAM_EFFECTS_H
+
+// Haces y láseres como cintas que miran a la cámara.
+//
+// Cada haz es un dibujo de 4 vértices sin atributos: el vertex shader saca de
+// gl_VertexID el extremo (start o end) y el lado, y abre la cinta en la
+// dirección perpendicular al eje y a la vista, con el ancho interpolado entre
+// los dos extremos (un cono es un haz con ancho 0 en start). Todo sale de unos
+// pocos uniforms, así que no hay nada que subir al búfer cada fotograma.
+//
+// El fragment shader no usa la posición interpolada en la cinta sino la
+// distancia al eje en el mundo, para que el trapecio no muestre la diagonal de
+// sus dos triángulos. Con esa distancia normalizada s, la luz que atraviesa un
+// cilindro lleno es proporcional a sqrt(1 - s²): el centro brilla más y los
+// bordes se apagan sin corte, como un volumen. Encima van unas bandas que
+// recorren el haz con el tiempo y, para el láser, un núcleo blanco.
+//
+// Los haces se suman (GL_ONE) sin escribir profundidad, así que no hay que
+// ordenarlos entre sí ni con los transparentes: draw() va después de la cola.
+
+#include <vector>
+
+#include "program_cache.h"
+
+inline const char* beamVertexShaderSource = R"glsl(
+    #version 330 core
+    uniform mat4 viewProj;
+    uniform vec3 eye;
+    uniform vec3 start;
+    uniform vec3 end;
+    uniform vec2 width; // en start y en end
+
+    out vec3 WorldPos;
+
+    void main()
+    {
+        float along = float(gl_VertexID >> 1);
+        float side = float(gl_VertexID & 1) * 2.0 - 1.0;
+        vec3 center = mix(start, end, along);
+        vec3 across = cross(end - start, eye - center);
+        if (dot(across, across) > 0.0)
+            across = normalize(across);
+        WorldPos = center + across * side * 0.5 * mix(width.x, width.y, along);
+        gl_Position = viewProj * vec4(WorldPos, 1.0);
+    }
+)glsl";
+
+inline const char* beamFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    in vec3 WorldPos;
+
+    uniform vec3 start;
+    uniform vec3 end;
+    uniform vec2 width;
+    uniform vec4 color;   // alfa: intensidad
+    uniform float time;
+    uniform float bands;  // bandas por unidad de largo; 0: sin bandas
+    uniform float speed;  // unidades por segundo hacia end
+    uniform float core;   // brillo del núcleo blanco
+
+    void main()
+    {
+        vec3 axis = end - start;
+        float len = length(axis);
+        float along = clamp(dot(WorldPos - start, axis) / (len * len), 0.0, 1.0);
+        float radius = 0.5 * mix(width.x, width.y, along);
+        float s = radius > 0.0 ? length(WorldPos - (start + axis * along)) / radius : 1.0;
+        float thickness = sqrt(max(1.0 - s * s, 0.0));
+
+        float distance = along * len;
+        float ripple = bands > 0.0 ? 0.7 + 0.3 * sin(6.2831853 * bands * (distance - speed * time)) : 1.0;
+        // Los extremos se apagan en una unidad para no cortar en seco
+        float ends = clamp(distance, 0.0, 1.0) * clamp(len - distance, 0.0, 1.0);
+
+        float intensity = color.a * thickness * ripple * ends;
+        vec3 glow = mix(color.rgb, vec3(1.0), core * pow(thickness, 8.0));
+        FragColor = vec4(glow * intensity, intensity);
+    }
+)glsl";
+
+struct Beam
+{
+    glm::vec3 start = glm::vec3(0.0f);
+    glm::vec3 end = glm::vec3(0.0f);
+    float startWidth = 1.0f;
+    float endWidth = 1.0f;
+    glm::vec4 color = glm::vec4(1.0f);
+    float bands = 0.0f;
+    float speed = 0.0f;
+    float core = 0.0f;
+};
+
+class BeamRenderer
+{
+public:
+    void init(ProgramCache& cache)
+    {
+        program = cache.getProgram({ { GL_VERTEX_SHADER, beamVertexShaderSource },
+                                     { GL_FRAGMENT_SHADER, beamFragmentShaderSource } });
+        glGenVertexArrays(1, &emptyVao);
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if (!initialized)
+            return;
+        glDeleteVertexArrays(1, &emptyVao);
+        // El programa es de ProgramCache
+        initialized = false;
+    }
+
+    // Para el fotograma actual; draw() los dibuja y vacía la lista
+    void add(const Beam& beam)
+    {
+        beams.push_back(beam);
+    }
+
+    // Con el destino de la escena enlazado y la profundidad de lo opaco ya escrita
+    void draw(const glm::mat4x4& viewProj, const glm::vec3& eye, float time)
+    {
+        if (!initialized || beams.empty())
+        {
+            beams.clear();
+            return;
+        }
+
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
+        glUniform3fv(glGetUniformLocation(program, "eye"), 1, glm::value_ptr(eye));
+        glUniform1f(glGetUniformLocation(program, "time"), time);
+        GLint startLocation = glGetUniformLocation(program, "start");
+        GLint endLocation = glGetUniformLocation(program, "end");
+        GLint widthLocation = glGetUniformLocation(program, "width");
+        GLint colorLocation = glGetUniformLocation(program, "color");
+        GLint bandsLocation = glGetUniformLocation(program, "bands");
+        GLint speedLocation = glGetUniformLocation(program, "speed");
+        GLint coreLocation = glGetUniformLocation(program, "core");
+
+        glDepthMask(GL_FALSE);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glBindVertexArray(emptyVao);
+        for (const Beam& beam : beams)
+        {
+            glUniform3fv(startLocation, 1, glm::value_ptr(beam.start));
+            glUniform3fv(endLocation, 1, glm::value_ptr(beam.end));
+            glUniform2f(widthLocation, beam.startWidth, beam.endWidth);
+            glUniform4fv(colorLocation, 1, glm::value_ptr(beam.color));
+            glUniform1f(bandsLocation, beam.bands);
+            glUniform1f(speedLocation, beam.speed);
+            glUniform1f(coreLocation, beam.core);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        }
+        glBindVertexArray(0);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDepthMask(GL_TRUE);
+
+        beams.clear();
+    }
+
+private:
+    GLuint program = 0;
+    GLuint emptyVao = 0;
+    bool initialized = false;
+
+    std::vector<Beam> beams;
+};
+
+#endif
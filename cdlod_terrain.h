@@ -0,0 +1,538 @@
+#ifndef CDLOD_TERRAIN_H
+#define CDLOD_TERRAIN_H
+
+// Suelo con nivel de detalle continuo (CDLOD) sobre un heightmap.
+//
+// El heightmap cubre un cuadrado de worldSize de lado y se recorre con un
+// quadtree implícito de LOD_COUNT niveles: el nivel 0 son las hojas y cada
+// nivel cubre el doble de distancia que el anterior (ranges). Cada fotograma
+// select() baja por el árbol desde la raíz y se queda con el nodo más grande
+// cuyo rango aún cubre la cámara; cuando solo algunos hijos entran en el rango
+// más fino, del padre se dibujan solo los cuadrantes que faltan. El número de
+// nodos (y de triángulos) depende de los rangos, no del tamaño del terreno.
+//
+// Todos los nodos usan la misma rejilla de GRID_QUADS x GRID_QUADS; la posición
+// y el tamaño de cada uno llegan por instancia y la altura se lee del heightmap
+// en el vertex shader. En la última parte del rango de su nivel, los vértices
+// impares se deslizan hacia los pares (geomorphing), así que al pasar al nivel
+// siguiente la malla ya tiene su forma y no hay saltos ni grietas.
+//
+// Los datos por instancia se escriben en un StreamBuffer: select() antes de
+// StreamBuffer::commit() y draw() después. Con 3.3 basta un dibujo instanciado
+// por parte (nodo completo o uno de sus cuatro cuadrantes). select() es
+// selectNodes(), que no toca OpenGL y puede ir en otro hilo, y upload().
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "gpu_culling.h"
+#include "program_cache.h"
+#include "soft_raster.h"
+#include "stream_buffer.h"
+
+inline const char* cdlodVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec2 aGrid; // 0..1 dentro del nodo
+    layout (location = 1) in vec4 aNode; // origen xz, tamaño, nivel
+
+    out vec2 TexCoord;
+    out vec3 FragPos;
+
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform sampler2D heightmap;
+    uniform vec2 worldMin;
+    uniform float worldSize;
+    uniform float gridQuads;
+    uniform float textureSize;
+    uniform vec3 eye;
+    uniform vec2 morphRanges[8]; // inicio y fin de la transición de cada nivel
+
+    float heightAt(vec2 pos)
+    {
+        // Centros de texel: cada muestra del heightmap cae en un vértice de la rejilla
+        vec2 texels = vec2(textureSize(heightmap, 0));
+        vec2 uv = ((pos - worldMin) / worldSize * (texels - 1.0) + 0.5) / texels;
+        return texture(heightmap, uv).r;
+    }
+
+    void main()
+    {
+        vec2 pos = aNode.xy + aGrid * aNode.z;
+        float distance = length(eye - vec3(pos.x, heightAt(pos), pos.y));
+        vec2 morph = morphRanges[int(aNode.w)];
+        float k = clamp((distance - morph.x) / (morph.y - morph.x), 0.0, 1.0);
+
+        // Los vértices impares acaban sobre el par anterior: la rejilla del nivel siguiente
+        vec2 fracPart = fract(aGrid * gridQuads * 0.5) * 2.0 / gridQuads;
+        pos = aNode.xy + (aGrid - fracPart * k) * aNode.z;
+
+        FragPos = vec3(pos.x, heightAt(pos), pos.y);
+        gl_Position = projection * view * vec4(FragPos, 1.0);
+        TexCoord = pos / textureSize;
+    }
+)glsl";
+
+inline const char* cdlodFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    in vec2 TexCoord;
+    in vec3 FragPos;
+
+    uniform sampler2D texture1;
+
+    vec3 applyShadows(vec3 color, vec3 worldPos); // shadowSampleShaderSource
+    vec3 applyLights(vec3 albedo, vec3 worldPos); // clusteredLightsShaderSource
+
+    void main()
+    {
+        vec4 color = texture(texture1, TexCoord);
+        FragColor = vec4(applyShadows(color.rgb, FragPos) + applyLights(color.rgb, FragPos), color.a);
+    }
+)glsl";
+
+class CdlodTerrain
+{
+public:
+    static const int GRID_QUADS = 32;
+    static const int LOD_COUNT = 6;
+    static const int PART_COUNT = 5; // nodo completo y sus cuatro cuadrantes
+    static constexpr float MORPH_START = 0.7f; // parte del rango de un nivel en la que empieza la transición
+    static constexpr float TEXTURE_SIZE = 50.0f; // unidades del mundo por repetición de la textura
+
+    // heights: size x size muestras por filas (z) sobre [worldMin, worldMin + worldSize];
+    // leafRange es la distancia que cubren las hojas. Solo CPU: sirve también sin OpenGL.
+    void build(const std::vector<float>& _heights, int _size, const glm::vec2& _worldMin, float _worldSize, float leafRange)
+    {
+        heights = _heights;
+        size = _size;
+        worldMin = _worldMin;
+        worldSize = _worldSize;
+
+        float previous = 0.0f;
+        for (int lod = 0; lod < LOD_COUNT; ++lod)
+        {
+            ranges[lod] = leafRange * float(1 << lod);
+            morphRanges[lod] = glm::vec2(previous + (ranges[lod] - previous) * MORPH_START, ranges[lod]);
+            previous = ranges[lod];
+        }
+
+        nodes.clear();
+        buildNode(worldMin, worldSize, LOD_COUNT - 1);
+        std::cout << "Suelo CDLOD: " << nodes.size() << " nodos, " << size << "x" << size << " muestras" << std::endl;
+    }
+
+    // Tras build(), con OpenGL: heightmap, rejilla y programa. libraries son las
+    // fuentes compartidas con applyShadows() y applyLights()
+    void upload(ProgramCache& cache, const std::vector<ShaderSource>& libraries)
+    {
+        glGenTextures(1, &heightTexture);
+        glBindTexture(GL_TEXTURE_2D, heightTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, heights.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        std::vector<float> grid;
+        for (int z = 0; z <= GRID_QUADS; ++z)
+            for (int x = 0; x <= GRID_QUADS; ++x)
+            {
+                grid.push_back(x / float(GRID_QUADS));
+                grid.push_back(z / float(GRID_QUADS));
+            }
+        std::vector<unsigned int> indices = gridIndices();
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(float), grid.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        setupProgram(cache, libraries);
+    }
+
+    void destroy()
+    {
+        if (heightTexture) glDeleteTextures(1, &heightTexture);
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (vbo) glDeleteBuffers(1, &vbo);
+        if (ebo) glDeleteBuffers(1, &ebo);
+        // El programa es de ProgramCache
+        heightTexture = vao = vbo = ebo = program = 0;
+    }
+
+    void setTexture(GLuint _texture)
+    {
+        texture = _texture;
+    }
+
+    GLuint getTexture() const
+    {
+        return texture;
+    }
+
+    GLuint getProgram() const
+    {
+        return program;
+    }
+
+    // Al recargar las bibliotecas de luz cambia el programa
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+            if (program == swap.oldProgram)
+                program = swap.newProgram;
+    }
+
+    // Elige los nodos del fotograma; con stream escribe sus datos por instancia
+    void select(const glm::vec3& eye, const glm::mat4x4& viewProj, StreamBuffer* stream)
+    {
+        selectNodes(eye, viewProj);
+        upload(stream);
+    }
+
+    void selectNodes(const glm::vec3& eye, const glm::mat4x4& viewProj)
+    {
+        selectionEye = eye;
+        lastTriangles = 0;
+        for (std::vector<glm::vec4>& part : parts)
+            part.clear();
+        if (nodes.empty())
+            return;
+
+        glm::vec4 planes[6];
+        GpuCuller::extractPlanes(viewProj, planes);
+        selectNode(0, eye, planes);
+        for (int part = 0; part < PART_COUNT; ++part)
+            lastTriangles += (unsigned)parts[part].size() * partIndexCount(part) / 3;
+    }
+
+    // Los nodos del último selectNodes(); sin stream solo se cuentan
+    void upload(StreamBuffer* stream)
+    {
+        for (int part = 0; part < PART_COUNT; ++part)
+        {
+            partData[part] = StreamBuffer::Allocation{ nullptr, 0 };
+            if (stream && !parts[part].empty())
+            {
+                partData[part] = stream->allocate(parts[part].size() * sizeof(glm::vec4), sizeof(glm::vec4));
+                if (partData[part].data)
+                    memcpy(partData[part].data, parts[part].data(), parts[part].size() * sizeof(glm::vec4));
+            }
+        }
+    }
+
+    // Tras StreamBuffer::commit(); stream es el mismo de select()
+    void draw(const StreamBuffer& stream, const glm::mat4x4& view, const glm::mat4x4& proj)
+    {
+        if (!program)
+            return;
+
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
+        glUniform2fv(glGetUniformLocation(program, "worldMin"), 1, glm::value_ptr(worldMin));
+        glUniform1f(glGetUniformLocation(program, "worldSize"), worldSize);
+        glUniform1f(glGetUniformLocation(program, "gridQuads"), float(GRID_QUADS));
+        glUniform1f(glGetUniformLocation(program, "textureSize"), TEXTURE_SIZE);
+        glUniform3fv(glGetUniformLocation(program, "eye"), 1, glm::value_ptr(selectionEye));
+        glUniform2fv(glGetUniformLocation(program, "morphRanges"), LOD_COUNT, glm::value_ptr(morphRanges[0]));
+        glUniform1i(glGetUniformLocation(program, "texture1"), 0);
+        glUniform1i(glGetUniformLocation(program, "heightmap"), 1);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, heightTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+        for (int part = 0; part < PART_COUNT; ++part)
+        {
+            if (!partData[part].data)
+                continue;
+            glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)partData[part].offset);
+            glDrawElementsInstanced(GL_TRIANGLES, partIndexCount(part), GL_UNSIGNED_INT,
+                (void*)(partFirstIndex(part) * sizeof(GLuint)), (GLsizei)parts[part].size());
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Los nodos del último select(), con el mismo geomorphing que el vertex shader.
+    // SoftRasterizer solo guarda punteros: la geometría sigue aquí hasta el
+    // siguiente rasterize(), así que render() tiene que ir antes
+    void rasterize(SoftRasterizer& raster, const SoftTexture* softTexture)
+    {
+        std::vector<unsigned int> indices = gridIndices();
+        size_t nodeCount = 0;
+        for (int part = 0; part < PART_COUNT; ++part)
+            nodeCount += parts[part].size();
+        // Sin reservas a mitad: los punteros de los ya enviados no deben moverse
+        softPositions.resize(nodeCount);
+        softTexcoords.resize(nodeCount);
+
+        size_t slot = 0;
+        for (int part = 0; part < PART_COUNT; ++part)
+        {
+            softIndices[part].assign(indices.begin() + partFirstIndex(part),
+                                     indices.begin() + partFirstIndex(part) + partIndexCount(part));
+            for (const glm::vec4& node : parts[part])
+            {
+                std::vector<float>& positions = softPositions[slot];
+                std::vector<float>& texcoords = softTexcoords[slot];
+                ++slot;
+                positions.clear();
+                texcoords.clear();
+                for (int z = 0; z <= GRID_QUADS; ++z)
+                    for (int x = 0; x <= GRID_QUADS; ++x)
+                    {
+                        glm::vec3 vertex = morphedVertex(node, x, z);
+                        positions.push_back(vertex.x);
+                        positions.push_back(vertex.y);
+                        positions.push_back(vertex.z);
+                        texcoords.push_back(vertex.x / TEXTURE_SIZE);
+                        texcoords.push_back(vertex.z / TEXTURE_SIZE);
+                    }
+                raster.submit(positions, texcoords, softIndices[part], glm::mat4x4(1.0f), softTexture);
+            }
+        }
+    }
+
+    // Diámetro en píxeles de una repetición de la textura en el punto del suelo
+    // más cercano a la cámara (el de debajo), que es donde más se ve
+    float textureFootprint(const glm::vec3& eye, const glm::mat4x4& proj, float viewportHeight) const
+    {
+        float distance = std::max(eye.y - heightAt(eye.x, eye.z), 1.0f);
+        return 0.5f * TEXTURE_SIZE * proj[1][1] / distance * viewportHeight;
+    }
+
+    // Bilineal, igual que el vertex shader
+    float heightAt(float x, float z) const
+    {
+        float u = glm::clamp((x - worldMin.x) / worldSize, 0.0f, 1.0f) * (size - 1);
+        float v = glm::clamp((z - worldMin.y) / worldSize, 0.0f, 1.0f) * (size - 1);
+        int x0 = std::min((int)u, size - 2), z0 = std::min((int)v, size - 2);
+        float fx = u - x0, fz = v - z0;
+        const float* row0 = &heights[z0 * size + x0];
+        const float* row1 = row0 + size;
+        return (row0[0] * (1.0f - fx) + row0[1] * fx) * (1.0f - fz) + (row1[0] * (1.0f - fx) + row1[1] * fx) * fz;
+    }
+
+    // Caja y nivel de cada nodo del último select(), para DebugViews; un nodo
+    // que solo dibuja parte de sus cuartos sale una vez por cuarto
+    template <typename Visit>
+    void forEachSelectedNode(Visit visit) const
+    {
+        for (const std::vector<glm::vec4>& part : parts)
+            for (const glm::vec4& node : part)
+            {
+                float low = std::numeric_limits<float>::infinity(), high = -low;
+                for (int corner = 0; corner < 5; ++corner)
+                {
+                    float offsetX = corner == 4 ? 0.5f : float(corner & 1);
+                    float offsetZ = corner == 4 ? 0.5f : float(corner >> 1);
+                    float height = heightAt(node.x + offsetX * node.z, node.y + offsetZ * node.z);
+                    low = std::min(low, height);
+                    high = std::max(high, height);
+                }
+                visit(glm::vec3(node.x, low, node.y), glm::vec3(node.x + node.z, high, node.y + node.z), int(node.w));
+            }
+    }
+
+    // Nodos y triángulos del último select()
+    size_t getSelectedCount() const
+    {
+        size_t count = 0;
+        for (const std::vector<glm::vec4>& part : parts)
+            count += part.size();
+        return count;
+    }
+
+    unsigned getTriangleCount() const
+    {
+        return lastTriangles;
+    }
+
+private:
+    struct Node
+    {
+        glm::vec3 minCorner, maxCorner;
+        int lod;
+        int children[4]; // -1 en las hojas
+    };
+
+    std::vector<float> heights;
+    int size = 0;
+    glm::vec2 worldMin;
+    float worldSize = 0.0f;
+    float ranges[LOD_COUNT];
+    glm::vec2 morphRanges[LOD_COUNT];
+    std::vector<Node> nodes; // la raíz es el primero
+
+    std::vector<glm::vec4> parts[PART_COUNT]; // origen xz, tamaño y nivel por nodo elegido
+    StreamBuffer::Allocation partData[PART_COUNT] = {};
+    glm::vec3 selectionEye;
+    unsigned lastTriangles = 0;
+
+    // Lo último enviado a SoftRasterizer, por nodo
+    std::vector<unsigned int> softIndices[PART_COUNT];
+    std::vector<std::vector<float>> softPositions, softTexcoords;
+
+    GLuint heightTexture = 0, texture = 0;
+    GLuint vao = 0, vbo = 0, ebo = 0, program = 0;
+
+    void setupProgram(ProgramCache& cache, const std::vector<ShaderSource>& libraries)
+    {
+        std::vector<ShaderSource> sources = { { GL_VERTEX_SHADER, cdlodVertexShaderSource },
+                                              { GL_FRAGMENT_SHADER, cdlodFragmentShaderSource } };
+        sources.insert(sources.end(), libraries.begin(), libraries.end());
+        program = cache.getProgram(sources);
+    }
+
+    // Devuelve el índice del nodo; las alturas mínima y máxima salen de las muestras que cubre
+    int buildNode(const glm::vec2& origin, float nodeSize, int lod)
+    {
+        int index = (int)nodes.size();
+        nodes.push_back(Node());
+        Node node;
+        node.lod = lod;
+        float minHeight = 1e30f, maxHeight = -1e30f;
+        if (lod == 0)
+        {
+            int x0 = sampleIndex(origin.x - worldMin.x), x1 = sampleIndex(origin.x + nodeSize - worldMin.x);
+            int z0 = sampleIndex(origin.y - worldMin.y), z1 = sampleIndex(origin.y + nodeSize - worldMin.y);
+            for (int z = z0; z <= z1; ++z)
+                for (int x = x0; x <= x1; ++x)
+                {
+                    minHeight = std::min(minHeight, heights[z * size + x]);
+                    maxHeight = std::max(maxHeight, heights[z * size + x]);
+                }
+            std::fill(node.children, node.children + 4, -1);
+        }
+        else
+        {
+            float half = nodeSize * 0.5f;
+            for (int child = 0; child < 4; ++child)
+            {
+                node.children[child] = buildNode(origin + glm::vec2((child & 1) * half, (child >> 1) * half), half, lod - 1);
+                minHeight = std::min(minHeight, nodes[node.children[child]].minCorner.y);
+                maxHeight = std::max(maxHeight, nodes[node.children[child]].maxCorner.y);
+            }
+        }
+        node.minCorner = glm::vec3(origin.x, minHeight, origin.y);
+        node.maxCorner = glm::vec3(origin.x + nodeSize, maxHeight, origin.y + nodeSize);
+        nodes[index] = node;
+        return index;
+    }
+
+    int sampleIndex(float offset) const
+    {
+        return glm::clamp((int)std::floor(offset / worldSize * (size - 1)), 0, size - 1);
+    }
+
+    // false si el nodo queda fuera de su rango: el padre dibuja esa parte
+    bool selectNode(int index, const glm::vec3& eye, const glm::vec4 planes[6])
+    {
+        const Node& node = nodes[index];
+        if (distanceTo(node, eye) > ranges[node.lod])
+            return false;
+        if (!inFrustum(node, planes))
+            return true; // cubierto, pero no se ve
+        if (node.lod == 0 || distanceTo(node, eye) > ranges[node.lod - 1])
+        {
+            parts[0].push_back(instanceData(node));
+            return true;
+        }
+        for (int child = 0; child < 4; ++child)
+            if (!selectNode(node.children[child], eye, planes))
+                parts[1 + child].push_back(instanceData(node));
+        return true;
+    }
+
+    static glm::vec4 instanceData(const Node& node)
+    {
+        return glm::vec4(node.minCorner.x, node.minCorner.z, node.maxCorner.x - node.minCorner.x, float(node.lod));
+    }
+
+    static float distanceTo(const Node& node, const glm::vec3& eye)
+    {
+        return glm::length(eye - glm::clamp(eye, node.minCorner, node.maxCorner));
+    }
+
+    static bool inFrustum(const Node& node, const glm::vec4 planes[6])
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            // La esquina de la caja más adentro del plano
+            glm::vec3 corner(planes[i].x >= 0.0f ? node.maxCorner.x : node.minCorner.x,
+                             planes[i].y >= 0.0f ? node.maxCorner.y : node.minCorner.y,
+                             planes[i].z >= 0.0f ? node.maxCorner.z : node.minCorner.z);
+            if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    glm::vec3 morphedVertex(const glm::vec4& node, int x, int z) const
+    {
+        glm::vec2 grid(x / float(GRID_QUADS), z / float(GRID_QUADS));
+        glm::vec2 pos = glm::vec2(node.x, node.y) + grid * node.z;
+        float distance = glm::length(selectionEye - glm::vec3(pos.x, heightAt(pos.x, pos.y), pos.y));
+        const glm::vec2& morph = morphRanges[(int)node.w];
+        float k = glm::clamp((distance - morph.x) / (morph.y - morph.x), 0.0f, 1.0f);
+
+        glm::vec2 fracPart((x & 1) / float(GRID_QUADS), (z & 1) / float(GRID_QUADS));
+        pos = glm::vec2(node.x, node.y) + (grid - fracPart * k) * node.z;
+        return glm::vec3(pos.x, heightAt(pos.x, pos.y), pos.y);
+    }
+
+    // Los cuadrantes van seguidos, así cada parte es un tramo contiguo
+    static std::vector<unsigned int> gridIndices()
+    {
+        const int half = GRID_QUADS / 2;
+        std::vector<unsigned int> indices;
+        for (int quadrant = 0; quadrant < 4; ++quadrant)
+            for (int z = (quadrant >> 1) * half; z < ((quadrant >> 1) + 1) * half; ++z)
+                for (int x = (quadrant & 1) * half; x < ((quadrant & 1) + 1) * half; ++x)
+                {
+                    unsigned int corner = z * (GRID_QUADS + 1) + x;
+                    unsigned int quad[6] = { corner, corner + GRID_QUADS + 1, corner + GRID_QUADS + 2,
+                                             corner, corner + GRID_QUADS + 2, corner + 1 };
+                    indices.insert(indices.end(), quad, quad + 6);
+                }
+        return indices;
+    }
+
+    static GLsizei partIndexCount(int part)
+    {
+        return part == 0 ? GRID_QUADS * GRID_QUADS * 6 : GRID_QUADS * GRID_QUADS * 6 / 4;
+    }
+
+    static GLint partFirstIndex(int part)
+    {
+        return part == 0 ? 0 : (part - 1) * partIndexCount(part);
+    }
+};
+
+#endif
@@ -0,0 +1,355 @@
+#ifndef CLUSTERED_LIGHTS_H
+#define CLUSTERED_LIGHTS_H
+
+// Iluminación forward por clusters: muchas luces puntuales con un coste por
+// píxel que depende de las luces cercanas, no del total.
+//
+// El frustum de la cámara se divide en TILES_X x TILES_Y tiles de pantalla y
+// SLICES rodajas de profundidad (exponenciales entre CLUSTER_NEAR y
+// CLUSTER_FAR). Cada fotograma update() pasa las luces a la vista de la cámara
+// y calcula los clusters que toca su esfera, varias luces a la vez con los
+// vectores de softraster (AVX2, SSE2 o escalar). Luego cuenta las luces por
+// cluster, hace la suma de prefijos y rellena la lista de índices.
+//
+// Las luces, los clusters (primer índice y número) y la lista de índices se
+// escriben en el StreamBuffer; tres texturas de búfer sobre ese mismo búfer los
+// leen con texelFetch a partir de la posición de cada uno en el fotograma.
+//
+// Como en ShadowMaps, los receptores enlazan clusteredLightsShaderSource y declaran
+// vec3 applyLights(vec3 albedo, vec3 worldPos); bindReceiver() les da los
+// uniforms. La normal sale de las derivadas de la posición, así que sirve para
+// cualquier malla aunque no tenga normales; la sobrecarga con normal es la del
+// pase de luces de DeferredRenderer.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "soft_raster.h"
+#include "stream_buffer.h"
+
+// El fragment shader con applyLights(); no necesita init(), así los receptores
+// enlazan igual con las luces desactivadas
+inline const char* clusteredLightsShaderSource = R"glsl(
+    #version 330 core
+    uniform samplerBuffer lightData;     // dos texels por luz: posición y radio, color
+    uniform usamplerBuffer clusterData;  // primer índice y número de luces
+    uniform usamplerBuffer lightIndices;
+    uniform ivec3 bases;                 // primer texel de cada uno en este fotograma
+    uniform bool lightsEnabled;
+    uniform ivec3 clusterGrid;
+    uniform vec2 clusterDepth;           // rodaja = log(profundidad) * x + y
+    uniform vec2 viewportSize;
+    uniform mat4 lightsView;
+    uniform vec3 lightsEye;
+
+    // Con la normal ya calculada (el pase de luces diferido la lee del G-buffer)
+    vec3 applyLights(vec3 albedo, vec3 worldPos, vec3 normal)
+    {
+        if (!lightsEnabled)
+            return vec3(0.0);
+        if (dot(normal, lightsEye - worldPos) < 0.0)
+            normal = -normal;
+
+        float depth = -(lightsView * vec4(worldPos, 1.0)).z;
+        ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / viewportSize * vec2(clusterGrid.xy)),
+                              int(floor(log(max(depth, 1e-3)) * clusterDepth.x + clusterDepth.y)));
+        cluster = clamp(cluster, ivec3(0), clusterGrid - 1);
+        uvec2 range = texelFetch(clusterData, bases.y + (cluster.z * clusterGrid.y + cluster.y) * clusterGrid.x + cluster.x).xy;
+
+        vec3 light = vec3(0.0);
+        for (uint i = 0u; i < range.y; ++i)
+        {
+            int index = bases.x + 2 * int(texelFetch(lightIndices, bases.z + int(range.x + i)).r);
+            vec4 positionRadius = texelFetch(lightData, index);
+            vec3 toLight = positionRadius.xyz - worldPos;
+            float distance = length(toLight);
+            float attenuation = max(1.0 - distance / positionRadius.w, 0.0);
+            // Un poco de luz aunque la cara no mire a la luz: el pasto y las hojas son finos
+            float diffuse = 0.25 + 0.75 * max(dot(normal, toLight / max(distance, 1e-3)), 0.0);
+            light += texelFetch(lightData, index + 1).rgb * (attenuation * attenuation * diffuse);
+        }
+        return albedo * light;
+    }
+
+    vec3 applyLights(vec3 albedo, vec3 worldPos)
+    {
+        // Antes de cualquier rama: las derivadas necesitan a los cuatro píxeles del quad
+        return applyLights(albedo, worldPos, normalize(cross(dFdx(worldPos), dFdy(worldPos))));
+    }
+)glsl";
+
+class ClusteredLights
+{
+public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+    static const int MAX_LIGHTS = 1024;
+    static const int MAX_INDICES = 32768;        // entradas de la lista por fotograma
+    static constexpr float CLUSTER_NEAR = 1.0f;  // lo más cercano cae en la primera rodaja
+    static constexpr float CLUSTER_FAR = 500.0f; // las luces más lejanas no se asignan
+    static const int DATA_UNIT = 8;
+    static const int CLUSTER_UNIT = 9;
+    static const int INDEX_UNIT = 10;
+
+    // buffer: el de StreamBuffer::getBuffer() que luego recibe update()
+    void init(GLuint buffer)
+    {
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        GLint bufferSize = 0;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &bufferSize);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        if (bufferSize / 4 > maxTexels)
+            std::cerr << "Luces: el búfer de streaming supera GL_MAX_TEXTURE_BUFFER_SIZE (" << maxTexels << ")" << std::endl;
+
+        const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; ++i)
+        {
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffer);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        initialized = true;
+        std::cout << "Luces: " << TILES_X << "x" << TILES_Y << "x" << SLICES << " clusters, hasta " << MAX_LIGHTS << " luces" << std::endl;
+    }
+
+    void destroy()
+    {
+        if (initialized) glDeleteTextures(3, textures);
+        initialized = false;
+    }
+
+    // Las luces se vuelven a añadir cada fotograma, antes de update()
+    void addLight(const glm::vec3& position, float radius, const glm::vec3& color)
+    {
+        if (positionX.size() >= MAX_LIGHTS || radius <= 0.0f)
+            return;
+        positionX.push_back(position.x);
+        positionY.push_back(position.y);
+        positionZ.push_back(position.z);
+        radii.push_back(radius);
+        colors.push_back(color);
+    }
+
+    // Antes de StreamBuffer::commit(): asigna las luces a los clusters y lo escribe todo
+    void update(const glm::mat4x4& view, const glm::mat4x4& proj, const glm::vec2& _viewportSize, StreamBuffer& stream)
+    {
+        cameraView = view;
+        cameraEye = glm::vec3(glm::inverse(view)[3]);
+        viewportSize = _viewportSize;
+        lightCount = (unsigned)positionX.size();
+        indexCount = 0;
+        ready = false;
+        if (!initialized)
+        {
+            clearLights();
+            return;
+        }
+
+        computeBounds(view, glm::vec2(1.0f / proj[0][0], 1.0f / proj[1][1]));
+        assignClusters();
+
+        size_t lightBytes = std::max<size_t>(lightCount, 1) * 2 * sizeof(glm::vec4);
+        StreamBuffer::Allocation lightAllocation = stream.allocate(lightBytes, sizeof(glm::vec4));
+        StreamBuffer::Allocation clusterAllocation = stream.allocate(CLUSTER_COUNT * 2 * sizeof(uint32_t), 2 * sizeof(uint32_t));
+        StreamBuffer::Allocation indexAllocation = stream.allocate(std::max<size_t>(indexCount, 1) * sizeof(uint32_t), sizeof(uint32_t));
+        if (lightAllocation.data && clusterAllocation.data && indexAllocation.data)
+        {
+            glm::vec4* lights = (glm::vec4*)lightAllocation.data;
+            for (unsigned i = 0; i < lightCount; ++i)
+            {
+                lights[i * 2] = glm::vec4(positionX[i], positionY[i], positionZ[i], radii[i]);
+                lights[i * 2 + 1] = glm::vec4(colors[i], 0.0f);
+            }
+            memcpy(clusterAllocation.data, clusters.data(), clusters.size() * sizeof(uint32_t));
+            memcpy(indexAllocation.data, indices.data(), indexCount * sizeof(uint32_t));
+
+            bases = glm::ivec3((int)(lightAllocation.offset / sizeof(glm::vec4)),
+                               (int)(clusterAllocation.offset / (2 * sizeof(uint32_t))),
+                               (int)(indexAllocation.offset / sizeof(uint32_t)));
+            ready = true;
+        }
+        clearLights();
+    }
+
+    // Uniforms y texturas de applyLights() para un programa receptor (lo deja en uso)
+    void bindReceiver(GLuint receiver) const
+    {
+        glUseProgram(receiver);
+        glUniform1i(glGetUniformLocation(receiver, "lightData"), DATA_UNIT);
+        glUniform1i(glGetUniformLocation(receiver, "clusterData"), CLUSTER_UNIT);
+        glUniform1i(glGetUniformLocation(receiver, "lightIndices"), INDEX_UNIT);
+        glUniform1i(glGetUniformLocation(receiver, "lightsEnabled"), ready);
+        if (!ready)
+            return;
+
+        float logRange = std::log(CLUSTER_FAR / CLUSTER_NEAR);
+        glUniform3i(glGetUniformLocation(receiver, "bases"), bases.x, bases.y, bases.z);
+        glUniform3i(glGetUniformLocation(receiver, "clusterGrid"), TILES_X, TILES_Y, SLICES);
+        glUniform2f(glGetUniformLocation(receiver, "clusterDepth"), SLICES / logRange, -SLICES * std::log(CLUSTER_NEAR) / logRange);
+        glUniform2fv(glGetUniformLocation(receiver, "viewportSize"), 1, glm::value_ptr(viewportSize));
+        glUniformMatrix4fv(glGetUniformLocation(receiver, "lightsView"), 1, GL_FALSE, glm::value_ptr(cameraView));
+        glUniform3fv(glGetUniformLocation(receiver, "lightsEye"), 1, glm::value_ptr(cameraEye));
+
+        const int units[3] = { DATA_UNIT, CLUSTER_UNIT, INDEX_UNIT };
+        for (int i = 0; i < 3; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Del último update()
+    unsigned getLightCount() const
+    {
+        return lightCount;
+    }
+
+    unsigned getIndexCount() const
+    {
+        return indexCount;
+    }
+
+private:
+    // Luces del fotograma por componentes, para leerlas de LANE_COUNT en LANE_COUNT
+    std::vector<float> positionX, positionY, positionZ, radii;
+    std::vector<glm::vec3> colors;
+    unsigned lightCount = 0;
+
+    // Por luz: tiles (sin redondear) y profundidades que cubre su esfera
+    std::vector<float> tileMinX, tileMaxX, tileMinY, tileMaxY, depthMin, depthMax;
+
+    std::vector<uint32_t> clusters = std::vector<uint32_t>(CLUSTER_COUNT * 2); // primer índice, número
+    std::vector<uint32_t> indices = std::vector<uint32_t>(MAX_INDICES);
+    std::vector<uint32_t> clusterCounts = std::vector<uint32_t>(CLUSTER_COUNT);
+    std::vector<uint32_t> lightClusters; // por luz: x0, x1, y0, y1, z0, z1 (x0 > x1: no toca ninguno)
+    unsigned indexCount = 0;
+
+    glm::mat4x4 cameraView = glm::mat4x4(1.0f);
+    glm::vec3 cameraEye = glm::vec3(0.0f);
+    glm::vec2 viewportSize = glm::vec2(1.0f);
+    glm::ivec3 bases = glm::ivec3(0);
+    bool initialized = false, ready = false;
+    GLuint textures[3] = { 0, 0, 0 };
+
+    void clearLights()
+    {
+        positionX.clear();
+        positionY.clear();
+        positionZ.clear();
+        radii.clear();
+        colors.clear();
+    }
+
+    // El AABB de cada esfera en la vista, proyectado de forma conservadora: cada borde
+    // se divide por la profundidad que más lo aleja del centro de la pantalla
+    void computeBounds(const glm::mat4x4& view, const glm::vec2& tanHalf)
+    {
+        using namespace softraster;
+
+        size_t padded = (lightCount + LANE_COUNT - 1) / LANE_COUNT * LANE_COUNT;
+        for (std::vector<float>* component : { &positionX, &positionY, &positionZ, &radii })
+            component->resize(padded, 0.0f);
+        for (std::vector<float>* bound : { &tileMinX, &tileMaxX, &tileMinY, &tileMaxY, &depthMin, &depthMax })
+            bound->resize(padded);
+
+        Lanes zero = splat(0.0f), nearDepth = splat(CLUSTER_NEAR);
+        Lanes scaleX = splat(0.5f * TILES_X / tanHalf.x), scaleY = splat(0.5f * TILES_Y / tanHalf.y);
+        Lanes centerX = splat(0.5f * TILES_X), centerY = splat(0.5f * TILES_Y);
+        for (size_t i = 0; i < padded; i += LANE_COUNT)
+        {
+            Lanes x = load(&positionX[i]), y = load(&positionY[i]), z = load(&positionZ[i]), radius = load(&radii[i]);
+            Lanes viewX = add(add(mul(splat(view[0][0]), x), mul(splat(view[1][0]), y)), add(mul(splat(view[2][0]), z), splat(view[3][0])));
+            Lanes viewY = add(add(mul(splat(view[0][1]), x), mul(splat(view[1][1]), y)), add(mul(splat(view[2][1]), z), splat(view[3][1])));
+            Lanes depth = sub(zero, add(add(mul(splat(view[0][2]), x), mul(splat(view[1][2]), y)), add(mul(splat(view[2][2]), z), splat(view[3][2]))));
+
+            Lanes front = maximum(sub(depth, radius), nearDepth), back = maximum(add(depth, radius), nearDepth);
+            Lanes left = sub(viewX, radius), right = add(viewX, radius);
+            Lanes bottom = sub(viewY, radius), top = add(viewY, radius);
+            left = div(left, select(less(left, zero), front, back));
+            right = div(right, select(less(right, zero), back, front));
+            bottom = div(bottom, select(less(bottom, zero), front, back));
+            top = div(top, select(less(top, zero), back, front));
+
+            store(&tileMinX[i], add(mul(left, scaleX), centerX));
+            store(&tileMaxX[i], add(mul(right, scaleX), centerX));
+            store(&tileMinY[i], add(mul(bottom, scaleY), centerY));
+            store(&tileMaxY[i], add(mul(top, scaleY), centerY));
+            store(&depthMin[i], sub(depth, radius));
+            store(&depthMax[i], add(depth, radius));
+        }
+    }
+
+    static int sliceAt(float depth)
+    {
+        float slice = std::log(std::max(depth, CLUSTER_NEAR) / CLUSTER_NEAR) / std::log(CLUSTER_FAR / CLUSTER_NEAR) * SLICES;
+        return std::min(std::max((int)std::floor(slice), 0), SLICES - 1);
+    }
+
+    // Recuento por cluster, suma de prefijos y relleno
+    void assignClusters()
+    {
+        lightClusters.assign(lightCount * 6, 0);
+        std::fill(clusterCounts.begin(), clusterCounts.end(), 0);
+
+        for (unsigned light = 0; light < lightCount; ++light)
+        {
+            uint32_t* range = &lightClusters[light * 6];
+            range[0] = 1; // vacío mientras no se demuestre lo contrario
+            if (depthMax[light] <= CLUSTER_NEAR || depthMin[light] >= CLUSTER_FAR)
+                continue;
+            if (tileMaxX[light] < 0.0f || tileMinX[light] >= TILES_X || tileMaxY[light] < 0.0f || tileMinY[light] >= TILES_Y)
+                continue;
+
+            range[0] = (uint32_t)std::max((int)std::floor(tileMinX[light]), 0);
+            range[1] = (uint32_t)std::min((int)std::floor(tileMaxX[light]), TILES_X - 1);
+            range[2] = (uint32_t)std::max((int)std::floor(tileMinY[light]), 0);
+            range[3] = (uint32_t)std::min((int)std::floor(tileMaxY[light]), TILES_Y - 1);
+            range[4] = (uint32_t)sliceAt(depthMin[light]);
+            range[5] = (uint32_t)sliceAt(std::min(depthMax[light], CLUSTER_FAR));
+            for (uint32_t z = range[4]; z <= range[5]; ++z)
+                for (uint32_t y = range[2]; y <= range[3]; ++y)
+                    for (uint32_t x = range[0]; x <= range[1]; ++x)
+                        ++clusterCounts[(z * TILES_Y + y) * TILES_X + x];
+        }
+
+        // Los clusters que ya no caben en la lista se quedan sin luces
+        uint32_t first = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; ++cluster)
+        {
+            if (first + clusterCounts[cluster] > MAX_INDICES)
+                clusterCounts[cluster] = 0;
+            clusters[cluster * 2] = first;
+            clusters[cluster * 2 + 1] = 0;
+            first += clusterCounts[cluster];
+        }
+        indexCount = first;
+
+        for (unsigned light = 0; light < lightCount; ++light)
+        {
+            const uint32_t* range = &lightClusters[light * 6];
+            if (range[0] > range[1])
+                continue;
+            for (uint32_t z = range[4]; z <= range[5]; ++z)
+                for (uint32_t y = range[2]; y <= range[3]; ++y)
+                    for (uint32_t x = range[0]; x <= range[1]; ++x)
+                    {
+                        uint32_t cluster = (z * TILES_Y + y) * TILES_X + x;
+                        if (clusters[cluster * 2 + 1] < clusterCounts[cluster])
+                            indices[clusters[cluster * 2] + clusters[cluster * 2 + 1]++] = light;
+                    }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef DEBUG_VIEWS_H
+#define DEBUG_VIEWS_H
+
+// Vistas de depuración para revisar el rendimiento (F1 a F4, o --debug-view
+// sin ventana).
+//
+// Las dos primeras cuentan fragmentos por píxel en el stencil del framebuffer
+// por defecto y después lo pintan con una rampa de calor (azul = 0, rojo =
+// HEAT_LEVELS - 1 o más):
+//   - sobredibujo: cada fragmento que pasa la profundidad suma uno (como
+//     OverdrawCounter, pero por píxel); lo descartado en el shader no cuenta;
+//   - triángulos: la escena en alambre y cada arista suma uno pase o no la
+//     profundidad, así que los píxeles con muchas aristas son mallas densas.
+// Se cuenta en el stencil y no con blending aditivo porque el pasto y los
+// impostores cambian la función de mezcla; el recuento no depende de ella.
+// Con sombreado diferido el G-buffer no tiene stencil y no están disponibles.
+//
+// Las otras dos son cajas de líneas que se añaden cada fotograma:
+//   - lod: color por nivel de detalle (chunks del terreno, nodos del suelo,
+//     árboles con malla, fundidos o impostor);
+//   - descartados: en rojo los objetos ocultos por oclusión y en verde los que
+//     se dibujan.
+//
+// Sin ventana, heatImage() y drawLines() hacen lo mismo sobre la imagen de
+// SoftRasterizer (ver SoftRasterizer::setCounters()).
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "program_cache.h"
+#include "soft_raster.h"
+#include "stream_buffer.h"
+
+enum DebugView
+{
+    DEBUG_VIEW_NONE = 0,
+    DEBUG_VIEW_OVERDRAW,  // fragmentos que pasan la profundidad por píxel
+    DEBUG_VIEW_TRIANGLES, // aristas por píxel: densidad de triángulos
+    DEBUG_VIEW_LOD,       // cajas con el nivel de detalle
+    DEBUG_VIEW_CULLED,    // cajas de los objetos descartados y dibujados
+    DEBUG_VIEW_COUNT
+};
+
+inline const char* debugViewNames[DEBUG_VIEW_COUNT] = { "ninguna", "sobredibujo", "triangulos", "lod", "descartados" };
+
+inline const char* debugViewVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec3 aColor;
+
+    uniform mat4 viewProj;
+    uniform bool fullscreen; // triángulo que cubre la pantalla, sin atributos
+
+    out vec3 Color;
+
+    void main()
+    {
+        if (fullscreen)
+        {
+            vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+            gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+        }
+        else
+            gl_Position = viewProj * vec4(aPos, 1.0);
+        Color = aColor;
+    }
+)glsl";
+
+inline const char* debugViewFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    in vec3 Color;
+
+    uniform bool fullscreen;
+    uniform vec3 tint;
+
+    void main()
+    {
+        FragColor = vec4(fullscreen ? tint : Color, 1.0);
+    }
+)glsl";
+
+class DebugViews
+{
+public:
+    static const int HEAT_LEVELS = 16;
+    static const int LOD_COLORS = 6;
+
+    // Azul, cian, verde, amarillo y rojo de 0 a 1
+    static glm::vec3 heatColor(float t)
+    {
+        t = glm::clamp(t, 0.0f, 1.0f);
+        return glm::clamp(glm::vec3(1.5f - std::abs(4.0f * t - 3.0f), 1.5f - std::abs(4.0f * t - 2.0f), 1.5f - std::abs(4.0f * t - 1.0f)),
+                          glm::vec3(0.0f), glm::vec3(1.0f));
+    }
+
+    static glm::vec3 levelColor(int level)
+    {
+        static const glm::vec3 colors[LOD_COLORS] = { glm::vec3(0.1f, 1.0f, 0.1f), glm::vec3(0.1f, 0.8f, 1.0f), glm::vec3(0.2f, 0.3f, 1.0f),
+                                                      glm::vec3(1.0f, 0.2f, 1.0f), glm::vec3(1.0f, 0.6f, 0.1f), glm::vec3(1.0f, 0.1f, 0.1f) };
+        return colors[glm::clamp(level, 0, LOD_COLORS - 1)];
+    }
+
+    // Por el nombre de debugViewNames; DEBUG_VIEW_NONE si no existe
+    static DebugView parse(const std::string& name)
+    {
+        for (int view = 1; view < DEBUG_VIEW_COUNT; ++view)
+            if (name == debugViewNames[view])
+                return DebugView(view);
+        return DEBUG_VIEW_NONE;
+    }
+
+    // stencilViews: si el destino de la escena tiene stencil (no con el G-buffer)
+    void init(ProgramCache& cache, bool _stencilViews)
+    {
+        program = cache.getProgram({ { GL_VERTEX_SHADER, debugViewVertexShaderSource },
+                                     { GL_FRAGMENT_SHADER, debugViewFragmentShaderSource } });
+        stencilViews = _stencilViews;
+        glGenVertexArrays(1, &emptyVao);
+        glGenVertexArrays(1, &lineVao);
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if (!initialized)
+            return;
+        glDeleteVertexArrays(1, &emptyVao);
+        glDeleteVertexArrays(1, &lineVao);
+        // El programa es de ProgramCache
+        initialized = false;
+    }
+
+    // La misma vista otra vez la quita
+    void toggle(DebugView next)
+    {
+        if (!stencilViews && (next == DEBUG_VIEW_OVERDRAW || next == DEBUG_VIEW_TRIANGLES))
+        {
+            std::cout << "Vista " << debugViewNames[next] << ": necesita el stencil del framebuffer por defecto" << std::endl;
+            return;
+        }
+        view = view == next ? DEBUG_VIEW_NONE : next;
+        std::cout << "Vista de depuración: " << debugViewNames[view] << std::endl;
+    }
+
+    void setView(DebugView next)
+    {
+        view = next;
+    }
+
+    DebugView getView() const
+    {
+        return view;
+    }
+
+    bool wantsBoxes() const
+    {
+        return view == DEBUG_VIEW_LOD || view == DEBUG_VIEW_CULLED;
+    }
+
+    // Las 12 aristas de la caja, para el fotograma en curso
+    void addBox(const glm::vec3& low, const glm::vec3& high, const glm::vec3& color)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+            for (int corner = 0; corner < 4; ++corner)
+            {
+                glm::vec3 from = low;
+                int other = 0;
+                for (int k = 0; k < 3; ++k)
+                    if (k != axis)
+                        from[k] = (corner >> other++) & 1 ? high[k] : low[k];
+                glm::vec3 to = from;
+                to[axis] = high[axis];
+                lines.push_back({ from, color });
+                lines.push_back({ to, color });
+            }
+    }
+
+    // Caja de una esfera envolvente
+    void addSphereBox(const glm::vec3& center, float radius, const glm::vec3& color)
+    {
+        addBox(center - glm::vec3(radius), center + glm::vec3(radius), color);
+    }
+
+    // Antes de StreamBuffer::commit(); vacía las cajas del fotograma
+    void upload(StreamBuffer& stream)
+    {
+        lineCount = 0;
+        if (initialized && !lines.empty())
+        {
+            lineData = stream.allocate(lines.size() * sizeof(LineVertex), sizeof(LineVertex));
+            if (lineData.data)
+            {
+                memcpy(lineData.data, lines.data(), lines.size() * sizeof(LineVertex));
+                glBindVertexArray(lineVao);
+                glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+                glEnableVertexAttribArray(0);
+                glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex), (void*)lineData.offset);
+                glEnableVertexAttribArray(1);
+                glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(LineVertex), (void*)(lineData.offset + sizeof(glm::vec3)));
+                glBindVertexArray(0);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                lineCount = (GLsizei)lines.size();
+            }
+        }
+        lines.clear();
+    }
+
+    // Después de la pasada previa y antes del color de la escena
+    void beginScene()
+    {
+        if (!initialized || !stencilViews || (view != DEBUG_VIEW_OVERDRAW && view != DEBUG_VIEW_TRIANGLES))
+            return;
+        glClearStencil(0);
+        glClear(GL_STENCIL_BUFFER_BIT);
+        glEnable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 0, 0xFF);
+        if (view == DEBUG_VIEW_OVERDRAW)
+            glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+        else
+        {
+            glStencilOp(GL_KEEP, GL_INCR, GL_INCR);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        }
+        counting = true;
+    }
+
+    // Tras la escena: la rampa de calor sobre el recuento o las cajas encima
+    void endScene(const glm::mat4x4& viewProj)
+    {
+        if (!initialized)
+            return;
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
+
+        if (counting)
+        {
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+            glDisable(GL_DEPTH_TEST);
+            glUniform1i(glGetUniformLocation(program, "fullscreen"), 1);
+            glBindVertexArray(emptyVao);
+            // Cada nivel pinta encima donde el recuento llega a él
+            for (int level = 0; level < HEAT_LEVELS; ++level)
+            {
+                glStencilFunc(GL_LEQUAL, level, 0xFF);
+                glUniform3fv(glGetUniformLocation(program, "tint"), 1, glm::value_ptr(heatColor(level / float(HEAT_LEVELS - 1))));
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+            }
+            glDisable(GL_STENCIL_TEST);
+            glEnable(GL_DEPTH_TEST);
+            counting = false;
+        }
+        else if (lineCount > 0 && wantsBoxes())
+        {
+            // Los descartados pueden estar detrás de otros: sin prueba de profundidad
+            if (view == DEBUG_VIEW_CULLED)
+                glDisable(GL_DEPTH_TEST);
+            glUniform1i(glGetUniformLocation(program, "fullscreen"), 0);
+            glBindVertexArray(lineVao);
+            glDrawArrays(GL_LINES, 0, lineCount);
+            glEnable(GL_DEPTH_TEST);
+        }
+
+        glBindVertexArray(0);
+        if (blend) glEnable(GL_BLEND);
+    }
+
+    // Sin ventana: el recuento de SoftRasterizer con la misma rampa
+    static std::vector<uint32_t> heatImage(const std::vector<uint16_t>& counts)
+    {
+        std::vector<uint32_t> image(counts.size());
+        for (size_t i = 0; i < counts.size(); ++i)
+        {
+            int level = std::min<int>(counts[i], HEAT_LEVELS - 1);
+            image[i] = softraster::packColor(glm::vec4(heatColor(level / float(HEAT_LEVELS - 1)), 1.0f));
+        }
+        return image;
+    }
+
+    // Sin ventana: las cajas del fotograma sobre image (fila 0 abajo), sin
+    // prueba de profundidad; las vacía como upload()
+    void drawLines(std::vector<uint32_t>& image, int width, int height, const glm::mat4x4& viewProj)
+    {
+        for (size_t i = 0; i + 1 < lines.size(); i += 2)
+        {
+            glm::vec4 from = viewProj * glm::vec4(lines[i].position, 1.0f);
+            glm::vec4 to = viewProj * glm::vec4(lines[i + 1].position, 1.0f);
+            // Recorte contra el plano cercano (w > 0)
+            const float nearW = 1e-3f;
+            if (from.w < nearW && to.w < nearW)
+                continue;
+            if (from.w < nearW)
+                from = glm::mix(from, to, (nearW - from.w) / (to.w - from.w));
+            else if (to.w < nearW)
+                to = glm::mix(to, from, (nearW - to.w) / (from.w - to.w));
+
+            glm::vec2 a((from.x / from.w * 0.5f + 0.5f) * width, (from.y / from.w * 0.5f + 0.5f) * height);
+            glm::vec2 b((to.x / to.w * 0.5f + 0.5f) * width, (to.y / to.w * 0.5f + 0.5f) * height);
+            uint32_t color = softraster::packColor(glm::vec4(lines[i].color, 1.0f));
+            int steps = (int)std::ceil(std::max(std::abs(b.x - a.x), std::abs(b.y - a.y)));
+            steps = std::min(steps, 4 * (width + height));
+            for (int step = 0; step <= steps; ++step)
+            {
+                glm::vec2 p = steps > 0 ? glm::mix(a, b, step / float(steps)) : a;
+                int x = (int)std::floor(p.x), y = (int)std::floor(p.y);
+                if (x >= 0 && y >= 0 && x < width && y < height)
+                    image[y * width + x] = color;
+            }
+        }
+        lines.clear();
+    }
+
+private:
+    struct LineVertex
+    {
+        glm::vec3 position;
+        glm::vec3 color;
+    };
+
+    DebugView view = DEBUG_VIEW_NONE;
+    bool initialized = false, stencilViews = true, counting = false;
+    GLuint program = 0, emptyVao = 0, lineVao = 0;
+    std::vector<LineVertex> lines;
+    StreamBuffer::Allocation lineData = {};
+    GLsizei lineCount = 0;
+};
+
+#endif
@@ -0,0 +1,367 @@
+#ifndef DEFERRED_RENDERER_H
+#define DEFERRED_RENDERER_H
+
+// Sombreado diferido: la geometría que recibe luz se dibuja una vez en un
+// G-buffer (albedo, normal y profundidad) y las luces se aplican después por
+// píxel, así que el coste de las luces no se multiplica por los triángulos.
+//
+// Los receptores no cambian: en lugar de shadowSampleShaderSource y
+// clusteredLightsShaderSource enlazan gBufferWriteShaderSource, cuyos
+// applyShadows() y applyLights() escriben la normal (de las derivadas de la
+// posición, como en ClusteredLights) en el segundo color y devuelven el albedo
+// tal cual, que acaba en el primero. Lo que no recibe luz (cielo, impostores)
+// y lo transparente se dibujan después, en forward, contra la profundidad que
+// deja shade().
+//
+// shade() dibuja en el framebuffer que estaba enlazado en beginGeometry() (el
+// de la ventana o el de DynamicResolution):
+//   - un triángulo de pantalla completa con la luna y sus sombras (el mismo
+//     applyShadows() de ShadowMaps) y las luces puntuales, que usan los clusters
+//     que ClusteredLights reparte en la CPU (tiles de pantalla por rodajas de
+//     profundidad); además copia la profundidad del G-buffer con gl_FragDepth;
+//   - el foco del OVNI como volumen de luz: un cono generado en el vertex shader
+//     que encierra su alcance, sumado solo en los píxeles que cubre.
+//
+// El G-buffer solo crece: se dibuja en el mismo viewport que el destino, así
+// que cuando DynamicResolution cambia el tamaño no se reserva nada; las luces
+// reciben la parte dibujada (gBufferViewport).
+//
+// El G-buffer no tiene multisampling: el pasto descarta por alfa en lugar de
+// usar alpha-to-coverage (ver GrassRenderer::disableAlphaToCoverage()).
+//
+// Uso por fotograma: beginGeometry() antes de los receptores y shade() después
+// de la cola de opacos; applySwaps() con lo que devuelve ProgramCache::update().
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "clustered_lights.h"
+#include "program_cache.h"
+#include "shadow_maps.h"
+
+// Sustituye a las bibliotecas de iluminación en los receptores del G-buffer.
+// El albedo sale por el FragColor del receptor (location 0)
+inline const char* gBufferWriteShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 1) out vec4 GNormal; // normal * 0.5 + 0.5; a = 0: sin luz
+
+    void writeNormal(vec3 worldPos)
+    {
+        GNormal = vec4(normalize(cross(dFdx(worldPos), dFdy(worldPos))) * 0.5 + 0.5, 1.0);
+    }
+
+    vec3 applyShadows(vec3 color, vec3 worldPos)
+    {
+        writeNormal(worldPos);
+        return color;
+    }
+
+    vec3 applyLights(vec3 albedo, vec3 worldPos)
+    {
+        writeNormal(worldPos);
+        return vec3(0.0);
+    }
+)glsl";
+
+// Lectura del G-buffer en el píxel actual, común a los dos pases de luz
+inline const char* gBufferReadShaderSource = R"glsl(
+    #version 330 core
+    uniform sampler2D gAlbedo;
+    uniform sampler2D gNormal;
+    uniform sampler2D gDepth;
+    uniform mat4 inverseViewProj;
+    uniform vec4 gBufferViewport; // la parte dibujada: origen y tamaño
+
+    // false: fondo o geometría sin luz
+    bool readGBuffer(out vec4 albedo, out vec3 worldPos, out vec3 normal, out float depth)
+    {
+        ivec2 texel = ivec2(gl_FragCoord.xy);
+        albedo = texelFetch(gAlbedo, texel, 0);
+        depth = texelFetch(gDepth, texel, 0).r;
+        vec4 encoded = texelFetch(gNormal, texel, 0);
+        vec4 position = inverseViewProj * vec4((gl_FragCoord.xy - gBufferViewport.xy) / gBufferViewport.zw * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+        worldPos = position.xyz / position.w;
+        normal = normalize(encoded.xyz * 2.0 - 1.0);
+        return encoded.a > 0.0;
+    }
+)glsl";
+
+inline const char* deferredScreenVertexShaderSource = R"glsl(
+    #version 330 core
+
+    void main()
+    {
+        // Un triángulo que cubre la pantalla, sin vértices
+        vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+    }
+)glsl";
+
+inline const char* deferredLightingFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    bool readGBuffer(out vec4 albedo, out vec3 worldPos, out vec3 normal, out float depth); // gBufferReadShaderSource
+    vec3 applyShadows(vec3 color, vec3 worldPos);              // shadowSampleShaderSource
+    vec3 applyLights(vec3 albedo, vec3 worldPos, vec3 normal); // clusteredLightsShaderSource
+
+    void main()
+    {
+        vec4 albedo;
+        vec3 worldPos, normal;
+        float depth;
+        bool lit = readGBuffer(albedo, worldPos, normal, depth);
+        gl_FragDepth = depth;
+        FragColor = vec4(lit ? applyShadows(albedo.rgb, worldPos) + applyLights(albedo.rgb, worldPos, normal) : albedo.rgb, 1.0);
+    }
+)glsl";
+
+// Cono unidad: vértice en el origen y base de radio 1 en z = -1
+inline const char* spotVolumeVertexShaderSource = R"glsl(
+    #version 330 core
+    uniform mat4 viewProj;
+    uniform mat4 volume;
+    uniform int segments;
+
+    void main()
+    {
+        int triangle = gl_VertexID / 3;
+        int corner = gl_VertexID % 3;
+        bool cap = triangle >= segments;
+        vec3 position = vec3(0.0, 0.0, cap ? -1.0 : 0.0);
+        if (corner > 0)
+        {
+            // Lateral: vértice, i, i + 1; tapa: centro, i + 1, i (las dos hacia fuera)
+            int ring = triangle % segments + (cap ? 2 - corner : corner - 1);
+            float angle = 6.28318531 * float(ring) / float(segments);
+            position = vec3(cos(angle), sin(angle), -1.0);
+        }
+        gl_Position = viewProj * volume * vec4(position, 1.0);
+    }
+)glsl";
+
+inline const char* spotVolumeFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    uniform vec3 spotColor;
+
+    bool readGBuffer(out vec4 albedo, out vec3 worldPos, out vec3 normal, out float depth); // gBufferReadShaderSource
+    float spotLight(vec3 worldPos);                                                         // shadowSampleShaderSource
+
+    void main()
+    {
+        vec4 albedo;
+        vec3 worldPos, normal;
+        float depth;
+        if (!readGBuffer(albedo, worldPos, normal, depth))
+            discard;
+        FragColor = vec4(albedo.rgb * spotColor * spotLight(worldPos), 1.0);
+    }
+)glsl";
+
+class DeferredRenderer
+{
+public:
+    static const int VOLUME_SEGMENTS = 32;
+    static const int ALBEDO_UNIT = 11;
+    static const int NORMAL_UNIT = 12;
+    static const int DEPTH_UNIT = 13;
+
+    // El G-buffer se crea en el primer beginGeometry(), del tamaño del viewport
+    void init(ProgramCache& cache)
+    {
+        lightingProgram = cache.getProgram({ { GL_VERTEX_SHADER, deferredScreenVertexShaderSource },
+                                             { GL_FRAGMENT_SHADER, deferredLightingFragmentShaderSource },
+                                             { GL_FRAGMENT_SHADER, gBufferReadShaderSource, true },
+                                             { GL_FRAGMENT_SHADER, shadowSampleShaderSource, true },
+                                             { GL_FRAGMENT_SHADER, clusteredLightsShaderSource, true } });
+        spotProgram = cache.getProgram({ { GL_VERTEX_SHADER, spotVolumeVertexShaderSource },
+                                         { GL_FRAGMENT_SHADER, spotVolumeFragmentShaderSource },
+                                         { GL_FRAGMENT_SHADER, gBufferReadShaderSource, true },
+                                         { GL_FRAGMENT_SHADER, shadowSampleShaderSource, true } });
+        glGenVertexArrays(1, &emptyVao);
+        glGenFramebuffers(1, &fbo);
+        initialized = true;
+        std::cout << "Diferido: G-buffer de albedo, normal y profundidad" << std::endl;
+    }
+
+    void destroy()
+    {
+        if (!initialized)
+            return;
+        glDeleteTextures(3, textures);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteVertexArrays(1, &emptyVao);
+        // Los programas son de ProgramCache
+        initialized = false;
+    }
+
+    // Los programas se comparten con la caché: al recargar las bibliotecas de luz cambian
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+        {
+            if (lightingProgram == swap.oldProgram)
+                lightingProgram = swap.newProgram;
+            if (spotProgram == swap.oldProgram)
+                spotProgram = swap.newProgram;
+        }
+    }
+
+    // Deja el G-buffer como destino; el albedo se borra con el color de fondo
+    void beginGeometry()
+    {
+        if (!initialized)
+            return;
+
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        int width = viewport[0] + viewport[2], height = viewport[1] + viewport[3];
+        if (width > size.x || height > size.y)
+            resize(std::max(width, size.x), std::max(height, size.y));
+
+        GLfloat background[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, background);
+        const GLfloat noNormal[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLfloat farDepth = 1.0f;
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glClearBufferfv(GL_COLOR, 0, background);
+        glClearBufferfv(GL_COLOR, 1, noNormal);
+        glClearBufferfv(GL_DEPTH, 0, &farDepth);
+    }
+
+    // Tras los receptores: vuelve al destino de antes del G-buffer y aplica las luces.
+    // Fija los uniforms de sombras y luces en sus propios programas
+    void shade(const glm::mat4x4& view, const glm::mat4x4& proj, const ShadowMaps& shadows, const ClusteredLights& lights)
+    {
+        if (!initialized)
+            return;
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+
+        glm::mat4x4 viewProj = proj * view;
+        glm::mat4x4 inverseViewProj = glm::inverse(viewProj);
+        const int units[3] = { ALBEDO_UNIT, NORMAL_UNIT, DEPTH_UNIT };
+        for (int i = 0; i < 3; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + units[i]);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        // Luna y luces puntuales; el foco va en su volumen
+        shadows.bindReceiver(lightingProgram);
+        lights.bindReceiver(lightingProgram);
+        bindGBuffer(lightingProgram, inverseViewProj);
+        glUniform1i(glGetUniformLocation(lightingProgram, "spotEnabled"), 0);
+
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+        glDepthFunc(GL_ALWAYS);
+        glBindVertexArray(emptyVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glDepthFunc(GL_LESS);
+
+        if (shadows.isSpotEnabled())
+        {
+            shadows.bindReceiver(spotProgram);
+            bindGBuffer(spotProgram, inverseViewProj);
+            glUniformMatrix4fv(glGetUniformLocation(spotProgram, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
+            glUniformMatrix4fv(glGetUniformLocation(spotProgram, "volume"), 1, GL_FALSE, glm::value_ptr(spotVolume(shadows)));
+            glUniform1i(glGetUniformLocation(spotProgram, "segments"), VOLUME_SEGMENTS);
+
+            // Solo las caras de atrás: cada píxel una vez, también con la cámara dentro del cono
+            GLboolean cull = glIsEnabled(GL_CULL_FACE);
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glDisable(GL_DEPTH_TEST);
+            glDepthMask(GL_FALSE);
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+            glDrawArrays(GL_TRIANGLES, 0, VOLUME_SEGMENTS * 2 * 3);
+            glCullFace(GL_BACK);
+            if (!cull) glDisable(GL_CULL_FACE);
+            glDepthMask(GL_TRUE);
+            glEnable(GL_DEPTH_TEST);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        glBindVertexArray(0);
+        if (blend) glEnable(GL_BLEND);
+        else glDisable(GL_BLEND);
+    }
+
+    // El reservado, no el del viewport actual
+    glm::ivec2 getSize() const
+    {
+        return size;
+    }
+
+private:
+    GLuint fbo = 0, emptyVao = 0;
+    GLint target = 0; // el destino de shade()
+    GLuint textures[3] = { 0, 0, 0 }; // albedo, normal, profundidad
+    GLuint lightingProgram = 0, spotProgram = 0;
+    glm::ivec2 size = glm::ivec2(0);
+    GLint viewport[4] = {}; // el de beginGeometry()
+    bool initialized = false;
+
+    void resize(int width, int height)
+    {
+        if (textures[0])
+            glDeleteTextures(3, textures);
+        size = glm::ivec2(width, height);
+
+        const GLenum internalFormats[3] = { GL_RGBA8, GL_RGB10_A2, GL_DEPTH_COMPONENT24 };
+        const GLenum formats[3] = { GL_RGBA, GL_RGBA, GL_DEPTH_COMPONENT };
+        const GLenum types[3] = { GL_UNSIGNED_BYTE, GL_UNSIGNED_INT_2_10_10_10_REV, GL_UNSIGNED_INT };
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; ++i)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], width, height, 0, formats[i], types[i], nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[0], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, textures[1], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, textures[2], 0);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Diferido: el G-buffer no está completo" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    // Uniforms de gBufferReadShaderSource (deja el programa en uso)
+    void bindGBuffer(GLuint program, const glm::mat4x4& inverseViewProj) const
+    {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "gAlbedo"), ALBEDO_UNIT);
+        glUniform1i(glGetUniformLocation(program, "gNormal"), NORMAL_UNIT);
+        glUniform1i(glGetUniformLocation(program, "gDepth"), DEPTH_UNIT);
+        glUniformMatrix4fv(glGetUniformLocation(program, "inverseViewProj"), 1, GL_FALSE, glm::value_ptr(inverseViewProj));
+        glUniform4f(glGetUniformLocation(program, "gBufferViewport"), (float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]);
+    }
+
+    // El cono unidad llevado al foco; el polígono de la base se agranda para
+    // que su lado, y no solo sus esquinas, quede fuera del borde de la luz
+    static glm::mat4x4 spotVolume(const ShadowMaps& shadows)
+    {
+        const glm::vec3& position = shadows.getSpotPosition();
+        const glm::vec3& direction = shadows.getSpotDirection();
+        glm::vec3 cone = shadows.getSpotCone();
+        float range = cone.z;
+        float radius = range * std::tan(std::acos(cone.x)) / std::cos(3.14159265f / VOLUME_SEGMENTS);
+        glm::vec3 up = std::abs(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+        return glm::scale(glm::inverse(glm::lookAt(position, position + direction, up)), glm::vec3(radius, radius, range));
+    }
+};
+
+#endif
@@ -0,0 +1,337 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+// Resolución dinámica: la escena se dibuja en un destino fuera de pantalla y
+// su resolución se ajusta cada fotograma para mantener el tiempo de GPU.
+//
+// El destino (color RGBA8 y profundidad con stencil, con multisampling si se
+// pide) se reserva una vez al tamaño de la ventana y se dibuja solo en la
+// esquina de getRenderSize(); cambiar la escala no reserva nada. Sin
+// multisampling son texturas que se pueden leer (getColorTexture() y
+// getDepthTexture(), para TemporalAA); con él, present() resuelve antes las
+// muestras a una textura. present() escala a la ventana con un filtro
+// bilineal y un realce de bordes limitado por los vecinos (sin halos), más
+// fuerte cuanto más se escala.
+//
+// El tiempo se mide con una consulta GL_TIME_ELAPSED por fotograma solo sobre
+// lo que escala: desde bindTarget() hasta antes del escalado de present(). Así
+// no cuenta lo que la GPU pasa esperando a que la CPU envíe (un fotograma
+// limitado por la CPU no baja la resolución) ni las sombras, que no dependen
+// de ella; las de ShadowMaps terminan antes de bindTarget() y no se anidan. Se
+// lee QUERY_COUNT fotogramas después sin esperar a la GPU. Como los píxeles crecen con el cuadrado de la escala, la escala deseada
+// es escala * sqrt(objetivo / medido); solo se mueve fuera de una banda
+// alrededor del objetivo y a medio camino cada vez, y se redondea a múltiplos
+// de SIZE_STEP píxeles para que el tamaño no cambie en cada fotograma.
+//
+// Uso por fotograma: beginFrame() antes de usar getRenderSize(), bindTarget()
+// tras las pasadas a otras texturas (sombras) y present() al terminar la
+// escena. Quien enlace otro framebuffer después de bindTarget() debe volver a
+// este (ver DeferredRenderer y HiZBuffer).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+#include "program_cache.h"
+
+inline const char* upscaleVertexShaderSource = R"glsl(
+    #version 330 core
+    out vec2 TexCoord;
+
+    // Triángulo que cubre la pantalla, sin atributos
+    void main()
+    {
+        vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        TexCoord = position;
+        gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+    }
+)glsl";
+
+inline const char* upscaleFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    in vec2 TexCoord;
+
+    uniform sampler2D source;
+    uniform vec2 renderSize; // la parte dibujada de source, en texels
+    uniform float sharpness;
+
+    vec3 fetch(vec2 texel)
+    {
+        // Sin salir de la parte dibujada
+        vec2 clamped = clamp(texel, vec2(0.5), renderSize - 0.5);
+        return texture(source, clamped / vec2(textureSize(source, 0))).rgb;
+    }
+
+    void main()
+    {
+        vec2 texel = TexCoord * renderSize;
+        vec3 center = fetch(texel);
+        vec3 north = fetch(texel + vec2(0.0, 1.0));
+        vec3 south = fetch(texel - vec2(0.0, 1.0));
+        vec3 east = fetch(texel + vec2(1.0, 0.0));
+        vec3 west = fetch(texel - vec2(1.0, 0.0));
+
+        vec3 low = min(center, min(min(north, south), min(east, west)));
+        vec3 high = max(center, max(max(north, south), max(east, west)));
+        vec3 sharpened = center + sharpness * (4.0 * center - north - south - east - west) * 0.25;
+        FragColor = vec4(clamp(sharpened, low, high), 1.0);
+    }
+)glsl";
+
+class DynamicResolution
+{
+public:
+    static const int QUERY_COUNT = 4;
+    static const int SIZE_STEP = 8;
+    static constexpr float MIN_SCALE = 0.5f;
+    static constexpr float SHARPNESS = 0.6f;
+    static constexpr float BAND_LOW = 0.85f;  // con menos tiempo que esto, sube
+    static constexpr float BAND_HIGH = 1.05f; // con más, baja
+
+    // El tamaño de la ventana; samples = 0 sin multisampling
+    void init(ProgramCache& cache, int _maxWidth, int _maxHeight, int _samples, float _targetMilliseconds)
+    {
+        maxWidth = _maxWidth;
+        maxHeight = _maxHeight;
+        samples = _samples;
+        targetMilliseconds = _targetMilliseconds;
+        scale = 1.0f;
+        updateRenderSize();
+
+        glGenTextures(1, &resolvedTexture);
+        glBindTexture(GL_TEXTURE_2D, resolvedTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, maxWidth, maxHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &sceneFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+        bool complete = true;
+        if (samples > 0)
+        {
+            glGenRenderbuffers(2, renderbuffers);
+            glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, maxWidth, maxHeight);
+            glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, maxWidth, maxHeight);
+            glBindRenderbuffer(GL_RENDERBUFFER, 0);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+            complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+            glGenFramebuffers(1, &resolveFbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolvedTexture, 0);
+        }
+        else
+        {
+            // Sin muestras se dibuja directamente en las texturas
+            glGenTextures(1, &depthTexture);
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, maxWidth, maxHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolvedTexture, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        }
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (!complete)
+        {
+            std::cerr << "Resolución dinámica: el destino no está completo, se dibuja en la ventana" << std::endl;
+            destroy();
+            return;
+        }
+
+        program = cache.getProgram({ { GL_VERTEX_SHADER, upscaleVertexShaderSource },
+                                     { GL_FRAGMENT_SHADER, upscaleFragmentShaderSource } });
+        glGenVertexArrays(1, &emptyVao);
+        glGenQueries(QUERY_COUNT, queries);
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if (queries[0]) glDeleteQueries(QUERY_COUNT, queries);
+        if (renderbuffers[0]) glDeleteRenderbuffers(2, renderbuffers);
+        if (resolvedTexture) glDeleteTextures(1, &resolvedTexture);
+        if (depthTexture) glDeleteTextures(1, &depthTexture);
+        if (sceneFbo) glDeleteFramebuffers(1, &sceneFbo);
+        if (resolveFbo) glDeleteFramebuffers(1, &resolveFbo);
+        if (emptyVao) glDeleteVertexArrays(1, &emptyVao);
+        // El programa es de ProgramCache
+        queries[0] = renderbuffers[0] = resolvedTexture = depthTexture = sceneFbo = resolveFbo = emptyVao = 0;
+        initialized = false;
+    }
+
+    // Lee la medida más antigua que ya haya llegado y ajusta la escala
+    void beginFrame()
+    {
+        if (!initialized)
+            return;
+        readQuery();
+        frameStarted = true;
+    }
+
+    // Destino de la escena con el viewport de getRenderSize(), ya borrado.
+    // La primera vez en el fotograma empieza a medir
+    void bindTarget()
+    {
+        if (!initialized)
+            return;
+        if (frameStarted && !timing)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, queries[queryIndex]);
+            timing = true;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFbo);
+        glViewport(0, 0, renderWidth, renderHeight);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+
+    // Resuelve y escala a la ventana; deja enlazado el framebuffer por defecto.
+    // source: otra imagen del tamaño del destino con lo dibujado en la misma
+    // esquina (la de TemporalAA); 0, la de la escena
+    void present(GLuint source = 0)
+    {
+        if (!initialized)
+            return;
+        if (samples > 0)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFbo);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFbo);
+            glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+        // El escalado cuesta lo mismo a cualquier escala
+        if (timing)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            queryPending[queryIndex] = true;
+            queryIndex = (queryIndex + 1) % QUERY_COUNT;
+            timing = false;
+        }
+        frameStarted = false;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, maxWidth, maxHeight);
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, source ? source : resolvedTexture);
+        glUniform1i(glGetUniformLocation(program, "source"), 0);
+        glUniform2f(glGetUniformLocation(program, "renderSize"), (float)renderWidth, (float)renderHeight);
+        glUniform1f(glGetUniformLocation(program, "sharpness"), SHARPNESS * std::min(1.0f, 2.0f * (maxWidth / (float)renderWidth - 1.0f)));
+        glBindVertexArray(emptyVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (depthTest) glEnable(GL_DEPTH_TEST);
+        if (blend) glEnable(GL_BLEND);
+
+        scaleTotal += scale;
+        ++frames;
+    }
+
+    // Tras init(); si el destino no se pudo crear, el de la ventana
+    glm::ivec2 getRenderSize() const
+    {
+        return glm::ivec2(renderWidth, renderHeight);
+    }
+
+    bool isEnabled() const
+    {
+        return initialized;
+    }
+
+    // Sin multisampling: lo dibujado hasta ahora, en la esquina de getRenderSize()
+    GLuint getColorTexture() const
+    {
+        return samples > 0 ? 0 : resolvedTexture;
+    }
+
+    GLuint getDepthTexture() const
+    {
+        return depthTexture;
+    }
+
+    float getAverageScale() const
+    {
+        return frames > 0 ? float(scaleTotal / frames) : scale;
+    }
+
+    double getAverageMilliseconds() const
+    {
+        return measuredFrames > 0 ? totalMilliseconds / measuredFrames : 0.0;
+    }
+
+    float getTargetMilliseconds() const
+    {
+        return targetMilliseconds;
+    }
+
+private:
+    int maxWidth = 0, maxHeight = 0, samples = 0;
+    int renderWidth = 0, renderHeight = 0;
+    float scale = 1.0f, targetMilliseconds = 16.6f;
+    bool initialized = false;
+
+    GLuint renderbuffers[2] = {};
+    GLuint sceneFbo = 0, resolveFbo = 0, resolvedTexture = 0, depthTexture = 0;
+    GLuint program = 0, emptyVao = 0;
+
+    GLuint queries[QUERY_COUNT] = {}; // una por fotograma
+    bool queryPending[QUERY_COUNT] = {};
+    int queryIndex = 0;
+    bool frameStarted = false, timing = false;
+
+    double scaleTotal = 0.0, totalMilliseconds = 0.0;
+    unsigned frames = 0, measuredFrames = 0;
+
+    void readQuery()
+    {
+        if (!queryPending[queryIndex])
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[queryIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[queryIndex], GL_QUERY_RESULT, &elapsed);
+            double milliseconds = elapsed / 1.0e6;
+            totalMilliseconds += milliseconds;
+            ++measuredFrames;
+            adjust(milliseconds);
+        }
+        queryPending[queryIndex] = false;
+    }
+
+    void adjust(double milliseconds)
+    {
+        if (milliseconds <= 0.0 || (milliseconds >= targetMilliseconds * BAND_LOW && milliseconds <= targetMilliseconds * BAND_HIGH))
+            return;
+        float desired = glm::clamp(scale * (float)std::sqrt(targetMilliseconds / milliseconds), MIN_SCALE, 1.0f);
+        scale += (desired - scale) * 0.5f;
+        updateRenderSize();
+    }
+
+    void updateRenderSize()
+    {
+        auto snap = [](float size, int limit) {
+            return std::min(limit, std::max(SIZE_STEP, (int)std::lround(size / SIZE_STEP) * SIZE_STEP));
+        };
+        renderWidth = snap(maxWidth * scale, maxWidth);
+        renderHeight = snap(maxHeight * scale, maxHeight);
+    }
+};
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+// Avisa cuando cambian ficheros concretos de un directorio.
+//
+// En Linux usa inotify sobre el directorio (IN_CLOSE_WRITE e IN_MOVED_TO, que
+// es como guardan los editores que escriben a un temporal y renombran) sin
+// bloquear: poll() solo lee los eventos pendientes. En el resto de sistemas
+// compara la fecha de modificación de cada fichero, como mucho cada
+// POLL_INTERVAL segundos. En los dos casos poll() devuelve cada fichero
+// cambiado una sola vez aunque haya llegado más de un evento.
+//
+// No depende de OpenGL.
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+class FileWatcher
+{
+public:
+    static constexpr double POLL_INTERVAL = 0.25;
+
+    FileWatcher() = default;
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    ~FileWatcher()
+    {
+        stop();
+    }
+
+    // Los ficheros se añaden después con watchFile(), todos dentro de directory
+    void start(const std::string& _directory)
+    {
+        stop();
+        directory = _directory;
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd >= 0 && inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+#endif
+        lastPoll = std::chrono::steady_clock::now();
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+#endif
+        files.clear();
+    }
+
+    void watchFile(const std::string& name)
+    {
+        WatchedFile file;
+        file.name = name;
+        file.path = (std::filesystem::path(directory) / name).string();
+        file.stamp = stampOf(file.path);
+        files.push_back(file);
+    }
+
+    // Rutas de los ficheros que han cambiado desde la última llamada
+    std::vector<std::string> poll()
+    {
+        std::vector<std::string> changed;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            alignas(inotify_event) char buffer[4096];
+            ssize_t length;
+            while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* cursor = buffer; cursor < buffer + length;)
+                {
+                    const inotify_event* event = (const inotify_event*)cursor;
+                    if (event->len > 0)
+                        for (const WatchedFile& file : files)
+                            if (file.name == event->name)
+                                addUnique(changed, file.path);
+                    cursor += sizeof(inotify_event) + event->len;
+                }
+            }
+            return changed;
+        }
+#endif
+        auto now = std::chrono::steady_clock::now();
+        if (std::chrono::duration<double>(now - lastPoll).count() < POLL_INTERVAL)
+            return changed;
+        lastPoll = now;
+        for (WatchedFile& file : files)
+        {
+            auto stamp = stampOf(file.path);
+            if (stamp != file.stamp)
+            {
+                file.stamp = stamp;
+                addUnique(changed, file.path);
+            }
+        }
+        return changed;
+    }
+
+private:
+    struct WatchedFile
+    {
+        std::string name, path;
+        std::filesystem::file_time_type stamp;
+    };
+
+    std::string directory;
+    std::vector<WatchedFile> files;
+    std::chrono::steady_clock::time_point lastPoll;
+#ifdef __linux__
+    int fd = -1;
+#endif
+
+    static std::filesystem::file_time_type stampOf(const std::string& path)
+    {
+        std::error_code ec;
+        auto stamp = std::filesystem::last_write_time(path, ec);
+        return ec ? std::filesystem::file_time_type() : stamp;
+    }
+
+    static void addUnique(std::vector<std::string>& paths, const std::string& path)
+    {
+        if (std::find(paths.begin(), paths.end(), path) == paths.end())
+            paths.push_back(path);
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+// Constantes, entradas y utilidades de OpenGL que el cargador glad del
+// proyecto (perfil 3.3) no declara. Las funciones posteriores a 3.3 se cargan
+// en loadGLExtensions() y se llaman a través de glext; valen nullptr si el
+// driver no las ofrece.
+
+#include <cstring>
+
+// EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// ARB_buffer_storage (4.4)
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+// ARB_draw_indirect (4.0)
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// ARB_get_program_binary (4.1)
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// ARB_parallel_shader_compile
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_ARB
+#define GL_MAX_SHADER_COMPILER_THREADS_ARB 0x91B0
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+
+// ARB_compute_shader y ARB_shader_storage_buffer_object (4.3)
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+struct GLExtensions
+{
+    int major = 3, minor = 3;
+
+    void (APIENTRYP bufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags) = nullptr;
+    // Con baseInstance (4.2), que es lo que elige la matriz de cada comando
+    void (APIENTRYP multiDrawElementsIndirect)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride) = nullptr;
+    void (APIENTRYP drawElementsIndirect)(GLenum mode, GLenum type, const void* indirect) = nullptr;
+    void (APIENTRYP drawElementsInstancedBaseVertexBaseInstance)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount, GLint basevertex, GLuint baseinstance) = nullptr;
+    void (APIENTRYP dispatchCompute)(GLuint groupsX, GLuint groupsY, GLuint groupsZ) = nullptr;
+    void (APIENTRYP memoryBarrier)(GLbitfield barriers) = nullptr;
+    void (APIENTRYP getProgramBinary)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary) = nullptr;
+    void (APIENTRYP programBinary)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length) = nullptr;
+    void (APIENTRYP programParameteri)(GLuint program, GLenum pname, GLint value) = nullptr;
+    void (APIENTRYP maxShaderCompilerThreads)(GLuint count) = nullptr;
+
+    bool hasVersion(int _major, int _minor) const
+    {
+        return major > _major || (major == _major && minor >= _minor);
+    }
+};
+
+inline GLExtensions glext;
+
+inline bool hasGLExtension(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; ++i)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Tras gladLoadGL(), con el mismo cargador
+inline void loadGLExtensions(GLADloadfunc load)
+{
+    glGetIntegerv(GL_MAJOR_VERSION, &glext.major);
+    glGetIntegerv(GL_MINOR_VERSION, &glext.minor);
+
+    if (glext.hasVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+        glext.bufferStorage = (decltype(glext.bufferStorage))load("glBufferStorage");
+    if (glext.hasVersion(4, 3) || (hasGLExtension("GL_ARB_multi_draw_indirect") && hasGLExtension("GL_ARB_base_instance")))
+    {
+        glext.multiDrawElementsIndirect = (decltype(glext.multiDrawElementsIndirect))load("glMultiDrawElementsIndirect");
+        glext.drawElementsInstancedBaseVertexBaseInstance = (decltype(glext.drawElementsInstancedBaseVertexBaseInstance))load("glDrawElementsInstancedBaseVertexBaseInstance");
+    }
+    if (glext.hasVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        glext.getProgramBinary = (decltype(glext.getProgramBinary))load("glGetProgramBinary");
+        glext.programBinary = (decltype(glext.programBinary))load("glProgramBinary");
+        glext.programParameteri = (decltype(glext.programParameteri))load("glProgramParameteri");
+    }
+    if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        glext.maxShaderCompilerThreads = (decltype(glext.maxShaderCompilerThreads))load("glMaxShaderCompilerThreadsARB");
+    else if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        glext.maxShaderCompilerThreads = (decltype(glext.maxShaderCompilerThreads))load("glMaxShaderCompilerThreadsKHR");
+    if (glext.hasVersion(4, 3))
+    {
+        glext.drawElementsIndirect = (decltype(glext.drawElementsIndirect))load("glDrawElementsIndirect");
+        glext.dispatchCompute = (decltype(glext.dispatchCompute))load("glDispatchCompute");
+        glext.memoryBarrier = (decltype(glext.memoryBarrier))load("glMemoryBarrier");
+    }
+}
+
+#endif
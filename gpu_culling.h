@@ -0,0 +1,552 @@
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+// Culling en la GPU de las instancias estáticas (árboles, pasto...).
+//
+// Matrices y esferas envolventes se suben una sola vez en upload(); cada
+// fotograma cull() prueba las esferas contra el frustum en la GPU y draw()
+// dibuja solo las visibles. La CPU ya no toca datos por instancia, así que el
+// coste por fotograma no depende del número de instancias.
+//
+// Con GL 4.3 un compute shader escribe las matrices visibles en un SSBO y
+// cuenta las instancias de cada grupo con atomicAdd directamente en los
+// comandos indirectos. En 3.3 se usa transform feedback: un vertex shader
+// prueba cada instancia (un punto por instancia, sin rasterizar) y un geometry
+// shader emite solo las visibles. El número escrito se lee con una query cuando
+// ya está (normalmente un fotograma después) para no esperar a la GPU, así que
+// se dibuja una lista anterior con las esferas algo infladas para tapar el retraso.
+//
+// Con setOcclusion() las instancias también se prueban contra la pirámide de
+// profundidad de un fotograma anterior (ver HiZBuffer).
+//
+// Con setLodFade() una malla deja de dibujarse a partir de cierta distancia y
+// antes se funde por tramado con su impostor (ver ImpostorRenderer).
+//
+// Cada grupo (misma malla y textura) es un dibujo instanciado.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gl_ext.h"
+#include "mesh_arena.h"
+#include "program_cache.h"
+
+// Compartido por los dos caminos (va tras la línea #version, ver abajo)
+inline const char* cullOcclusionSource = R"glsl(
+    uniform sampler2D hiz;
+    uniform mat4 hizViewProj;
+    uniform ivec2 hizSize; // nivel 0
+    uniform int hizLevels;
+    uniform bool occlusion;
+
+    bool isOccluded(vec4 sphere)
+    {
+        if (!occlusion)
+            return false;
+
+        vec2 minUv = vec2(1.0), maxUv = vec2(0.0);
+        float minDepth = 1.0;
+        for (int i = 0; i < 8; ++i)
+        {
+            vec3 corner = sphere.xyz + sphere.w * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+            vec4 clip = hizViewProj * vec4(corner, 1.0);
+            if (clip.w <= 0.0)
+                return false;
+            vec2 uv = clip.xy / clip.w * 0.5 + 0.5;
+            minUv = min(minUv, uv);
+            maxUv = max(maxUv, uv);
+            minDepth = min(minDepth, clip.z / clip.w * 0.5 + 0.5);
+        }
+        if (any(lessThan(maxUv, vec2(0.0))) || any(greaterThan(minUv, vec2(1.0))))
+            return false;
+        minUv = clamp(minUv, 0.0, 1.0);
+        maxUv = clamp(maxUv, 0.0, 1.0);
+
+        int level = 0;
+        ivec2 size = hizSize;
+        ivec2 low = min(ivec2(minUv * vec2(size)), size - 1);
+        ivec2 high = min(ivec2(maxUv * vec2(size)), size - 1);
+        while (level + 1 < hizLevels && (high.x - low.x > 1 || high.y - low.y > 1))
+        {
+            ++level;
+            size = max(size / 2, ivec2(1));
+            low = min(ivec2(minUv * vec2(size)), size - 1);
+            high = min(ivec2(maxUv * vec2(size)), size - 1);
+        }
+
+        float farthest = 0.0;
+        for (int y = low.y; y <= high.y; ++y)
+            for (int x = low.x; x <= high.x; ++x)
+                farthest = max(farthest, texelFetch(hiz, ivec2(x, y), level).r);
+        return minDepth > farthest;
+    }
+)glsl";
+
+inline const char* cullComputeShaderSource = R"glsl(
+    layout (local_size_x = 64) in;
+
+    struct Instance
+    {
+        mat4 model;
+        vec4 sphere; // centro en el mundo y radio
+        uint group;
+        float maxDistance; // 0: sin límite
+        uint padding1, padding2;
+    };
+
+    struct Command
+    {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int baseVertex;
+        uint baseInstance;
+    };
+
+    layout (std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+    layout (std430, binding = 1) writeonly buffer Visible { mat4 visible[]; };
+    layout (std430, binding = 2) buffer Commands { Command commands[]; };
+
+    uniform vec4 planes[6];
+    uniform vec3 eye;
+    uniform uint instanceCount;
+
+    void main()
+    {
+        uint id = gl_GlobalInvocationID.x;
+        if (id >= instanceCount)
+            return;
+
+        vec4 sphere = instances[id].sphere;
+        for (int i = 0; i < 6; ++i)
+            if (dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w)
+                return;
+        float maxDistance = instances[id].maxDistance;
+        if (maxDistance > 0.0 && length(eye - instances[id].model[3].xyz) > maxDistance)
+            return;
+        if (isOccluded(sphere))
+            return;
+
+        uint group = instances[id].group;
+        uint slot = atomicAdd(commands[group].instanceCount, 1u);
+        visible[commands[group].baseInstance + slot] = instances[id].model;
+    }
+)glsl";
+
+inline const char* cullVertexShaderSource = R"glsl(
+    layout (location = 0) in mat4 aModel;
+    layout (location = 4) in vec4 aSphere;
+    layout (location = 5) in float aMaxDistance;
+
+    out mat4 vModel;
+    out float vVisible;
+
+    uniform vec4 planes[6];
+    uniform vec3 eye;
+    uniform float radiusScale;
+
+    void main()
+    {
+        float radius = aSphere.w * radiusScale;
+        vVisible = 1.0;
+        for (int i = 0; i < 6; ++i)
+            if (dot(planes[i].xyz, aSphere.xyz) + planes[i].w < -radius)
+                vVisible = 0.0;
+        if (aMaxDistance > 0.0 && length(eye - aModel[3].xyz) > aMaxDistance)
+            vVisible = 0.0;
+        if (vVisible > 0.5 && isOccluded(vec4(aSphere.xyz, radius)))
+            vVisible = 0.0;
+        vModel = aModel;
+    }
+)glsl";
+
+// Las fuentes completas que se compilan: versión, parte común y la del camino
+inline const std::string cullComputeProgramSource = std::string("#version 430 core\n") + cullOcclusionSource + cullComputeShaderSource;
+inline const std::string cullVertexProgramSource = std::string("#version 330 core\n") + cullOcclusionSource + cullVertexShaderSource;
+
+inline const char* cullGeometryShaderSource = R"glsl(
+    #version 330 core
+    layout (points) in;
+    layout (points, max_vertices = 1) out;
+
+    in mat4 vModel[];
+    in float vVisible[];
+
+    out mat4 outModel;
+
+    void main()
+    {
+        if (vVisible[0] > 0.5)
+        {
+            outModel = vModel[0];
+            EmitVertex();
+            EndPrimitive();
+        }
+    }
+)glsl";
+
+class GpuCuller
+{
+public:
+    static const int LOCAL_SIZE = 64;
+    // Solo transform feedback: la lista que se dibuja es de un fotograma anterior
+    static constexpr float LATENT_RADIUS_SCALE = 1.25f;
+
+    void addInstance(const MeshRange& range, GLuint texture, const glm::mat4x4& model, const glm::vec3& center, float radius)
+    {
+        size_t group = 0;
+        while (group < groups.size() && !(groups[group].range.firstIndex == range.firstIndex &&
+               groups[group].range.baseVertex == range.baseVertex && groups[group].texture == texture))
+            ++group;
+        if (group == groups.size())
+        {
+            Group newGroup;
+            newGroup.range = range;
+            newGroup.texture = texture;
+            groups.push_back(newGroup);
+        }
+        ++groups[group].count;
+
+        Instance instance;
+        instance.model = model;
+        instance.sphere = glm::vec4(center, radius);
+        instance.group = (GLuint)group;
+        instance.maxDistance = 0.0f;
+        instances.push_back(instance);
+    }
+
+    // Tras MeshArena::upload(); los datos por instancia se liberan en la CPU
+    void upload(ProgramCache& cache, const MeshArena& arena)
+    {
+        if (instances.empty())
+            return;
+        compute = glext.dispatchCompute && glext.memoryBarrier && glext.drawElementsIndirect;
+
+        // Cada grupo ocupa un tramo contiguo de instancias y de la lista de visibles
+        std::stable_sort(instances.begin(), instances.end(),
+            [](const Instance& a, const Instance& b) { return a.group < b.group; });
+        GLuint first = 0;
+        for (Group& group : groups)
+        {
+            group.first = first;
+            first += group.count;
+        }
+        instanceCount = (GLuint)instances.size();
+        for (Instance& instance : instances)
+            instance.maxDistance = groups[instance.group].lodFade.y;
+
+        glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        std::vector<Instance>().swap(instances);
+
+        if (compute)
+        {
+            setupCompute(arena);
+            program = cache.getProgram({ { GL_COMPUTE_SHADER, cullComputeProgramSource.c_str() } });
+        }
+        else
+        {
+            setupFeedback(arena);
+            program = cache.getProgram({ { GL_VERTEX_SHADER, cullVertexProgramSource.c_str() },
+                                         { GL_GEOMETRY_SHADER, cullGeometryShaderSource } },
+                                       std::string(), { "outModel" });
+        }
+
+        std::cout << "Culling en GPU: " << instanceCount << " instancias en " << groups.size() << " grupos ("
+                  << (compute ? "compute shader" : "transform feedback") << ")" << std::endl;
+    }
+
+    void destroy()
+    {
+        if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+        if (visibleBuffer) glDeleteBuffers(1, &visibleBuffer);
+        if (commandBuffer) glDeleteBuffers(1, &commandBuffer);
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (cullVao) glDeleteVertexArrays(1, &cullVao);
+        for (Group& group : groups)
+        {
+            for (int i = 0; i < 2; ++i)
+            {
+                if (group.feedback[i]) glDeleteBuffers(1, &group.feedback[i]);
+                if (group.query[i]) glDeleteQueries(1, &group.query[i]);
+                if (group.vao[i]) glDeleteVertexArrays(1, &group.vao[i]);
+            }
+        }
+        // El programa es de ProgramCache
+        instanceBuffer = visibleBuffer = commandBuffer = vao = cullVao = program = 0;
+        groups.clear();
+    }
+
+    // El programa de la prueba es de ProgramCache y puede recargarse
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+            if (program == swap.oldProgram)
+                program = swap.newProgram;
+    }
+
+    // Pirámide R32F de profundidad máxima y la viewProj con la que se dibujó;
+    // texture = 0 desactiva la prueba
+    void setOcclusion(GLuint texture, const glm::ivec2& size, int levels, const glm::mat4x4& viewProj)
+    {
+        occlusionTexture = texture;
+        occlusionSize = size;
+        occlusionLevels = levels;
+        occlusionViewProj = viewProj;
+    }
+
+    // Antes de upload(): las instancias de range se funden en [fade.x, fade.y] y
+    // desaparecen a partir de fade.y (distancia de la cámara al origen del modelo)
+    void setLodFade(const MeshRange& range, const glm::vec2& fade)
+    {
+        for (Group& group : groups)
+            if (group.range.firstIndex == range.firstIndex && group.range.baseVertex == range.baseVertex)
+                group.lodFade = fade;
+    }
+
+    void cull(const glm::mat4x4& viewProj, const glm::vec3& eye)
+    {
+        if (!program)
+            return;
+
+        glm::vec4 planes[6];
+        extractPlanes(viewProj, planes);
+        glUseProgram(program);
+        glUniform4fv(glGetUniformLocation(program, "planes"), 6, glm::value_ptr(planes[0]));
+        glUniform3fv(glGetUniformLocation(program, "eye"), 1, glm::value_ptr(eye));
+        glUniform1i(glGetUniformLocation(program, "occlusion"), occlusionTexture != 0);
+        if (occlusionTexture)
+        {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, occlusionTexture);
+            glUniform1i(glGetUniformLocation(program, "hiz"), 0);
+            glUniformMatrix4fv(glGetUniformLocation(program, "hizViewProj"), 1, GL_FALSE, glm::value_ptr(occlusionViewProj));
+            glUniform2i(glGetUniformLocation(program, "hizSize"), occlusionSize.x, occlusionSize.y);
+            glUniform1i(glGetUniformLocation(program, "hizLevels"), occlusionLevels);
+        }
+
+        if (compute)
+        {
+            // Solo los contadores de cada grupo vuelven a cero
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+            glUniform1ui(glGetUniformLocation(program, "instanceCount"), instanceCount);
+            glext.dispatchCompute((instanceCount + LOCAL_SIZE - 1) / LOCAL_SIZE, 1, 1);
+            glext.memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+            return;
+        }
+
+        // La lista anterior se dibuja en cuanto su consulta tiene resultado; mientras
+        // tanto se sigue con la que ya tiene cuenta y no se lanza otra, así que
+        // nunca se espera a la GPU ni se mezcla una cuenta con otro búfer
+        if (pending)
+        {
+            for (const Group& group : groups)
+            {
+                GLuint available = GL_FALSE;
+                glGetQueryObjectuiv(group.query[drawIndex ^ 1], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    return;
+            }
+            drawIndex ^= 1;
+            visibleCount = 0;
+            for (Group& group : groups)
+            {
+                glGetQueryObjectuiv(group.query[drawIndex], GL_QUERY_RESULT, &group.visible);
+                visibleCount += group.visible;
+            }
+            pending = false;
+        }
+
+        int write = drawIndex ^ 1;
+        glUniform1f(glGetUniformLocation(program, "radiusScale"), LATENT_RADIUS_SCALE);
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(cullVao);
+        for (Group& group : groups)
+        {
+            glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, group.feedback[write]);
+            glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, group.query[write]);
+            glBeginTransformFeedback(GL_POINTS);
+            glDrawArrays(GL_POINTS, (GLint)group.first, (GLsizei)group.count);
+            glEndTransformFeedback();
+            glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        }
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+        pending = true;
+    }
+
+    // Con el programa de instancias (matriz "model" en los atributos 2-5)
+    void draw(GLuint drawProgram)
+    {
+        if (!program)
+            return;
+
+        glUseProgram(drawProgram);
+        GLint lodFadeLocation = glGetUniformLocation(drawProgram, "lodFade");
+        if (compute)
+        {
+            glBindVertexArray(vao);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            for (size_t i = 0; i < groups.size(); ++i)
+            {
+                glBindTexture(GL_TEXTURE_2D, groups[i].texture);
+                glUniform2fv(lodFadeLocation, 1, glm::value_ptr(groups[i].lodFade));
+                glext.drawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)(i * sizeof(DrawElementsIndirectCommand)));
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            for (const Group& group : groups)
+            {
+                if (group.visible == 0)
+                    continue;
+                glBindVertexArray(group.vao[drawIndex]);
+                glBindTexture(GL_TEXTURE_2D, group.texture);
+                glUniform2fv(lodFadeLocation, 1, glm::value_ptr(group.lodFade));
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, group.range.indexCount, GL_UNSIGNED_INT,
+                    (void*)(group.range.firstIndex * sizeof(GLuint)), (GLsizei)group.visible, group.range.baseVertex);
+            }
+        }
+        glBindVertexArray(0);
+        // El resto de dibujos con este programa no se funden
+        glUniform2f(lodFadeLocation, 0.0f, 0.0f);
+    }
+
+    GLuint getInstanceCount() const
+    {
+        return instanceCount;
+    }
+
+    // Solo con transform feedback; con compute shader el recuento no sale de la GPU
+    bool hasVisibleCount() const
+    {
+        return program && !compute;
+    }
+
+    GLuint getVisibleCount() const
+    {
+        return visibleCount;
+    }
+
+    // Planos del frustum (Gribb-Hartmann) normalizados, con la normal hacia dentro
+    static void extractPlanes(const glm::mat4x4& m, glm::vec4 planes[6])
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row3 + row2;
+        planes[5] = row3 - row2;
+        for (int i = 0; i < 6; ++i)
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+
+private:
+    // Misma disposición que el struct Instance de std430 (96 bytes)
+    struct Instance
+    {
+        glm::mat4x4 model;
+        glm::vec4 sphere;
+        GLuint group;
+        float maxDistance;
+        GLuint padding[2];
+    };
+
+    struct Group
+    {
+        MeshRange range;
+        GLuint texture = 0;
+        GLuint first = 0, count = 0;
+        glm::vec2 lodFade = glm::vec2(0.0f); // y = 0: sin fundido
+        // Transform feedback: doble búfer de matrices visibles, con su query y su VAO
+        GLuint feedback[2] = { 0, 0 };
+        GLuint query[2] = { 0, 0 };
+        GLuint vao[2] = { 0, 0 };
+        GLuint visible = 0;
+    };
+
+    std::vector<Instance> instances;
+    std::vector<Group> groups;
+    std::vector<DrawElementsIndirectCommand> commands;
+    GLuint instanceCount = 0;
+    bool compute = false;
+
+    GLuint program = 0;
+    GLuint instanceBuffer = 0;
+    GLuint visibleBuffer = 0, commandBuffer = 0, vao = 0;
+    GLuint cullVao = 0;
+    int drawIndex = 0;    // el búfer cuya cuenta está en visible; nada en el primero
+    bool pending = false; // el otro se escribió y su consulta no se ha leído
+    GLuint visibleCount = 0;
+
+    GLuint occlusionTexture = 0;
+    glm::ivec2 occlusionSize = glm::ivec2(0);
+    int occlusionLevels = 0;
+    glm::mat4x4 occlusionViewProj = glm::mat4x4(1.0f);
+
+    void setupCompute(const MeshArena& arena)
+    {
+        for (const Group& group : groups)
+            commands.push_back(DrawElementsIndirectCommand{ (GLuint)group.range.indexCount, 0, (GLuint)group.range.firstIndex,
+                                                            group.range.baseVertex, group.first });
+
+        glGenBuffers(1, &visibleBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCount * sizeof(glm::mat4x4), NULL, GL_DYNAMIC_COPY);
+        glGenBuffers(1, &commandBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        vao = arena.createVao(visibleBuffer);
+    }
+
+    void setupFeedback(const MeshArena& arena)
+    {
+        glGenVertexArrays(1, &cullVao);
+        glBindVertexArray(cullVao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int column = 0; column < 4; ++column)
+        {
+            glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(column * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(column);
+        }
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(4 * sizeof(glm::vec4)));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(5 * sizeof(glm::vec4) + sizeof(GLuint)));
+        glEnableVertexAttribArray(5);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        for (Group& group : groups)
+        {
+            glGenBuffers(2, group.feedback);
+            glGenQueries(2, group.query);
+            for (int i = 0; i < 2; ++i)
+            {
+                glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, group.feedback[i]);
+                glBufferData(GL_TRANSFORM_FEEDBACK_BUFFER, group.count * sizeof(glm::mat4x4), NULL, GL_DYNAMIC_COPY);
+                group.vao[i] = arena.createVao(group.feedback[i]);
+            }
+        }
+        glBindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, 0);
+    }
+};
+
+#endif
@@ -0,0 +1,593 @@
+#ifndef GRASS_H
+#define GRASS_H
+
+// Pasto de briznas instanciadas alrededor de la cámara.
+//
+// El suelo se divide en tiles de TILE_SIZE. Cada tile a menos de GRASS_DISTANCE
+// se rellena en hilos de fondo: se prueban MAX_BLADES posiciones al azar (con
+// una semilla fija por tile, así que un tile siempre sale igual) y cada una se
+// queda con la probabilidad del mapa de densidad en ese punto. Las briznas de
+// un tile ocupan un hueco fijo del búfer de instancias; los tiles que se quedan
+// lejos liberan su hueco.
+//
+// Cada brizna tiene un orden (0..1) que decide a qué distancia desaparece: la
+// CPU dibuja solo el principio de cada tile según su distancia y el vertex
+// shader encoge las briznas que están a punto de desaparecer, así que la
+// densidad baja poco a poco sin saltos.
+//
+// Con GL 4.3 todos los tiles visibles van en un glMultiDrawElementsIndirect
+// (baseInstance apunta al hueco de cada tile); en 3.3 es un dibujo instanciado
+// por tile. Los bordes de las briznas se suavizan con alpha-to-coverage si la
+// ventana tiene multisampling; si no, con alpha test.
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_ext.h"
+#include "gpu_culling.h"
+#include "mesh_arena.h"
+#include "program_cache.h"
+#include "stream_buffer.h"
+
+inline const char* grassVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec2 aBlade; // x: lado (-1..1), y: altura (0..1)
+    layout (location = 1) in vec4 aRoot;  // raíz, giro
+    layout (location = 2) in vec4 aShape; // alto, ancho, orden, tono
+
+    out float Side;
+    out float Height;
+    out float Tint;
+    out vec3 FragPos;
+
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform vec3 eye;
+    uniform float time;
+    uniform vec2 fade; // distancia a la que empiezan a desaparecer y a la que ya no queda ninguna
+
+    void main()
+    {
+        // Las últimas briznas del tile desaparecen antes
+        float limit = mix(fade.y, fade.x, aShape.z);
+        float scale = clamp((limit - length(eye - aRoot.xyz)) / (0.1 * (fade.y - fade.x)), 0.0, 1.0);
+        float height = aShape.x * scale;
+
+        vec3 right = vec3(cos(aRoot.w), 0.0, sin(aRoot.w));
+        vec3 forward = vec3(-right.z, 0.0, right.x);
+        float wind = sin(time * 1.7 + aRoot.x * 0.11 + aRoot.z * 0.07) * 0.35 + (aShape.w - 0.5) * 0.4;
+
+        vec3 position = aRoot.xyz + right * aBlade.x * aShape.y * scale
+                      + vec3(0.0, aBlade.y * height, 0.0)
+                      + forward * wind * aBlade.y * aBlade.y * height;
+        gl_Position = projection * view * vec4(position, 1.0);
+        FragPos = position;
+        Side = aBlade.x / max(1.0 - aBlade.y, 0.05);
+        Height = aBlade.y;
+        Tint = aShape.w;
+    }
+)glsl";
+
+inline const char* grassFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    in float Side;
+    in float Height;
+    in float Tint;
+    in vec3 FragPos;
+
+    uniform bool alphaTest;
+
+    vec3 applyShadows(vec3 color, vec3 worldPos); // shadowSampleShaderSource
+    vec3 applyLights(vec3 albedo, vec3 worldPos); // clusteredLightsShaderSource
+
+    void main()
+    {
+        float alpha = 1.0 - smoothstep(0.5, 1.0, abs(Side));
+        if (alphaTest && alpha < 0.5)
+            discard;
+        vec3 color = mix(vec3(0.02, 0.07, 0.02), vec3(0.16, 0.3, 0.08), Height) * (0.75 + 0.5 * Tint);
+        FragColor = vec4(applyShadows(color, FragPos) + applyLights(color, FragPos), alpha);
+    }
+)glsl";
+
+// Mapa de densidad: size x size valores (0..1) por filas (z) sobre [worldMin, worldMin + worldSize]
+struct GrassDensityMap
+{
+    std::vector<float> values;
+    int size = 0;
+    glm::vec2 worldMin;
+    float worldSize = 1.0f;
+
+    float at(float x, float z) const
+    {
+        if (size < 2)
+            return 0.0f;
+        float u = (x - worldMin.x) / worldSize * (size - 1);
+        float v = (z - worldMin.y) / worldSize * (size - 1);
+        if (u < 0.0f || v < 0.0f || u > size - 1 || v > size - 1)
+            return 0.0f;
+        int x0 = std::min((int)u, size - 2), z0 = std::min((int)v, size - 2);
+        float fx = u - x0, fz = v - z0;
+        const float* row0 = &values[z0 * size + x0];
+        const float* row1 = row0 + size;
+        return (row0[0] * (1.0f - fx) + row0[1] * fx) * (1.0f - fz) + (row1[0] * (1.0f - fx) + row1[1] * fx) * fz;
+    }
+};
+
+class GrassRenderer
+{
+public:
+    static constexpr float TILE_SIZE = 25.0f;
+    static const int MAX_BLADES = 1024;       // por tile, con densidad 1
+    static constexpr float GRASS_DISTANCE = 150.0f;
+    static constexpr float FADE_START = 60.0f;
+    static const int SLOT_COUNT = 256;        // cubre el círculo de GRASS_DISTANCE con margen
+    static const int BLADE_SEGMENTS = 4;
+    static const unsigned MAX_WORKERS = 4;
+
+    ~GrassRenderer()
+    {
+        shutdown();
+    }
+
+    // height da la altura del suelo; se llama desde los hilos de fondo. libraries son
+    // las fuentes compartidas con applyShadows() y applyLights()
+    void init(const GrassDensityMap& _density, const std::function<float(float, float)>& _height, ProgramCache& cache,
+              const std::vector<ShaderSource>& libraries)
+    {
+        density = _density;
+        height = _height;
+        indirect = glext.multiDrawElementsIndirect != nullptr;
+
+        GLint samples = 0;
+        glGetIntegerv(GL_SAMPLES, &samples);
+        alphaToCoverage = samples > 1;
+
+        setupMesh();
+        setupProgram(cache, libraries);
+        for (int slot = SLOT_COUNT - 1; slot >= 0; --slot)
+            freeSlots.push_back(slot);
+
+        running = true;
+        unsigned workerCount = std::min(MAX_WORKERS, std::max(1u, std::thread::hardware_concurrency() / 2));
+        for (unsigned i = 0; i < workerCount; ++i)
+            workers.push_back(std::thread(&GrassRenderer::workerLoop, this));
+
+        std::cout << "Pasto: " << workerCount << " hilos, " << (alphaToCoverage ? "alpha-to-coverage" : "alpha test") << std::endl;
+    }
+
+    void shutdown()
+    {
+        if (!running) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        jobAvailable.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (vbo) glDeleteBuffers(1, &vbo);
+        if (ebo) glDeleteBuffers(1, &ebo);
+        if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+        // El programa es de ProgramCache
+        vao = vbo = ebo = instanceBuffer = program = 0;
+    }
+
+    // Antes de StreamBuffer::commit(): sube los tiles terminados, pide los que
+    // faltan, libera los lejanos y prepara los dibujos del fotograma
+    void update(const glm::vec3& eye, const glm::mat4x4& viewProj, StreamBuffer& stream)
+    {
+        if (!running)
+            return;
+        uploadResults();
+
+        // Lejos (con un tile de margen para no generar y liberar en el borde)
+        for (auto it = tiles.begin(); it != tiles.end();)
+        {
+            if (it->second.ready && tileDistance(it->first, eye) > GRASS_DISTANCE + TILE_SIZE)
+            {
+                freeSlots.push_back(it->second.slot);
+                it = tiles.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        // Cerca: los más próximos primero
+        int minX = (int)std::floor((eye.x - GRASS_DISTANCE) / TILE_SIZE), maxX = (int)std::floor((eye.x + GRASS_DISTANCE) / TILE_SIZE);
+        int minZ = (int)std::floor((eye.z - GRASS_DISTANCE) / TILE_SIZE), maxZ = (int)std::floor((eye.z + GRASS_DISTANCE) / TILE_SIZE);
+        std::vector<std::pair<float, int64_t>> missing;
+        for (int z = minZ; z <= maxZ; ++z)
+            for (int x = minX; x <= maxX; ++x)
+            {
+                int64_t key = tileKey(x, z);
+                float distance = tileDistance(key, eye);
+                if (distance <= GRASS_DISTANCE && tiles.find(key) == tiles.end())
+                    missing.push_back(std::make_pair(distance, key));
+            }
+        std::sort(missing.begin(), missing.end());
+        for (const std::pair<float, int64_t>& tile : missing)
+        {
+            if (freeSlots.empty())
+                break;
+            Tile newTile;
+            newTile.slot = freeSlots.back();
+            freeSlots.pop_back();
+            tiles[tile.second] = newTile;
+            pushJob(Job{ tile.second, newTile.slot });
+        }
+
+        // Visibles, con menos briznas cuanto más lejos y de delante hacia atrás:
+        // las briznas tapadas por las de delante no pasan la profundidad
+        glm::vec4 planes[6];
+        GpuCuller::extractPlanes(viewProj, planes);
+        visibleTiles.clear();
+        lastBlades = 0;
+        for (const auto& entry : tiles)
+        {
+            const Tile& tile = entry.second;
+            if (!tile.ready || tile.count == 0 || !inFrustum(tile, planes))
+                continue;
+            float distance = tileDistance(entry.first, eye);
+            float t = glm::clamp((distance - FADE_START) / (GRASS_DISTANCE - FADE_START), 0.0f, 1.0f);
+            GLuint count = (GLuint)std::ceil(tile.count * (1.0f - t));
+            if (count == 0)
+                continue;
+            visibleTiles.push_back(std::make_pair(distance, DrawElementsIndirectCommand{ (GLuint)bladeIndexCount, count, 0, 0, (GLuint)(tile.slot * MAX_BLADES) }));
+            lastBlades += count;
+        }
+        std::sort(visibleTiles.begin(), visibleTiles.end(),
+                  [](const std::pair<float, DrawElementsIndirectCommand>& a, const std::pair<float, DrawElementsIndirectCommand>& b) { return a.first < b.first; });
+        draws.clear();
+        for (const std::pair<float, DrawElementsIndirectCommand>& tile : visibleTiles)
+            draws.push_back(tile.second);
+
+        commands = StreamBuffer::Allocation{ nullptr, 0 };
+        if (indirect && !draws.empty())
+        {
+            commands = stream.allocate(draws.size() * sizeof(DrawElementsIndirectCommand), 4);
+            if (commands.data)
+                memcpy(commands.data, draws.data(), draws.size() * sizeof(DrawElementsIndirectCommand));
+        }
+    }
+
+    // Tras StreamBuffer::commit() y antes de los transparentes
+    void draw(const StreamBuffer& stream, const glm::mat4x4& view, const glm::mat4x4& proj, const glm::vec3& eye, float time)
+    {
+        if (!program || draws.empty())
+            return;
+
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
+        glUniform3fv(glGetUniformLocation(program, "eye"), 1, glm::value_ptr(eye));
+        glUniform1f(glGetUniformLocation(program, "time"), time);
+        glUniform2f(glGetUniformLocation(program, "fade"), FADE_START, GRASS_DISTANCE);
+        glUniform1i(glGetUniformLocation(program, "alphaTest"), !alphaToCoverage);
+
+        // La cobertura sustituye a la mezcla
+        glDisable(GL_BLEND);
+        if (alphaToCoverage)
+            glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+
+        glBindVertexArray(vao);
+        if (commands.data)
+        {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.getBuffer());
+            glext.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commands.offset, (GLsizei)draws.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        else
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+            for (const DrawElementsIndirectCommand& command : draws)
+            {
+                setInstancePointers(command.baseInstance);
+                glDrawElementsInstanced(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, (void*)0, command.instanceCount);
+            }
+            setInstancePointers(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glBindVertexArray(0);
+
+        if (alphaToCoverage)
+            glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+        glEnable(GL_BLEND);
+    }
+
+    // Para dibujar en un destino sin multisampling (el G-buffer de DeferredRenderer)
+    void disableAlphaToCoverage()
+    {
+        alphaToCoverage = false;
+    }
+
+    // Briznas y tiles dibujados en el último update()
+    unsigned getBladeCount() const
+    {
+        return lastBlades;
+    }
+
+    size_t getTileCount() const
+    {
+        return draws.size();
+    }
+
+    GLuint getProgram() const
+    {
+        return program;
+    }
+
+    // Al recargar las bibliotecas de luz cambia el programa
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+            if (program == swap.oldProgram)
+                program = swap.newProgram;
+    }
+
+private:
+    struct Blade
+    {
+        glm::vec4 root;  // posición, giro
+        glm::vec4 shape; // alto, ancho, orden, tono
+    };
+
+    struct Tile
+    {
+        int slot = 0;
+        bool ready = false;
+        GLuint count = 0;
+        glm::vec3 minCorner, maxCorner;
+    };
+
+    struct Job
+    {
+        int64_t key;
+        int slot;
+    };
+
+    struct Result
+    {
+        int64_t key;
+        int slot;
+        std::vector<Blade> blades;
+        float minHeight, maxHeight;
+    };
+
+    GrassDensityMap density;
+    std::function<float(float, float)> height;
+    bool indirect = false;
+    bool alphaToCoverage = false;
+
+    GLuint vao = 0, vbo = 0, ebo = 0, instanceBuffer = 0, program = 0;
+    GLsizei bladeIndexCount = 0;
+
+    std::unordered_map<int64_t, Tile> tiles;
+    std::vector<int> freeSlots;
+    std::vector<DrawElementsIndirectCommand> draws;
+    std::vector<std::pair<float, DrawElementsIndirectCommand>> visibleTiles;
+    StreamBuffer::Allocation commands = {};
+    unsigned lastBlades = 0;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    bool running = false;
+
+    static int64_t tileKey(int x, int z)
+    {
+        return (int64_t)(((uint64_t)(uint32_t)x << 32) | (uint32_t)z);
+    }
+
+    static glm::vec2 tileOrigin(int64_t key)
+    {
+        return glm::vec2((int32_t)(key >> 32), (int32_t)(uint32_t)key) * TILE_SIZE;
+    }
+
+    // En el plano: la altura no cuenta
+    static float tileDistance(int64_t key, const glm::vec3& eye)
+    {
+        glm::vec2 origin = tileOrigin(key);
+        glm::vec2 closest = glm::clamp(glm::vec2(eye.x, eye.z), origin, origin + glm::vec2(TILE_SIZE));
+        return glm::length(glm::vec2(eye.x, eye.z) - closest);
+    }
+
+    static bool inFrustum(const Tile& tile, const glm::vec4 planes[6])
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            glm::vec3 corner(planes[i].x >= 0.0f ? tile.maxCorner.x : tile.minCorner.x,
+                             planes[i].y >= 0.0f ? tile.maxCorner.y : tile.minCorner.y,
+                             planes[i].z >= 0.0f ? tile.maxCorner.z : tile.minCorner.z);
+            if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    void uploadResults()
+    {
+        std::vector<Result> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.swap(results);
+        }
+        if (finished.empty())
+            return;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (const Result& result : finished)
+        {
+            Tile& tile = tiles[result.key];
+            tile.ready = true;
+            tile.count = (GLuint)result.blades.size();
+            glm::vec2 origin = tileOrigin(result.key);
+            tile.minCorner = glm::vec3(origin.x, result.minHeight, origin.y);
+            tile.maxCorner = glm::vec3(origin.x + TILE_SIZE, result.maxHeight, origin.y + TILE_SIZE);
+            if (!result.blades.empty())
+                glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)result.slot * MAX_BLADES * sizeof(Blade),
+                                result.blades.size() * sizeof(Blade), result.blades.data());
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Una tira que se estrecha hasta la punta
+    void setupMesh()
+    {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        for (int segment = 0; segment < BLADE_SEGMENTS; ++segment)
+        {
+            float t = segment / float(BLADE_SEGMENTS);
+            float side = 1.0f - t;
+            float vertex[4] = { -side, t, side, t };
+            vertices.insert(vertices.end(), vertex, vertex + 4);
+        }
+        vertices.push_back(0.0f);
+        vertices.push_back(1.0f);
+        for (int segment = 0; segment + 1 < BLADE_SEGMENTS; ++segment)
+        {
+            unsigned int base = segment * 2;
+            unsigned int quad[6] = { base, base + 1, base + 3, base, base + 3, base + 2 };
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+        unsigned int tip = BLADE_SEGMENTS * 2, last = tip - 2;
+        unsigned int triangle[3] = { last, last + 1, tip };
+        indices.insert(indices.end(), triangle, triangle + 3);
+        bladeIndexCount = (GLsizei)indices.size();
+
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &ebo);
+        glGenBuffers(1, &instanceBuffer);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, (size_t)SLOT_COUNT * MAX_BLADES * sizeof(Blade), NULL, GL_DYNAMIC_DRAW);
+        for (int attribute = 1; attribute <= 2; ++attribute)
+        {
+            glVertexAttribDivisor(attribute, 1);
+            glEnableVertexAttribArray(attribute);
+        }
+        setInstancePointers(0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Con el búfer de instancias enlazado en GL_ARRAY_BUFFER
+    void setInstancePointers(GLuint firstBlade)
+    {
+        size_t offset = (size_t)firstBlade * sizeof(Blade);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Blade), (void*)offset);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Blade), (void*)(offset + sizeof(glm::vec4)));
+    }
+
+    void setupProgram(ProgramCache& cache, const std::vector<ShaderSource>& libraries)
+    {
+        std::vector<ShaderSource> sources = { { GL_VERTEX_SHADER, grassVertexShaderSource },
+                                              { GL_FRAGMENT_SHADER, grassFragmentShaderSource } };
+        sources.insert(sources.end(), libraries.begin(), libraries.end());
+        program = cache.getProgram(sources);
+    }
+
+    void pushJob(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        jobAvailable.notify_one();
+    }
+
+    // ------------------------------------------------------------------------
+    // Hilos de fondo: solo CPU, nunca OpenGL
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return !running || !jobs.empty(); });
+                if (!running) return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            Result result = generate(job);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(result));
+        }
+    }
+
+    Result generate(const Job& job) const
+    {
+        Result result;
+        result.key = job.key;
+        result.slot = job.slot;
+        result.minHeight = 1e30f;
+        result.maxHeight = -1e30f;
+
+        // xorshift con la clave como semilla: el tile siempre sale igual
+        uint64_t seed = (uint64_t)job.key * 0x9e3779b97f4a7c15ull;
+        uint32_t state = ((uint32_t)(seed >> 32) ^ (uint32_t)seed) | 1u;
+        auto random = [&state]() {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return (state & 0xffffff) / float(0x1000000);
+        };
+
+        glm::vec2 origin = tileOrigin(job.key);
+        for (int i = 0; i < MAX_BLADES; ++i)
+        {
+            float x = origin.x + random() * TILE_SIZE;
+            float z = origin.y + random() * TILE_SIZE;
+            float keep = random();
+            float angle = random() * 6.2831853f;
+            float bladeHeight = 1.5f + random() * 2.0f;
+            float tint = random();
+            if (keep >= density.at(x, z))
+                continue;
+
+            Blade blade;
+            blade.root = glm::vec4(x, height(x, z), z, angle);
+            blade.shape = glm::vec4(bladeHeight, 0.12f + 0.08f * tint, 0.0f, tint);
+            result.blades.push_back(blade);
+            result.minHeight = std::min(result.minHeight, blade.root.y);
+            result.maxHeight = std::max(result.maxHeight, blade.root.y + bladeHeight);
+        }
+        // Las posiciones ya son aleatorias: el orden de desaparición es el de la lista
+        for (size_t i = 0; i < result.blades.size(); ++i)
+            result.blades[i].shape.z = (i + 0.5f) / result.blades.size();
+        return result;
+    }
+};
+
+#endif
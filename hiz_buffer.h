@@ -0,0 +1,401 @@
+#ifndef HIZ_BUFFER_H
+#define HIZ_BUFFER_H
+
+// Pirámide de profundidad (Hi-Z) para occlusion culling.
+//
+// Tras dibujar los opacos, build() copia la profundidad del fotograma y la
+// reduce en una cadena de mips R32F donde cada texel guarda la profundidad
+// máxima (la más lejana) de los que cubre. Un objeto cuya esfera envolvente
+// queda entera por detrás de ese máximo está oculto.
+//
+// La pirámide se usa en dos sitios con un fotograma o más de retraso, siempre
+// con la viewProj con la que se dibujó esa profundidad:
+//   - en la GPU, GpuCuller lee la textura directamente;
+//   - en la CPU, un nivel pequeño (READBACK_WIDTH de ancho como mucho) se
+//     copia a un PBO y se lee cuando su fence ha llegado, sin esperar a la
+//     GPU; isOccluded() prueba los Object antes de enviarlos a la cola.
+//     setCpuDepth() sustituye esa copia por una profundidad hecha en la CPU
+//     (p. ej. los oclusores de SoftRasterizer).
+//
+// Como los oclusores vienen de un fotograma anterior, algo que acaba de
+// destaparse puede tardar un fotograma en aparecer.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "program_cache.h"
+
+inline const char* hizVertexShaderSource = R"glsl(
+    #version 330 core
+
+    // Triángulo que cubre la pantalla, sin atributos
+    void main()
+    {
+        vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+    }
+)glsl";
+
+inline const char* hizFragmentShaderSource = R"glsl(
+    #version 330 core
+    out float depth;
+
+    uniform sampler2D source; // solo su nivel base es visible
+    uniform ivec2 sourceSize;   // la parte válida de source
+    uniform ivec2 targetSize;
+
+    void main()
+    {
+        // Los texels de source que toca este en proporción; con tamaños impares
+        // (o un viewport más pequeño que la pirámide) se solapan con los vecinos
+        vec2 ratio = vec2(sourceSize) / vec2(targetSize);
+        ivec2 low = ivec2(floor((gl_FragCoord.xy - 0.5) * ratio));
+        ivec2 high = min(ivec2(ceil((gl_FragCoord.xy + 0.5) * ratio)) - 1, sourceSize - 1);
+        float farthest = 0.0;
+        for (int y = low.y; y <= high.y; ++y)
+            for (int x = low.x; x <= high.x; ++x)
+                farthest = max(farthest, texelFetch(source, ivec2(x, y), 0).r);
+        depth = farthest;
+    }
+)glsl";
+
+class HiZBuffer
+{
+public:
+    static const int READBACK_WIDTH = 128;
+    static const int PBO_COUNT = 3;
+
+    void init(ProgramCache& cache, int _width, int _height)
+    {
+        width = _width;
+        height = _height;
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        glGenFramebuffers(1, &depthFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+
+        // Nivel 0 a media resolución, hasta 1x1; redondeando hacia abajo como
+        // GL, o la textura queda incompleta y texelFetch devuelve 0
+        levelSizes.clear();
+        glm::ivec2 size(std::max(width / 2, 1), std::max(height / 2, 1));
+        while (true)
+        {
+            levelSizes.push_back(size);
+            if (size.x == 1 && size.y == 1)
+                break;
+            size = glm::max(size / 2, glm::ivec2(1));
+        }
+
+        glGenTextures(1, &hizTexture);
+        glBindTexture(GL_TEXTURE_2D, hizTexture);
+        for (size_t level = 0; level < levelSizes.size(); ++level)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_R32F, levelSizes[level].x, levelSizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelSizes.size() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &reduceFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glGenVertexArrays(1, &emptyVao);
+
+        readbackLevel = 0;
+        while (levelSizes[readbackLevel].x > READBACK_WIDTH)
+            ++readbackLevel;
+        glm::ivec2 readbackSize = levelSizes[readbackLevel];
+        glGenBuffers(PBO_COUNT, pbos);
+        for (int i = 0; i < PBO_COUNT; ++i)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, readbackSize.x * readbackSize.y * sizeof(float), NULL, GL_STREAM_READ);
+            fences[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        program = cache.getProgram({ { GL_VERTEX_SHADER, hizVertexShaderSource },
+                                     { GL_FRAGMENT_SHADER, hizFragmentShaderSource } });
+    }
+
+    void destroy()
+    {
+        for (int i = 0; i < PBO_COUNT; ++i)
+            if (fences[i]) glDeleteSync(fences[i]);
+        if (pbos[0]) glDeleteBuffers(PBO_COUNT, pbos);
+        if (depthTexture) glDeleteTextures(1, &depthTexture);
+        if (hizTexture) glDeleteTextures(1, &hizTexture);
+        if (depthFbo) glDeleteFramebuffers(1, &depthFbo);
+        if (reduceFbo) glDeleteFramebuffers(1, &reduceFbo);
+        if (emptyVao) glDeleteVertexArrays(1, &emptyVao);
+        // El programa es de ProgramCache
+        depthTexture = hizTexture = depthFbo = reduceFbo = emptyVao = program = 0;
+        pbos[0] = 0;
+    }
+
+    // Al principio del fotograma: recoge la copia más reciente que ya haya llegado
+    // (nextPbo es la más antigua)
+    void beginFrame()
+    {
+        for (int k = 0; k < PBO_COUNT; ++k)
+        {
+            int slot = (nextPbo + k) % PBO_COUNT;
+            if (!fences[slot] || glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+                continue;
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+            if (readbackFrame[slot] <= cpuFrame)
+                continue;
+
+            glm::ivec2 size = levelSizes[readbackLevel];
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+            const float* data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size.x * size.y * sizeof(float), GL_MAP_READ_BIT);
+            if (data)
+            {
+                cpuSizes.assign(levelSizes.begin() + readbackLevel, levelSizes.end());
+                cpuLevels.resize(cpuSizes.size());
+                cpuLevels[0].assign(data, data + size.x * size.y);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                buildCpuLevels();
+                cpuViewProj = readbackViewProj[slot];
+                cpuFrame = readbackFrame[slot];
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    // Tras dibujar los opacos, con la viewProj con la que se dibujaron. Lee la
+    // profundidad del framebuffer enlazado, que puede ser más pequeño que la
+    // pirámide (DynamicResolution): se copia tal cual y el nivel 0 se reparte
+    // en proporción, así que las coordenadas de pantalla no cambian
+    void build(const glm::mat4x4& viewProj)
+    {
+        GLint viewport[4], target = 0;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glm::ivec2 sourceSize(std::min<int>(viewport[2], width), std::min<int>(viewport[3], height));
+
+        // Con multisampling la copia tiene que ser del mismo tamaño
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, target);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFbo);
+        glBlitFramebuffer(viewport[0], viewport[1], viewport[0] + sourceSize.x, viewport[1] + sourceSize.y,
+                          0, 0, sourceSize.x, sourceSize.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, reduceFbo);
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "source"), 0);
+        glBindVertexArray(emptyVao);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glActiveTexture(GL_TEXTURE0);
+
+        for (size_t level = 0; level < levelSizes.size(); ++level)
+        {
+            // El nivel que se lee es el único visible: no hay bucle de realimentación
+            glm::ivec2 levelSource = level == 0 ? sourceSize : levelSizes[level - 1];
+            if (level == 0)
+            {
+                glBindTexture(GL_TEXTURE_2D, depthTexture);
+            }
+            else
+            {
+                glBindTexture(GL_TEXTURE_2D, hizTexture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)level - 1);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)level - 1);
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hizTexture, (GLint)level);
+            glViewport(0, 0, levelSizes[level].x, levelSizes[level].y);
+            glUniform2i(glGetUniformLocation(program, "sourceSize"), levelSource.x, levelSource.y);
+            glUniform2i(glGetUniformLocation(program, "targetSize"), levelSizes[level].x, levelSizes[level].y);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, hizTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levelSizes.size() - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // Copia asíncrona del nivel pequeño; si la GPU va muy atrasada se salta
+        if (!fences[nextPbo])
+        {
+            glm::ivec2 size = levelSizes[readbackLevel];
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hizTexture, readbackLevel);
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[nextPbo]);
+            glReadPixels(0, 0, size.x, size.y, GL_RED, GL_FLOAT, (void*)0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            fences[nextPbo] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            readbackViewProj[nextPbo] = viewProj;
+            readbackFrame[nextPbo] = ++frame;
+            nextPbo = (nextPbo + 1) % PBO_COUNT;
+        }
+
+        glBindVertexArray(0);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+        if (blend)
+            glEnable(GL_BLEND);
+
+        gpuViewProj = viewProj;
+        gpuReady = true;
+    }
+
+    // Profundidad de ventana [0,1], fila 0 abajo, dibujada con viewProj
+    void setCpuDepth(const std::vector<float>& depth, const glm::ivec2& size, const glm::mat4x4& viewProj)
+    {
+        cpuSizes.clear();
+        glm::ivec2 levelSize = size;
+        while (true)
+        {
+            cpuSizes.push_back(levelSize);
+            if (levelSize.x == 1 && levelSize.y == 1)
+                break;
+            levelSize = glm::max(levelSize / 2, glm::ivec2(1));
+        }
+        cpuLevels.resize(cpuSizes.size());
+        cpuLevels[0] = depth;
+        buildCpuLevels();
+        cpuViewProj = viewProj;
+    }
+
+    // Esfera del mundo contra la copia de la CPU; sin copia nada está oculto
+    bool isOccluded(const glm::vec3& center, float radius) const
+    {
+        if (cpuLevels.empty())
+            return false;
+
+        glm::vec2 minUv(1.0f), maxUv(0.0f);
+        float minDepth = 1.0f;
+        for (int i = 0; i < 8; ++i)
+        {
+            glm::vec3 corner = center + radius * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+            glm::vec4 clip = cpuViewProj * glm::vec4(corner, 1.0f);
+            if (clip.w <= 0.0f)
+                return false; // cruza el plano cercano
+            glm::vec2 uv(clip.x / clip.w * 0.5f + 0.5f, clip.y / clip.w * 0.5f + 0.5f);
+            minUv = glm::min(minUv, uv);
+            maxUv = glm::max(maxUv, uv);
+            minDepth = std::min(minDepth, clip.z / clip.w * 0.5f + 0.5f);
+        }
+        // Fuera de la pantalla no hay oclusores con los que comparar
+        if (maxUv.x < 0.0f || maxUv.y < 0.0f || minUv.x > 1.0f || minUv.y > 1.0f)
+            return false;
+        minUv = glm::clamp(minUv, glm::vec2(0.0f), glm::vec2(1.0f));
+        maxUv = glm::clamp(maxUv, glm::vec2(0.0f), glm::vec2(1.0f));
+
+        // El nivel en el que el rectángulo cubre como mucho 2x2 texeles
+        size_t level = 0;
+        glm::ivec2 size, low, high;
+        for (;; ++level)
+        {
+            size = cpuSizes[level];
+            low = glm::min(glm::ivec2(minUv * glm::vec2(size)), size - 1);
+            high = glm::min(glm::ivec2(maxUv * glm::vec2(size)), size - 1);
+            if (level + 1 == cpuLevels.size() || (high.x - low.x <= 1 && high.y - low.y <= 1))
+                break;
+        }
+
+        float farthest = 0.0f;
+        for (int y = low.y; y <= high.y; ++y)
+            for (int x = low.x; x <= high.x; ++x)
+                farthest = std::max(farthest, cpuLevels[level][y * size.x + x]);
+        return minDepth > farthest;
+    }
+
+    // Para GpuCuller: la pirámide de la GPU y la viewProj con la que se construyó
+    bool isReady() const
+    {
+        return gpuReady;
+    }
+
+    GLuint getTexture() const
+    {
+        return hizTexture;
+    }
+
+    glm::ivec2 getSize() const
+    {
+        return levelSizes.empty() ? glm::ivec2(0) : levelSizes[0];
+    }
+
+    int getLevelCount() const
+    {
+        return (int)levelSizes.size();
+    }
+
+    const glm::mat4x4& getViewProj() const
+    {
+        return gpuViewProj;
+    }
+
+    // El programa de reducción es de ProgramCache y puede recargarse
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+            if (program == swap.oldProgram)
+                program = swap.newProgram;
+    }
+
+private:
+    int width = 0, height = 0;
+    GLuint depthTexture = 0, depthFbo = 0;
+    GLuint hizTexture = 0, reduceFbo = 0;
+    GLuint emptyVao = 0, program = 0;
+    std::vector<glm::ivec2> levelSizes;
+    glm::mat4x4 gpuViewProj = glm::mat4x4(1.0f);
+    bool gpuReady = false;
+
+    // Copia a la CPU: anillo de PBOs desde readbackLevel
+    int readbackLevel = 0;
+    GLuint pbos[PBO_COUNT] = {};
+    GLsync fences[PBO_COUNT];
+    glm::mat4x4 readbackViewProj[PBO_COUNT];
+    unsigned readbackFrame[PBO_COUNT] = {};
+    int nextPbo = 0;
+    unsigned frame = 0;
+
+    std::vector<std::vector<float>> cpuLevels;
+    std::vector<glm::ivec2> cpuSizes;
+    glm::mat4x4 cpuViewProj = glm::mat4x4(1.0f);
+    unsigned cpuFrame = 0;
+
+    // Mismo criterio que el shader de reducción
+    void buildCpuLevels()
+    {
+        for (size_t level = 1; level < cpuLevels.size(); ++level)
+        {
+            glm::ivec2 source = cpuSizes[level - 1];
+            glm::ivec2 size = cpuSizes[level];
+            const std::vector<float>& src = cpuLevels[level - 1];
+            std::vector<float>& dst = cpuLevels[level];
+            dst.assign(size.x * size.y, 0.0f);
+            int extentX = 2 + (source.x & 1), extentY = 2 + (source.y & 1);
+            for (int y = 0; y < size.y; ++y)
+                for (int x = 0; x < size.x; ++x)
+                {
+                    float farthest = 0.0f;
+                    for (int dy = 0; dy < extentY; ++dy)
+                        for (int dx = 0; dx < extentX; ++dx)
+                        {
+                            int sx = std::min(x * 2 + dx, source.x - 1);
+                            int sy = std::min(y * 2 + dy, source.y - 1);
+                            farthest = std::max(farthest, src[sy * source.x + sx]);
+                        }
+                    dst[y * size.x + x] = farthest;
+                }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,412 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+// Impostores octaédricos para los árboles lejanos.
+//
+// bake() dibuja una vez el modelo, fuera de pantalla, desde FRAMES x FRAMES
+// direcciones repartidas sobre la esfera con la codificación octaédrica y guarda
+// cada vista en un cuadro del atlas. A partir de impostorDistance cada instancia
+// es un quad orientado a la cámara que mezcla los cuatro cuadros más cercanos a
+// la dirección de vista (en el espacio del modelo, así que vale para instancias
+// giradas en Y).
+//
+// La transición es un fundido por tramado: en [fade.x, fade.y] la malla (ver
+// GpuCuller::setLodFade) conserva los píxeles cuyo ruido queda por debajo de su
+// opacidad y el impostor el resto, así que entre los dos cubren cada píxel una
+// sola vez y sin mezcla.
+//
+// Los datos por instancia se escriben en un StreamBuffer: update() antes de
+// StreamBuffer::commit() y draw() después. update() es select(), que no toca
+// OpenGL y puede ir en otro hilo, y upload().
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gpu_culling.h"
+#include "mesh_arena.h"
+#include "program_cache.h"
+#include "soft_raster.h"
+#include "stream_buffer.h"
+
+// Dirección <-> punto del cuadrado [-1, 1]^2, y el ruido del fundido; igual en la malla
+inline const char* impostorCommonSource = R"glsl(
+    vec2 octEncode(vec3 direction)
+    {
+        direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+        vec2 encoded = direction.xz;
+        if (direction.y < 0.0)
+            encoded = (1.0 - abs(direction.zx)) * vec2(direction.x >= 0.0 ? 1.0 : -1.0, direction.z >= 0.0 ? 1.0 : -1.0);
+        return encoded;
+    }
+
+    float fadeNoise(vec2 fragCoord)
+    {
+        return fract(52.9829189 * fract(dot(fragCoord, vec2(0.06711056, 0.00583715))));
+    }
+)glsl";
+
+inline const char* impostorBakeVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec2 aTexCoord;
+
+    out vec2 TexCoord;
+
+    uniform mat4 viewProj;
+
+    void main()
+    {
+        gl_Position = viewProj * vec4(aPos, 1.0);
+        TexCoord = aTexCoord;
+    }
+)glsl";
+
+inline const char* impostorBakeFragmentShaderSource = R"glsl(
+    #version 330 core
+    out vec4 FragColor;
+
+    in vec2 TexCoord;
+
+    uniform sampler2D texture1;
+
+    void main()
+    {
+        FragColor = vec4(texture(texture1, TexCoord).rgb, 1.0);
+    }
+)glsl";
+
+inline const char* impostorVertexShaderSource = R"glsl(
+    layout (location = 0) in vec2 aCorner;  // -1..1
+    layout (location = 1) in vec4 aCenter;  // centro de la esfera envolvente y radio
+    layout (location = 2) in vec4 aOrigin;  // origen del modelo y giro en Y
+
+    out vec2 FrameUv;
+    flat out vec2 FrameBase;
+    out vec2 FrameBlend;
+    out float Fade;
+
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform vec3 eye;
+    uniform vec2 fade;
+    uniform float frames;
+
+    void main()
+    {
+        vec3 forward = normalize(eye - aCenter.xyz);
+        vec3 right = cross(vec3(0.0, 1.0, 0.0), forward);
+        right = length(right) > 1e-3 ? normalize(right) : vec3(1.0, 0.0, 0.0);
+        vec3 up = cross(forward, right);
+        vec3 position = aCenter.xyz + (right * aCorner.x + up * aCorner.y) * aCenter.w;
+        gl_Position = projection * view * vec4(position, 1.0);
+
+        // La dirección de vista en el espacio del modelo elige los cuadros
+        float c = cos(aOrigin.w), s = sin(aOrigin.w);
+        vec3 local = vec3(c * forward.x - s * forward.z, forward.y, s * forward.x + c * forward.z);
+        vec2 grid = clamp((octEncode(local) * 0.5 + 0.5) * frames - 0.5, 0.0, frames - 1.0);
+        FrameBase = min(floor(grid), vec2(frames - 2.0));
+        FrameBlend = grid - FrameBase;
+        FrameUv = aCorner * 0.5 + 0.5;
+
+        Fade = clamp((fade.y - length(eye - aOrigin.xyz)) / (fade.y - fade.x), 0.0, 1.0);
+    }
+)glsl";
+
+inline const char* impostorFragmentShaderSource = R"glsl(
+    out vec4 FragColor;
+
+    in vec2 FrameUv;
+    flat in vec2 FrameBase;
+    in vec2 FrameBlend;
+    in float Fade;
+
+    uniform sampler2D atlas;
+    uniform float frames;
+
+    vec4 frameSample(vec2 frame)
+    {
+        return texture(atlas, (frame + FrameUv) / frames);
+    }
+
+    void main()
+    {
+        // La malla aún dibuja este píxel
+        if (fadeNoise(gl_FragCoord.xy) < Fade)
+            discard;
+
+        vec4 color = mix(mix(frameSample(FrameBase), frameSample(FrameBase + vec2(1.0, 0.0)), FrameBlend.x),
+                         mix(frameSample(FrameBase + vec2(0.0, 1.0)), frameSample(FrameBase + vec2(1.0, 1.0)), FrameBlend.x),
+                         FrameBlend.y);
+        if (color.a < 0.5)
+            discard;
+        // El fondo del atlas es negro transparente: dividir por alfa quita el borde oscuro
+        FragColor = vec4(color.rgb / color.a, 1.0);
+    }
+)glsl";
+
+// El dibujo lleva impostorCommonSource tras la línea #version en los dos shaders
+inline const std::string impostorVertexProgramSource = std::string("#version 330 core\n") + impostorCommonSource + impostorVertexShaderSource;
+inline const std::string impostorFragmentProgramSource = std::string("#version 330 core\n") + impostorCommonSource + impostorFragmentShaderSource;
+
+class ImpostorRenderer
+{
+public:
+    static const int FRAMES = 8;          // cuadros por lado del atlas
+    static const int FRAME_SIZE = 256;    // píxeles por cuadro
+
+    // Tras MeshArena::upload(); la textura se sube aparte porque la de la GPU puede
+    // estar aún en streaming. center y radius son la esfera envolvente del modelo.
+    void bake(ProgramCache& cache, const MeshArena& arena, const MeshRange& range, const SoftTexture* texture, const glm::vec3& center, float radius)
+    {
+        setupPrograms(cache);
+
+        GLuint sourceTexture = 0;
+        glGenTextures(1, &sourceTexture);
+        glBindTexture(GL_TEXTURE_2D, sourceTexture);
+        if (texture)
+        {
+            GLenum format = texture->channels == 4 ? GL_RGBA : texture->channels == 3 ? GL_RGB : texture->channels == 2 ? GL_RG : GL_RED;
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture->width, texture->height, 0, format, GL_UNSIGNED_BYTE, texture->pixels.data());
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        }
+        else
+        {
+            const unsigned char white[4] = { 255, 255, 255, 255 };
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        int atlasSize = FRAMES * FRAME_SIZE;
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        GLuint depth, fbo;
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Error: el framebuffer de los impostores no está completo" << std::endl;
+
+        GLint viewport[4];
+        GLfloat clearColor[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), blend = glIsEnabled(GL_BLEND);
+
+        glViewport(0, 0, atlasSize, atlasSize);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+
+        glUseProgram(bakeProgram);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, sourceTexture);
+        glUniform1i(glGetUniformLocation(bakeProgram, "texture1"), 0);
+        glBindVertexArray(arena.getVao());
+        glm::mat4x4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 4.0f * radius);
+        for (int y = 0; y < FRAMES; ++y)
+            for (int x = 0; x < FRAMES; ++x)
+            {
+                // Misma base que el quad de impostorVertexShaderSource
+                glm::vec3 direction = octDecode(glm::vec2((x + 0.5f) / FRAMES, (y + 0.5f) / FRAMES) * 2.0f - 1.0f);
+                glm::vec3 up = glm::length(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), direction)) > 1e-3f ?
+                               glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, -direction.y);
+                glm::mat4x4 viewProj = projection * glm::lookAt(center + direction * (2.0f * radius), center, up);
+                glUniformMatrix4fv(glGetUniformLocation(bakeProgram, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
+                glViewport(x * FRAME_SIZE, y * FRAME_SIZE, FRAME_SIZE, FRAME_SIZE);
+                glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                    (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+            }
+        glBindVertexArray(0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+        if (!depthTest) glDisable(GL_DEPTH_TEST);
+        if (blend) glEnable(GL_BLEND);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteTextures(1, &sourceTexture);
+
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        setupQuad();
+        std::cout << "Impostor: " << FRAMES * FRAMES << " vistas en un atlas de " << atlasSize << "x" << atlasSize << std::endl;
+    }
+
+    void destroy()
+    {
+        if (atlas) glDeleteTextures(1, &atlas);
+        if (vao) glDeleteVertexArrays(1, &vao);
+        if (vbo) glDeleteBuffers(1, &vbo);
+        // Los programas son de ProgramCache
+        atlas = vao = vbo = bakeProgram = program = 0;
+    }
+
+    // Solo se gira en Y; center y radius, la esfera envolvente en el mundo
+    void addInstance(const glm::mat4x4& model, const glm::vec3& center, float radius)
+    {
+        Instance instance;
+        instance.center = glm::vec4(center, radius);
+        instance.origin = glm::vec4(glm::vec3(model[3]), std::atan2(-model[0][2], model[0][0]));
+        instances.push_back(instance);
+    }
+
+    // Distancias entre las que la malla se funde con el impostor
+    void setFade(const glm::vec2& _fade)
+    {
+        fade = _fade;
+    }
+
+    // Antes de StreamBuffer::commit()
+    void update(const glm::vec3& eye, const glm::mat4x4& viewProj, StreamBuffer& stream)
+    {
+        select(eye, viewProj);
+        upload(stream);
+    }
+
+    void select(const glm::vec3& eye, const glm::mat4x4& viewProj)
+    {
+        glm::vec4 planes[6];
+        GpuCuller::extractPlanes(viewProj, planes);
+        visible.clear();
+        for (const Instance& instance : instances)
+        {
+            if (glm::length(eye - glm::vec3(instance.origin)) < fade.x)
+                continue;
+            bool inside = true;
+            for (int i = 0; i < 6 && inside; ++i)
+                inside = glm::dot(glm::vec3(planes[i]), glm::vec3(instance.center)) + planes[i].w >= -instance.center.w;
+            if (inside)
+                visible.push_back(instance);
+        }
+    }
+
+    // Los visibles del último select()
+    void upload(StreamBuffer& stream)
+    {
+        instanceData = StreamBuffer::Allocation{ nullptr, 0 };
+        if (!visible.empty())
+        {
+            instanceData = stream.allocate(visible.size() * sizeof(Instance), sizeof(Instance));
+            if (instanceData.data)
+                memcpy(instanceData.data, visible.data(), visible.size() * sizeof(Instance));
+        }
+    }
+
+    // Tras StreamBuffer::commit(), con los opacos
+    void draw(const StreamBuffer& stream, const glm::mat4x4& view, const glm::mat4x4& proj, const glm::vec3& eye)
+    {
+        if (!program || !instanceData.data)
+            return;
+
+        glUseProgram(program);
+        glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
+        glUniform3fv(glGetUniformLocation(program, "eye"), 1, glm::value_ptr(eye));
+        glUniform2fv(glGetUniformLocation(program, "fade"), 1, glm::value_ptr(fade));
+        glUniform1f(glGetUniformLocation(program, "frames"), float(FRAMES));
+        glUniform1i(glGetUniformLocation(program, "atlas"), 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)instanceData.offset);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)(instanceData.offset + sizeof(glm::vec4)));
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)visible.size());
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Impostores dibujados en el último update()
+    size_t getVisibleCount() const
+    {
+        return visible.size();
+    }
+
+    // Solo el programa de dibujo: el de horneado ya no se vuelve a usar
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+            if (program == swap.oldProgram)
+                program = swap.newProgram;
+    }
+
+private:
+    struct Instance
+    {
+        glm::vec4 center; // centro y radio
+        glm::vec4 origin; // origen y giro en Y
+    };
+
+    std::vector<Instance> instances;
+    std::vector<Instance> visible;
+    StreamBuffer::Allocation instanceData = {};
+    glm::vec2 fade = glm::vec2(0.0f);
+
+    GLuint atlas = 0, vao = 0, vbo = 0;
+    GLuint bakeProgram = 0, program = 0;
+
+    // Inversa de octEncode() en impostorCommonSource
+    static glm::vec3 octDecode(const glm::vec2& encoded)
+    {
+        glm::vec3 direction(encoded.x, 1.0f - std::abs(encoded.x) - std::abs(encoded.y), encoded.y);
+        if (direction.y < 0.0f)
+        {
+            float x = direction.x, z = direction.z;
+            direction.x = (1.0f - std::abs(z)) * (x >= 0.0f ? 1.0f : -1.0f);
+            direction.z = (1.0f - std::abs(x)) * (z >= 0.0f ? 1.0f : -1.0f);
+        }
+        return glm::normalize(direction);
+    }
+
+    void setupQuad()
+    {
+        const float corners[8] = { -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f };
+        glGenVertexArrays(1, &vao);
+        glGenBuffers(1, &vbo);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        for (int attribute = 1; attribute <= 2; ++attribute)
+        {
+            glVertexAttribDivisor(attribute, 1);
+            glEnableVertexAttribArray(attribute);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void setupPrograms(ProgramCache& cache)
+    {
+        bakeProgram = cache.getProgram({ { GL_VERTEX_SHADER, impostorBakeVertexShaderSource },
+                                         { GL_FRAGMENT_SHADER, impostorBakeFragmentShaderSource } });
+        program = cache.getProgram({ { GL_VERTEX_SHADER, impostorVertexProgramSource.c_str() },
+                                     { GL_FRAGMENT_SHADER, impostorFragmentProgramSource.c_str() } });
+    }
+};
+
+#endif
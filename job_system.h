@@ -0,0 +1,295 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+// Trabajo de la CPU por fotograma repartido entre todos los núcleos.
+//
+// Cada hilo tiene su cola doble de trabajos; el principal es el 0 y los
+// trabajadores, del 1 en adelante. Lo que un hilo lanza va al final de su cola
+// y él mismo lo saca del final (lo último lanzado aún está en caché); cuando se
+// queda sin nada, roba del principio de la cola de otro, que es lo más antiguo.
+// Cada cola tiene su propio mutex: los trabajos son de decenas de
+// microsegundos como poco y con eso basta.
+//
+// Un JobCounter cuenta los trabajos pendientes de un grupo. run() puede
+// depender de otro contador: el trabajo no entra en ninguna cola hasta que ese
+// llega a cero (se guarda en el contador y lo lanza quien termina el último).
+// wait() no duerme: el hilo que espera sigue sacando y robando trabajos, así
+// que el principal también trabaja y un trabajo puede esperar a otros dentro.
+// Los trabajadores sin nada que hacer sí duermen hasta que llega algo.
+//
+// Cada trabajo lleva un nombre (un literal) y se mide lo que tarda;
+// getProfile() suma por nombre lo de todos los hilos.
+//
+// Los trabajos no pueden llamar a OpenGL ni pedir memoria a un StreamBuffer:
+// eso sigue en el hilo principal.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobCounter;
+
+struct Job
+{
+    const char* name = "";
+    std::function<void()> work;
+    JobCounter* counter = nullptr;
+};
+
+// Puede destruirse en cuanto done() devuelve true
+struct JobCounter
+{
+    std::atomic<unsigned> pending{ 0 };
+    std::mutex mutex;
+    std::vector<Job> continuations; // los que dependen de este contador
+
+    // El último trabajo baja el contador con el mutex tomado: cuando aquí se
+    // ve el cero, ese hilo ya no va a tocar el contador
+    bool done()
+    {
+        if (pending.load() > 0)
+            return false;
+        std::lock_guard<std::mutex> lock(mutex);
+        return pending.load() == 0;
+    }
+};
+
+struct JobProfile
+{
+    const char* name;
+    unsigned jobs;
+    double milliseconds;
+};
+
+class JobSystem
+{
+public:
+    // threadCount = 0: uno por núcleo, contando el principal
+    void init(unsigned threadCount = 0)
+    {
+        unsigned count = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+        queues = std::vector<Queue>(count);
+        profiles.assign(count, std::vector<JobProfile>());
+        stopping = false;
+        currentSystem = this;
+        currentIndex = 0;
+        for (unsigned index = 1; index < count; ++index)
+            workers.push_back(std::thread(&JobSystem::workerLoop, this, index));
+    }
+
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+    }
+
+    // after: si no es nullptr, el trabajo espera a que ese contador llegue a cero
+    void run(const char* name, std::function<void()> work, JobCounter* counter = nullptr, JobCounter* after = nullptr)
+    {
+        Job job;
+        job.name = name;
+        job.work = std::move(work);
+        job.counter = counter;
+        if (counter)
+            ++counter->pending;
+
+        if (after)
+        {
+            std::lock_guard<std::mutex> lock(after->mutex);
+            if (after->pending.load() > 0)
+            {
+                after->continuations.push_back(std::move(job));
+                return;
+            }
+        }
+        push(std::move(job));
+    }
+
+    // work(begin, end) por tramos de como mucho grain elementos
+    void parallelFor(const char* name, size_t count, size_t grain, const std::function<void(size_t, size_t)>& work, JobCounter* counter)
+    {
+        grain = std::max(grain, (size_t)1);
+        for (size_t begin = 0; begin < count; begin += grain)
+        {
+            size_t end = std::min(begin + grain, count);
+            run(name, [work, begin, end] { work(begin, end); }, counter);
+        }
+    }
+
+    // Ejecuta trabajos (propios o robados) hasta que el contador llega a cero
+    void wait(JobCounter& counter)
+    {
+        unsigned index = currentThread();
+        while (!counter.done())
+        {
+            Job job;
+            if (take(index, job))
+                execute(job, index);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    // Con todo esperado; los trabajos con el mismo nombre se suman
+    std::vector<JobProfile> getProfile() const
+    {
+        std::vector<JobProfile> total;
+        for (const std::vector<JobProfile>& thread : profiles)
+            for (const JobProfile& entry : thread)
+            {
+                auto found = std::find_if(total.begin(), total.end(), [&](const JobProfile& other) { return std::strcmp(other.name, entry.name) == 0; });
+                if (found == total.end())
+                    total.push_back(entry);
+                else
+                {
+                    found->jobs += entry.jobs;
+                    found->milliseconds += entry.milliseconds;
+                }
+            }
+        return total;
+    }
+
+    unsigned getThreadCount() const
+    {
+        return (unsigned)queues.size();
+    }
+
+    unsigned getSteals() const
+    {
+        return steals.load();
+    }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::vector<JobProfile>> profiles; // por hilo; cada uno solo toca el suyo
+    std::vector<std::thread> workers;
+    std::atomic<unsigned> queued{ 0 }, steals{ 0 };
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    static inline thread_local const JobSystem* currentSystem = nullptr;
+    static inline thread_local unsigned currentIndex = 0;
+
+    // Los hilos que no son de este sistema (p. ej. los del pasto) usan la cola del principal
+    unsigned currentThread() const
+    {
+        return currentSystem == this ? currentIndex : 0;
+    }
+
+    void push(Job job)
+    {
+        // Antes de que esté en la cola: queued nunca baja de cero
+        ++queued;
+        Queue& queue = queues[currentThread()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    bool take(unsigned index, Job& job)
+    {
+        if (queued.load() == 0)
+            return false;
+        for (size_t k = 0; k < queues.size(); ++k)
+        {
+            Queue& queue = queues[(index + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+                continue;
+            if (k == 0)
+            {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+                ++steals;
+            }
+            --queued;
+            return true;
+        }
+        return false;
+    }
+
+    void execute(Job& job, unsigned index)
+    {
+        auto start = std::chrono::steady_clock::now();
+        job.work();
+        double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<JobProfile>& profile = profiles[index];
+        auto found = std::find_if(profile.begin(), profile.end(), [&](const JobProfile& entry) { return entry.name == job.name; });
+        if (found == profile.end())
+            profile.push_back({ job.name, 1, milliseconds });
+        else
+        {
+            ++found->jobs;
+            found->milliseconds += milliseconds;
+        }
+
+        if (job.counter)
+            finish(*job.counter);
+    }
+
+    // El último en terminar lanza los que dependían del contador
+    void finish(JobCounter& counter)
+    {
+        std::vector<Job> ready;
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            if (--counter.pending == 0)
+                ready.swap(counter.continuations);
+        }
+        for (Job& job : ready)
+            push(std::move(job));
+    }
+
+    void workerLoop(unsigned index)
+    {
+        currentSystem = this;
+        currentIndex = index;
+        for (;;)
+        {
+            Job job;
+            if (take(index, job))
+            {
+                execute(job, index);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [&] { return stopping || queued.load() > 0; });
+            if (stopping)
+                return;
+        }
+    }
+};
+
+#endif
@@ -10,6 +10,9 @@
 #include <vector>
 #include <string>
 #include <filesystem>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -17,198 +20,199 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
+#include "gl_ext.h"
+#include "texture_bake.h"
+#include "texture_streaming.h"
+#include "stream_buffer.h"
+#include "mesh_arena.h"
+#include "render_queue.h"
+#include "gpu_culling.h"
+#include "hiz_buffer.h"
+#include "soft_raster.h"
+#include "terrain.h"
+#include "cdlod_terrain.h"
+#include "grass.h"
+#include "impostor.h"
+#include "shadow_maps.h"
+#include "clustered_lights.h"
+#include "program_cache.h"
+#include "shader_permutations.h"
+#include "deferred_renderer.h"
+#include "overdraw_counter.h"
+#include "debug_views.h"
+#include "dynamic_resolution.h"
+#include "temporal_aa.h"
+#include "beam_effects.h"
+#include "job_system.h"
+#include "particles.h"
+
 #define WINDOW_WIDTH 1920.0f
 #define WINDOW_HEIGHT 1080.0f
 #define CAMERA_STEP 1.0f
 
-const char* vertexShaderSource = R"glsl(
-    #version 330 core
-    layout (location = 0) in vec3 aPos;
-    layout (location = 1) in vec2 aTexCoord;
-
-    out vec2 TexCoord;
-    out vec3 FragPos;
-    out vec3 Normal;
-
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
-
-    void main()
-    {
-        gl_Position = projection * view * model * vec4(aPos, 1.0);
-        FragPos = vec3(model * vec4(aPos, 1.0));
-        Normal = mat3(transpose(inverse(model))) * aPos;
-        TexCoord = aTexCoord;
-    }
-)glsl";
-
-const char* fragmentShaderSource = R"glsl(
-    #version 330 core
-    out vec4 FragColor;
-
-    in vec2 TexCoord;
-
-    uniform sampler2D texture1;
-
-    void main()
-    {
-        vec4 texColor = texture(texture1, TexCoord);
-        FragColor = texColor;
-    }
-)glsl";
-
-const char* coneFragmentShaderSource = R"glsl(
-    #version 330 core
-    out vec4 FragColor;
-
-    in vec3 FragPos;
-    in vec3 Normal;
-
-    uniform vec3 lightPos;
-    uniform vec3 viewPos;
-    uniform vec3 lightColor;
-    uniform vec3 objectColor;
-
-    void main()
-    {
-        // Ambient
-        float ambientStrength = 0.1;
-        vec3 ambient = ambientStrength * lightColor;
-
-        // Diffuse 
-        vec3 norm = normalize(Normal);
-        vec3 lightDir = normalize(lightPos - FragPos);
-        float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = diff * lightColor;
-
-        // Specular
-        float specularStrength = 0.5;
-        vec3 viewDir = normalize(viewPos - FragPos);
-        vec3 reflectDir = reflect(-lightDir, norm);
-        float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
-        vec3 specular = specularStrength * spec * lightColor;
-
-        vec3 result = (ambient + diffuse + specular) * objectColor;
-        FragColor = vec4(result, 0.5); // Cambiar la componente alfa para transparencia
-    }
-)glsl";
-
-const char* laserVertexShaderSource = R"glsl(
-    #version 330 core
-    layout (location = 0) in vec3 aPos;
-
-    uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
-
-    void main()
-    {
-        gl_Position = projection * view * model * vec4(aPos, 1.0);
-    }
-)glsl";
-
-const char* laserFragmentShaderSource = R"glsl(
-    #version 330 core
-    out vec4 FragColor;
-
-    void main()
-    {
-        FragColor = vec4(1.0, 0.0, 0.0, 0.35); // Color rojo con opacidad
-    }
-)glsl";
-
-
-GLuint laserShaderProgram;
-GLuint laserVAO, laserVBO;
-GLuint shaderProgram;
-GLuint coneShaderProgram;
 class Camera* camera;
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processKeyInput(GLFWwindow* window, int key, int scancode, int action, int mods);
-GLuint loadShader(GLenum type, const char* source);
 GLuint loadTexture(const std::string& path);
-
-// Definición de un cono simple
-std::vector<float> coneVertices;
-std::vector<unsigned int> coneIndices;
-const int coneResolution = 30;
+int bakeTexturesOffline(const std::string& directory);
+GrassDensityMap buildGrassDensity(const std::string& modelsDir);
+
+// Opciones del horneado de texturas; la compresión depende del driver
+TextureBakeOptions textureBakeOptions;
+
+// Streaming de texturas: memoria máxima para los niveles de detalle
+const bool textureStreaming = true;
+const size_t textureMemoryBudget = 48 * 1024 * 1024;
+TextureStreamer textureStreamer;
+
+// Datos que se reescriben cada fotograma (vértices del láser, etc.)
+StreamBuffer dynamicBuffer;
+
+// Todos los dibujos del fotograma pasan por aquí y se ordenan por estado
+RenderQueue renderQueue;
+
+// Geometría estática de todos los modelos en un solo VBO/EBO/VAO
+MeshArena staticMeshes;
+
+// Las montañas: heightfield por chunks con nivel de detalle
+Terrain terrain;
+const float terrainCellSize = 10.0f;
+
+// El suelo: CDLOD sobre un heightmap, con el mismo coste a cualquier tamaño
+CdlodTerrain ground;
+const float groundSize = 8192.0f;
+const float groundLeafRange = 512.0f; // distancia que cubren los nodos más finos
+const float groundHeightScale = 300.0f;
+const int groundResolution = 1025; // muestras por lado del heightmap procedural
+// Textura del suelo y de las montañas (la del antiguo parche de pasto); la versión
+// para SoftRasterizer se decodifica la primera vez que se pide
+std::string groundTexturePath;
+SoftTexture groundSoftTexture;
+bool groundSoftTextureLoaded = false;
+
+// Briznas de pasto generadas alrededor de la cámara; alpha-to-coverage necesita multisampling
+const bool grassBlades = true;
+const int multisampleCount = 4;
+GrassRenderer grass;
+
+// Árboles lejanos como impostores (solo con gpuCulling: la malla se funde en el culler)
+const bool treeImpostors = true;
+const glm::vec2 impostorFade(180.0f, 220.0f);
+ImpostorRenderer treeImpostor;
+
+// Sombras de la luna en cascadas y del foco del OVNI; los shaders de los objetos,
+// el suelo y el pasto enlazan su applyShadows() aunque estén desactivadas
+const bool shadows = true;
+const glm::vec3 moonDirection(-0.35f, -1.0f, -0.45f);
+const float moonShadowStrength = 0.5f;
+ShadowMaps shadowMaps;
+
+// Luces puntuales del OVNI (luces de posición y del rayo) asignadas por clusters
+const bool clusteredLighting = true;
+const int ufoRunningLights = 32;
+const int beamLights = 8;
+ClusteredLights lights;
+
+// Las fuentes con applyShadows() y applyLights(), y los programas que las enlazan
+std::vector<ShaderSource> lightingLibraries;
+std::vector<GLuint> litPrograms;
+
+// Programas compilados una vez por ejecución; los binarios enlazados se guardan
+// en disco para los siguientes arranques si el driver lo permite
+ProgramCache programCache;
+
+// Los shaders de la escena y las bibliotecas de iluminación se leen de shaders/ y
+// se recompilan al guardar, sin reiniciar ni volver a cargar la escena
+const bool shaderHotReload = true;
+
+// Objetos, árboles y suelo: variantes de un mismo shader elegidas por máscara
+ShaderPermutations sceneShaders;
+const unsigned terrainShaderFeatures = SHADER_TEXTURED | SHADER_SHADOWED | SHADER_LIT;
+
+// Sombreado diferido: lo que recibe luz escribe un G-buffer y las luces se aplican
+// una vez por píxel; el cielo, los impostores y lo transparente van después a forwardQueue
+const bool deferredShading = false;
+DeferredRenderer deferred;
+RenderQueue forwardQueue;
+
+// Pasada previa de profundidad para los árboles y los opacos de la cola (solo
+// posiciones) y después color con GL_EQUAL; overdraw mide los fragmentos por píxel
+const bool depthPrepass = true;
+OverdrawCounter overdraw;
+
+// La escena se dibuja fuera de pantalla a la resolución que mantiene el tiempo de
+// GPU por fotograma cerca del objetivo y se escala a la ventana con realce
+const bool dynamicResolution = true;
+const float frameTimeTarget = 16.6f; // ms
+DynamicResolution resolution;
+
+// Antialiasing temporal con la proyección desplazada por subpíxeles, en lugar de
+// multisampling (necesita dynamicResolution, cuyo destino deja de tener muestras)
+const bool temporalAA = true;
+TemporalAA taa;
+
+// Vistas de depuración (F1 sobredibujo, F2 triángulos, F3 lod, F4 descartados);
+// sin ventana con --debug-view <vista> salida.tga
+DebugViews debugViews;
+
+// Árboles: culling y dibujo instanciado en la GPU
+const bool gpuCulling = true;
+GpuCuller gpuCuller;
+
+// Oclusión contra la profundidad de fotogramas anteriores
+const bool occlusionCulling = true;
+HiZBuffer hiZ;
+
+// Oclusores rasterizados en la CPU en lugar de leer la profundidad de la GPU
+const bool softwareOcclusion = false;
+const int softwareOcclusionDivisor = 8; // resolución = ventana / divisor
+SoftRasterizer occluderRaster;
+
+// Sin ventana ni OpenGL (--reference): los modelos no crean texturas
+bool headless = false;
+bool referenceRequested = false;
+
+// El haz del OVNI y el láser (ver beam_effects.h)
+BeamRenderer beams;
 const float coneHeight = 50.0f;  // Ajustar la altura del cono
 const float coneRadius = 10.0f;  // Ajustar el radio del cono
 float time_laser = 0.0f;
 
-void setupLaserShader() {
-    GLuint laserVertexShader = loadShader(GL_VERTEX_SHADER, laserVertexShaderSource);
-    GLuint laserFragmentShader = loadShader(GL_FRAGMENT_SHADER, laserFragmentShaderSource);
-    laserShaderProgram = glCreateProgram();
-    glAttachShader(laserShaderProgram, laserVertexShader);
-    glAttachShader(laserShaderProgram, laserFragmentShader);
-    glLinkProgram(laserShaderProgram);
-
-    // Comprobar errores de enlace
-    int success;
-    char infoLog[512];
-    glGetProgramiv(laserShaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(laserShaderProgram, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
-    glDeleteShader(laserVertexShader);
-    glDeleteShader(laserFragmentShader);
-}
-
-void setupLaser() {
-    glGenVertexArrays(1, &laserVAO);
-    glGenBuffers(1, &laserVBO);
-
-    glBindVertexArray(laserVAO);
+// Trabajo de la CPU por fotograma (animación, nivel de detalle, oclusión, partículas)
+// repartido entre todos los núcleos, el principal incluido
+JobSystem jobs;
 
-    glBindBuffer(GL_ARRAY_BUFFER, laserVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6, NULL, GL_DYNAMIC_DRAW);
+// Chispas y polvo del rayo, simulados en la CPU; sin ventana con --particles [cantidad]
+const bool beamParticles = true;
+const float sparkleRate = 4000.0f; // por segundo
+const float dustRate = 2500.0f;
+ParticleSystem particles;
+ParticleRenderer particleRenderer;
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+// Sin ventana no hay texturas de OpenGL
+GLuint requestTexture(const std::string& path)
+{
+    if (headless)
+        return 0;
+    return textureStreaming ? textureStreamer.request(path) : loadTexture(path);
 }
 
-
-void generateCone() {
-    // Vertices
-    coneVertices.push_back(0.0f); // Centro de la base (x)
-    coneVertices.push_back(0.0f); // Centro de la base (y)
-    coneVertices.push_back(0.0f); // Centro de la base (z)
-
-    for (int i = 0; i <= coneResolution; ++i) {
-        float angle = 2.0f * 3.14159265359f * float(i) / float(coneResolution);
-        float x = coneRadius * cos(angle);
-        float z = coneRadius * sin(angle);
-        coneVertices.push_back(x); // Base vertex (x)
-        coneVertices.push_back(0.0f); // Base vertex (y)
-        coneVertices.push_back(z); // Base vertex (z)
-    }
-
-    // Tip of the cone
-    coneVertices.push_back(0.0f); // (x)
-    coneVertices.push_back(coneHeight); // (y)
-    coneVertices.push_back(0.0f); // (z)
-
-    // Indices for base
-    for (int i = 1; i <= coneResolution; ++i) {
-        coneIndices.push_back(0);
-        coneIndices.push_back(i);
-        coneIndices.push_back(i + 1);
-    }
-
-    // Indices for the sides
-    int tipIndex = coneVertices.size() / 3 - 1;
-    for (int i = 1; i <= coneResolution; ++i) {
-        coneIndices.push_back(tipIndex);
-        coneIndices.push_back(i);
-        coneIndices.push_back(i + 1);
+// Decodifica path para SoftRasterizer solo la primera vez; nullptr si no se pudo
+const SoftTexture* loadSoftTexture(const std::string& path, SoftTexture& texture, bool& loaded)
+{
+    if (!loaded && !path.empty())
+    {
+        loaded = true;
+        unsigned char* data = stbi_load(path.c_str(), &texture.width, &texture.height, &texture.channels, 0);
+        if (data) {
+            texture.pixels.assign(data, data + texture.width * texture.height * texture.channels);
+            stbi_image_free(data);
+        } else {
+            std::cerr << "Error al cargar la textura: " << path << std::endl;
+        }
     }
+    return texture.pixels.empty() ? nullptr : &texture;
 }
 
 class Model
@@ -216,41 +220,37 @@ class Model
     std::vector<float> vertices;
     std::vector<float> texcoords;
     std::vector<unsigned int> indices;
-    GLuint vao, vbo, ebo;
+    MeshRange range;
     std::vector<GLuint> textureIDs;
+    std::vector<std::string> texturePaths;
+    SoftTexture softTexture;
+    bool softTextureLoaded = false;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+    unsigned shaderFeatures = SHADER_SHADOWED | SHADER_LIT;
+
+    void computeBounds()
+    {
+        glm::vec3 minCorner(1e30f), maxCorner(-1e30f);
+        for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+        {
+            glm::vec3 v(vertices[i], vertices[i + 1], vertices[i + 2]);
+            minCorner = glm::min(minCorner, v);
+            maxCorner = glm::max(maxCorner, v);
+        }
+        boundsCenter = (minCorner + maxCorner) * 0.5f;
+        boundsRadius = 0.0f;
+        for (size_t i = 0; i + 2 < vertices.size(); i += 3)
+            boundsRadius = glm::max(boundsRadius, glm::length(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]) - boundsCenter));
+    }
 
     void setUpVao()
     {
         std::cout << "Vertices: " << vertices.size() << std::endl;
         std::cout << "Indices: " << indices.size() << std::endl;
 
-        glGenVertexArrays(1, &vao);
-        glGenBuffers(1, &vbo);
-        glGenBuffers(1, &ebo);
-
-        glBindVertexArray(vao);
-
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        if (!texcoords.empty())
-        {
-            GLuint texVBO;
-            glGenBuffers(1, &texVBO);
-            glBindBuffer(GL_ARRAY_BUFFER, texVBO);
-            glBufferData(GL_ARRAY_BUFFER, texcoords.size() * sizeof(float), texcoords.data(), GL_STATIC_DRAW);
-            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
-            glEnableVertexAttribArray(1);
-        }
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        // La subida a la GPU la hace staticMeshes.upload() con todos los modelos
+        range = staticMeshes.add(vertices, texcoords, indices);
     }
 
     bool loadModel(const std::string& path)
@@ -285,6 +285,7 @@ class Model
         }
 
         setUpVao();
+        computeBounds();
 
         // Cargar texturas desde el archivo .mtl
         for (const auto& material : materials)
@@ -292,8 +293,14 @@ class Model
             if (!material.diffuse_texname.empty())
             {
                 std::string texturePath = baseDir + material.diffuse_texname;
-                textureIDs.push_back(loadTexture(texturePath));
+                texturePaths.push_back(texturePath);
+                shaderFeatures |= SHADER_TEXTURED;
+                if (!headless)
+                    textureIDs.push_back(requestTexture(texturePath));
             }
+            // Con map_d (las hojas del árbol) los texels transparentes se descartan
+            if (!material.alpha_texname.empty())
+                shaderFeatures |= SHADER_ALPHA_TESTED;
         }
 
         return true;
@@ -307,15 +314,68 @@ public:
             exit(1);
     }
 
-    void draw()
+    // La textura con la que se dibuja (la última del modelo), la de fillDrawItem()
+    GLuint getBoundTexture() const
     {
-        for (const auto& textureID : textureIDs)
-        {
-            glBindTexture(GL_TEXTURE_2D, textureID);
-        }
-        glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        return textureIDs.empty() ? 0 : textureIDs.back();
+    }
+
+    void fillDrawItem(DrawItem& item) const
+    {
+        item.texture = getBoundTexture();
+        item.vao = staticMeshes.getVao();
+        item.mode = GL_TRIANGLES;
+        item.indexed = true;
+        item.first = range.firstIndex;
+        item.count = range.indexCount;
+        item.baseVertex = range.baseVertex;
+    }
+
+    const MeshRange& getRange() const
+    {
+        return range;
+    }
+
+    // Máscara de ShaderFeature que necesitan sus materiales
+    unsigned getShaderFeatures() const
+    {
+        return shaderFeatures;
+    }
+
+    const std::vector<float>& getVertices() const
+    {
+        return vertices;
+    }
+
+    const std::vector<float>& getTexcoords() const
+    {
+        return texcoords;
+    }
+
+    const std::vector<unsigned int>& getIndices() const
+    {
+        return indices;
+    }
+
+    // La misma textura que getBoundTexture(), decodificada para SoftRasterizer
+    const SoftTexture* getSoftTexture()
+    {
+        return loadSoftTexture(texturePaths.empty() ? std::string() : texturePaths.back(), softTexture, softTextureLoaded);
+    }
+
+    const std::vector<GLuint>& getTextureIDs() const
+    {
+        return textureIDs;
+    }
+
+    glm::vec3 getBoundsCenter() const
+    {
+        return boundsCenter;
+    }
+
+    float getBoundsRadius() const
+    {
+        return boundsRadius;
     }
 };
 
@@ -323,24 +383,117 @@ class Object
 {
     glm::vec4 position;
     glm::mat4x4 transformation;
+    glm::mat4x4 previousTransformation; // la del fotograma anterior, para TAA
     Model* model;
+    unsigned shaderFeatures;
 
 public:
     Object(Model* _model, const glm::mat4x4& _transformation) :
-        transformation(_transformation), model(_model)
+        transformation(_transformation), previousTransformation(_transformation), model(_model), shaderFeatures(_model->getShaderFeatures())
     {
         position = transformation * glm::vec4(0.0f);
     }
 
+    // Una vez por fotograma: la anterior queda para los vectores de movimiento
     void updateTransformation(const glm::mat4x4& _transformation)
     {
+        previousTransformation = transformation;
         transformation = _transformation;
     }
 
-    void draw()
+    unsigned getShaderFeatures() const
+    {
+        return shaderFeatures;
+    }
+
+    void setShaderFeatures(unsigned features)
+    {
+        shaderFeatures = features;
+    }
+
+    void submit(RenderQueue& queue, GLuint program, const glm::vec3& eye, GLuint depthProgram = 0) const
+    {
+        DrawItem item;
+        item.program = program;
+        item.depthProgram = depthProgram;
+        item.batchable = queue.isIndirect();
+        model->fillDrawItem(item);
+        item.model = transformation;
+        item.depth = glm::length(worldCenter() - eye);
+        queue.submit(item);
+    }
+
+    // Para instancias que no se mueven: a partir de aquí las dibuja la GPU
+    void addToCuller(GpuCuller& culler) const
+    {
+        culler.addInstance(model->getRange(), model->getBoundTexture(), transformation, worldCenter(), worldRadius());
+    }
+
+    void addToImpostors(ImpostorRenderer& impostors) const
+    {
+        impostors.addInstance(transformation, worldCenter(), worldRadius());
+    }
+
+    void addToShadows(ShadowMaps& shadowMaps) const
+    {
+        shadowMaps.addCaster(model->getRange(), transformation, worldCenter(), worldRadius());
+    }
+
+    // Cada fotograma, para los que se mueven; spot: si también tapa el foco del OVNI
+    void castShadow(ShadowMaps& shadowMaps, bool spot) const
+    {
+        shadowMaps.addDynamicCaster(model->getRange(), transformation, worldCenter(), worldRadius(), spot);
+    }
+
+    // Cada fotograma, para los que se mueven, entre TemporalAA::beginMotion() y endMotion()
+    void drawMotion(TemporalAA& taa) const
+    {
+        taa.drawMotion(model->getRange(), transformation, previousTransformation);
+    }
+
+    Model* getModel() const
+    {
+        return model;
+    }
+
+    // color: con la textura del modelo (referencia); sin él, solo profundidad (oclusores)
+    void rasterize(SoftRasterizer& raster, bool color) const
+    {
+        raster.submit(model->getVertices(), model->getTexcoords(), model->getIndices(), transformation,
+                      color ? model->getSoftTexture() : nullptr);
+    }
+
+    glm::vec3 worldCenter() const
+    {
+        return glm::vec3(transformation * glm::vec4(model->getBoundsCenter(), 1.0f));
+    }
+
+    float worldRadius() const
+    {
+        float scale = glm::max(glm::length(glm::vec3(transformation[0])),
+                      glm::max(glm::length(glm::vec3(transformation[1])), glm::length(glm::vec3(transformation[2]))));
+        return model->getBoundsRadius() * scale;
+    }
+
+    // Diámetro aproximado en píxeles de la esfera envolvente
+    float projectedSize(const glm::mat4x4& view, const glm::mat4x4& proj, float viewportHeight) const
+    {
+        float radius = worldRadius();
+        glm::vec4 center = view * glm::vec4(worldCenter(), 1.0f);
+        float depth = -center.z;
+
+        if (depth + radius <= 0.0f)
+            return 0.0f;
+        if (depth <= radius)
+            return viewportHeight;
+        return radius * proj[1][1] / depth * viewportHeight;
+    }
+
+    void noteTextureUsage(TextureStreamer& streamer, const glm::mat4x4& view, const glm::mat4x4& proj, float viewportHeight) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(transformation));
-        model->draw();
+        float size = projectedSize(view, proj, viewportHeight);
+        for (GLuint textureID : model->getTextureIDs())
+            streamer.noteUsage(textureID, size);
     }
 };
 
@@ -351,13 +504,18 @@ class Camera
 
     glm::mat4x4 viewMatrix;
     glm::mat4x4 projMatrix;
+    glm::mat4x4 unjitteredProjMatrix;
+
+    // viewProj sin jitter del fotograma en curso y del anterior (TAA)
+    glm::mat4x4 frameViewProj;
+    glm::mat4x4 previousViewProj;
+    bool frameStarted = false;
 
     float fovy, aspect, near, far;
 
     void updateViewMatrix()
     {
         viewMatrix = glm::lookAt(position, center, glm::vec3(0.0f, 0.1f, 0.0f));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
     }
 
 public:
@@ -365,8 +523,19 @@ public:
         position(_position), center(_center), fovy(_fovy), aspect(_aspect), near(_near), far(_far)
     {
         updateViewMatrix();
-        projMatrix = glm::perspective(fovy, aspect, near, far);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projMatrix));
+        projMatrix = unjitteredProjMatrix = glm::perspective(fovy, aspect, near, far);
+        frameViewProj = previousViewProj = projMatrix * viewMatrix;
+    }
+
+    // Al principio de cada fotograma: desplaza la proyección jitter (en NDC,
+    // ver TemporalAA::nextJitter()) y guarda la viewProj del fotograma anterior
+    void beginFrame(const glm::vec2& jitter)
+    {
+        glm::mat4x4 viewProj = unjitteredProjMatrix * viewMatrix;
+        previousViewProj = frameStarted ? frameViewProj : viewProj;
+        frameViewProj = viewProj;
+        frameStarted = true;
+        projMatrix = glm::translate(glm::mat4x4(1.0f), glm::vec3(jitter, 0.0f)) * unjitteredProjMatrix;
     }
 
     void move(const glm::vec3& amount)
@@ -430,10 +599,68 @@ public:
     {
         return projMatrix;
     }
+
+    glm::mat4x4 getUnjitteredViewProj() const
+    {
+        return unjitteredProjMatrix * viewMatrix;
+    }
+
+    glm::mat4x4 getPreviousViewProj() const
+    {
+        return previousViewProj;
+    }
 };
 
-int main()
+void buildScene(std::vector<Model>& models, std::vector<Object>& objects, const std::string& modelsDir);
+void renderSoftware(SoftRasterizer& raster, const std::vector<Object>& objects, const SoftTexture* terrainTexture, const glm::mat4& viewProj);
+int renderReferenceOffline(const std::string& modelsDir, const std::string& outputPath);
+int renderDebugViewOffline(const std::string& modelsDir, const std::string& viewName, const std::string& outputPath);
+void addLodBoxes(DebugViews& views, const std::vector<Object>& objects, const Model* treeModel, const glm::vec3& eye);
+void compareWithReference(const std::vector<Object>& objects, const SoftTexture* terrainTexture, const glm::mat4& viewProj);
+ParticleEmitter sparkleEmitter(const glm::vec3& center, float beamRadius);
+ParticleEmitter dustEmitter(const glm::vec3& base, float beamRadius);
+int runParticlesOffline(unsigned count);
+
+int main(int argc, char** argv)
 {
+    // Relative Path
+    std::filesystem::path p = std::filesystem::current_path();
+    int levels_path = 1;
+    std::filesystem::path p_current;
+    p_current = p.parent_path();
+
+    for (int i = 0; i < levels_path; i++)
+    {
+        p_current = p_current.parent_path();
+    }
+
+    std::string vs_path, fs_path;
+
+    std::stringstream ss;
+    ss << std::quoted(p_current.string());
+    std::string out;
+    ss >> std::quoted(out);
+
+    std::cout << "\nCurrent path: " << out << "\n";
+
+    std::string modelsDir = out + "\\glfw-master\\OwnProjects\\Project_01\\modelos\\";
+
+    // Hornear las texturas sin abrir ventana (--bake-textures)
+    if (argc > 1 && std::string(argv[1]) == "--bake-textures")
+        return bakeTexturesOffline(modelsDir);
+
+    // Imagen de referencia por software, sin GPU (--reference salida.tga)
+    if (argc > 2 && std::string(argv[1]) == "--reference")
+        return renderReferenceOffline(modelsDir, argv[2]);
+
+    // Vista de depuración por software (--debug-view sobredibujo salida.tga)
+    if (argc > 3 && std::string(argv[1]) == "--debug-view")
+        return renderDebugViewOffline(modelsDir, argv[2], argv[3]);
+
+    // Partículas del rayo a plena carga, solo con la CPU (--particles [cantidad])
+    if (argc > 1 && std::string(argv[1]) == "--particles")
+        return runParticlesOffline(argc > 2 ? (unsigned)std::stoul(argv[2]) : ParticleSystem::MAX_PARTICLES);
+
     // Inicializar GLFW
     if (!glfwInit()) {
         std::cerr << "Error al inicializar GLFW" << std::endl;
@@ -444,6 +671,10 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // Con resolución dinámica el multisampling es del destino fuera de pantalla
+    if (grassBlades && !dynamicResolution)
+        glfwWindowHint(GLFW_SAMPLES, multisampleCount);
+    glfwWindowHint(GLFW_STENCIL_BITS, 8); // vistas de sobredibujo y triángulos
     GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Cargador de múltiples OBJ", NULL, NULL);
     if (window == NULL) {
         std::cerr << "Error al crear la ventana GLFW" << std::endl;
@@ -461,104 +692,875 @@ int main()
         glfwTerminate();
         return -1;
     }
-
-    // Compilar shaders
-    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint fragmentShader = loadShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    // Comprobar errores de enlace
-    int success;
-    char infoLog[512];
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    loadGLExtensions(glfwGetProcAddress);
+    programCache.init(out + "\\glfw-master\\OwnProjects\\Project_01\\shader_cache\\");
+    if (shaderHotReload) {
+        programCache.enableHotReload(out + "\\glfw-master\\OwnProjects\\Project_01\\shaders\\");
+        programCache.watchSource(sceneVertexShaderSource, "scene.vert");
+        programCache.watchSource(sceneFragmentShaderSource, "scene.frag");
+        programCache.watchSource(shadowSampleShaderSource, "shadows.frag");
+        programCache.watchSource(clusteredLightsShaderSource, "lights.frag");
+        programCache.watchSource(cdlodVertexShaderSource, "ground.vert");
+        programCache.watchSource(grassVertexShaderSource, "grass.vert");
+        programCache.watchSource(cullComputeProgramSource.c_str(), "cull.comp");
+        programCache.watchSource(cullVertexProgramSource.c_str(), "cull.vert");
+        programCache.watchSource(hizFragmentShaderSource, "hiz.frag");
     }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    // Compilar shaders para el cono
-    GLuint coneVertexShader = loadShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint coneFragmentShader = loadShader(GL_FRAGMENT_SHADER, coneFragmentShaderSource);
-    coneShaderProgram = glCreateProgram();
-    glAttachShader(coneShaderProgram, coneVertexShader);
-    glAttachShader(coneShaderProgram, coneFragmentShader);
-    glLinkProgram(coneShaderProgram);
-
-    // Comprobar errores de enlace
-    glGetProgramiv(coneShaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(coneShaderProgram, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    if (deferredShading)
+        lightingLibraries = { { GL_FRAGMENT_SHADER, gBufferWriteShaderSource, true } };
+    else
+        lightingLibraries = { { GL_FRAGMENT_SHADER, shadowSampleShaderSource, true },
+                              { GL_FRAGMENT_SHADER, clusteredLightsShaderSource, true } };
+    sceneShaders.init(programCache);
+    if (dynamicResolution)
+        resolution.init(programCache, (int)WINDOW_WIDTH, (int)WINDOW_HEIGHT, grassBlades && !temporalAA ? multisampleCount : 0, frameTimeTarget);
+    if (temporalAA && resolution.getDepthTexture())
+        taa.init(programCache, resolution.getDepthTexture(), (int)WINDOW_WIDTH, (int)WINDOW_HEIGHT);
+
+    // Sin S3TC se hornean los mipmaps sin comprimir
+    textureBakeOptions.compress = hasGLExtension("GL_EXT_texture_compression_s3tc");
+    if (textureStreaming)
+        textureStreamer.init(textureBakeOptions, textureMemoryBudget);
+
+    dynamicBuffer.init(GL_ARRAY_BUFFER, 4 * 1024 * 1024);
+    beams.init(programCache);
+    jobs.init();
+    if (beamParticles) {
+        particles.init(jobs);
+        particleRenderer.init(programCache, particles.getCapacity());
     }
-    glDeleteShader(coneVertexShader);
-    glDeleteShader(coneFragmentShader);
 
-	// Configurar shaders y láser
-    setupLaserShader();
-    setupLaser();
-
-    // Generar el cono
-    GLuint coneVAO, coneVBO, coneEBO;
-    generateCone();
-
-    // Crear y configurar VAO, VBO y EBO para el cono
-    glGenVertexArrays(1, &coneVAO);
-    glGenBuffers(1, &coneVBO);
-    glGenBuffers(1, &coneEBO);
+    // Con dibujo indirecto, toda la geometría estática se agrupa por textura
+    // y los objetos usan las variantes instanciadas
+    if (glext.multiDrawElementsIndirect) {
+        renderQueue.enableIndirect(&dynamicBuffer);
+        forwardQueue.enableIndirect(&dynamicBuffer);
+    }
+    unsigned batchedFeatures = renderQueue.isIndirect() ? (unsigned)SHADER_INSTANCED : 0u;
+
+    // Con sombreado diferido, lo que recibe luz pasa a escribir el G-buffer
+    auto sceneFeatures = [](unsigned features) {
+        return deferredShading && (features & (SHADER_SHADOWED | SHADER_LIT)) ? features | SHADER_GBUFFER : features;
+    };
+    auto queueFor = [](unsigned features) -> RenderQueue& {
+        return deferredShading && !(features & SHADER_GBUFFER) ? forwardQueue : renderQueue;
+    };
+    // La pasada previa no lleva coordenadas de textura: lo recortado por alfa no entra
+    auto depthFeatures = [&](unsigned features) {
+        return depthPrepass && !(features & SHADER_ALPHA_TESTED) && &queueFor(features) == &renderQueue ? ShaderPermutations::depthOnly(features) : 0u;
+    };
+    auto depthProgramFor = [&](unsigned features) {
+        unsigned depth = depthFeatures(features);
+        return depth ? sceneShaders.get(depth) : 0u;
+    };
+
+    // Cargar modelos y objetos de la escena
+    std::vector<Model> models;
+    std::vector<Object> objects;
+    buildScene(models, objects, modelsDir);
+
+    // Los árboles pasan a la GPU (ver más abajo), todos con la misma variante.
+    // Las que va a usar la escena se compilan mientras se prepara el resto.
+    auto drawnOnGpu = [&](const Object& object) {
+        return gpuCulling && object.getModel() == &models[0];
+    };
+    unsigned cullerShaderFeatures = sceneFeatures(models[0].getShaderFeatures() | SHADER_INSTANCED);
+    std::vector<unsigned> sceneVariants = { sceneFeatures(terrainShaderFeatures | batchedFeatures) };
+    if (gpuCulling)
+        sceneVariants.push_back(cullerShaderFeatures);
+    if (gpuCulling && depthPrepass)
+        sceneVariants.push_back(ShaderPermutations::depthOnly(cullerShaderFeatures));
+    for (const Object& object : objects)
+        if (!drawnOnGpu(object)) {
+            sceneVariants.push_back(sceneFeatures(object.getShaderFeatures() | batchedFeatures));
+            if (depthFeatures(sceneVariants.back()))
+                sceneVariants.push_back(depthFeatures(sceneVariants.back()));
+        }
+    if (depthFeatures(sceneFeatures(terrainShaderFeatures | batchedFeatures)))
+        sceneVariants.push_back(depthFeatures(sceneFeatures(terrainShaderFeatures | batchedFeatures)));
+    sceneShaders.warmUp(sceneVariants);
+
+    staticMeshes.upload(dynamicBuffer.getBuffer());
+    GLuint prepassVao = 0;
+    if (depthPrepass) {
+        prepassVao = staticMeshes.createDepthVao(dynamicBuffer.getBuffer());
+        renderQueue.setDepthVao(staticMeshes.getVao(), prepassVao);
+    }
+    overdraw.init();
+    debugViews.init(programCache, !deferredShading);
+    ground.upload(programCache, lightingLibraries);
+    if (grassBlades) {
+        // Alpha-to-coverage depende de las muestras del destino en el que se va a dibujar
+        resolution.bindTarget();
+        grass.init(buildGrassDensity(modelsDir), [](float x, float z) { return std::max(ground.heightAt(x, z), terrain.heightAt(x, z)); },
+                   programCache, lightingLibraries);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    if (!deferredShading) {
+        litPrograms.push_back(ground.getProgram());
+        if (grassBlades)
+            litPrograms.push_back(grass.getProgram());
+    }
+    if (clusteredLighting)
+        lights.init(dynamicBuffer.getBuffer());
+    if (deferredShading) {
+        deferred.init(programCache);
+        grass.disableAlphaToCoverage();
+    }
 
-    glBindVertexArray(coneVAO);
+    // Proyectan sombra los árboles y la casa; la vaca y el OVNI se añaden cada fotograma y el cielo nunca
+    if (shadows) {
+        shadowMaps.init(programCache, staticMeshes, dynamicBuffer.getBuffer());
+        shadowMaps.setMoonDirection(moonDirection, moonShadowStrength);
+        for (const Object& object : objects)
+            if (object.getModel() == &models[0] || object.getModel() == &models[1])
+                object.addToShadows(shadowMaps);
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, coneVBO);
-    glBufferData(GL_ARRAY_BUFFER, coneVertices.size() * sizeof(float), &coneVertices[0], GL_STATIC_DRAW);
+    // Oclusores para la rasterización por software: la casa (y el terreno)
+    std::vector<Object> occluders;
+    for (const Object& object : objects)
+        if (object.getModel() == &models[1])
+            occluders.push_back(object);
+
+    // Los árboles pasan a la GPU; el resto (la vaca y el OVNI siguen al final) a la cola.
+    // gpuObjects se guarda para el streaming de texturas, las vistas de depuración y la referencia.
+    std::vector<Object> gpuObjects;
+    if (gpuCulling) {
+        std::vector<Object> remaining;
+        for (const Object& object : objects) {
+            if (drawnOnGpu(object)) {
+                object.addToCuller(gpuCuller);
+                gpuObjects.push_back(object);
+                if (treeImpostors && object.getModel() == &models[0])
+                    object.addToImpostors(treeImpostor);
+            }
+            else
+                remaining.push_back(object);
+        }
+        objects.swap(remaining);
+        if (treeImpostors) {
+            gpuCuller.setLodFade(models[0].getRange(), impostorFade);
+            treeImpostor.bake(programCache, staticMeshes, models[0].getRange(), models[0].getSoftTexture(), models[0].getBoundsCenter(), models[0].getBoundsRadius());
+            treeImpostor.setFade(impostorFade);
+        }
+        gpuCuller.upload(programCache, staticMeshes);
+    }
+    if (occlusionCulling)
+        hiZ.init(programCache, (int)WINDOW_WIDTH, (int)WINDOW_HEIGHT);
+    if (occlusionCulling && softwareOcclusion)
+        occluderRaster.init((int)WINDOW_WIDTH / softwareOcclusionDivisor, (int)WINDOW_HEIGHT / softwareOcclusionDivisor, false);
+    unsigned occludedObjects = 0, testedObjects = 0;
+    size_t particlesDrawn = 0;
+    std::vector<char> objectOccluded(objects.size(), 0);
+    unsigned groundNodes = 0, groundTriangles = 0, grassBladesDrawn = 0, impostorsDrawn = 0, shadowCasters = 0, lightsAssigned = 0;
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, coneEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, coneIndices.size() * sizeof(unsigned int), &coneIndices[0], GL_STATIC_DRAW);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // Habilitar blending para transparencia
+    glClearColor(0.05f, 0.05f, 0.2f, 1.0f);
+	time_laser += 0.05f; // Ajusta la velocidad del movimiento del láser aquí
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    // Configuración inicial de la cámara
+    camera = new Camera(glm::vec3(120.0f, 20.0f, 120.0f), glm::vec3(-50.0f, 10.0f, 0.0f), glm::radians(45.0f), WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 1000.0f);
+    renderQueue.setDepthRange(1000.0f);
+    forwardQueue.setDepthRange(1000.0f);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    float ufoRotationAngle = 0.0f;
+    float ufoPositionY = 50.0f;
+    float ufoPositionX = -50.0f;
+    float ufoScale = 1.0f;
+    float cowPositionOffsetY = 5.0f;
+    float cowScale = 1.2f;
+    float cowRotationAngle = 0.0f;
+    bool ufoDescending = true;
+    bool ufoMovingRight = false;
+    bool cowAscending = false;
+    bool cowRotating = false;
+    bool cowAbducted = false; // Variable para controlar si la vaca ha sido completamente abducida
+    bool ufoRetreating = false; // Variable para controlar el retiro del UFO
+    bool ufoExiting = false; // Variable para controlar la salida del OVNI
+    bool cameraStopped = false; // Variable para controlar si la cámara se detiene
 
-    // Relative Path
-    std::filesystem::path p = std::filesystem::current_path();
-    int levels_path = 1;
-    std::filesystem::path p_current;
-    p_current = p.parent_path();
+    glm::vec3 objectColor(1.0f, 1.0f, 0.0f);
 
-    for (int i = 0; i < levels_path; i++)
+    // Bucle de renderizado
+    double lastFrameTime = glfwGetTime();
+    while (!glfwWindowShouldClose(window))
     {
-        p_current = p_current.parent_path();
-    }
-
-    std::string vs_path, fs_path;
-
-    std::stringstream ss;
-    ss << std::quoted(p_current.string());
-    std::string out;
-    ss >> std::quoted(out);
-
-    std::cout << "\nCurrent path: " << out << "\n";
+        // Las partículas avanzan con el tiempo real; lo demás, por fotograma
+        double frameTime = glfwGetTime();
+        float frameSeconds = std::min((float)(frameTime - lastFrameTime), 0.05f);
+        lastFrameTime = frameTime;
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glClearColor(0.1f, 0.12f, 0.1f, 1.0f);
+        dynamicBuffer.beginFrame();
+        resolution.beginFrame();
+        glm::ivec2 renderSize = resolution.isEnabled() ? resolution.getRenderSize() : glm::ivec2((int)WINDOW_WIDTH, (int)WINDOW_HEIGHT);
+        camera->beginFrame(taa.nextJitter(renderSize));
+        if (shaderHotReload) {
+            const std::vector<ProgramSwap>& swaps = programCache.update();
+            sceneShaders.applySwaps(swaps);
+            deferred.applySwaps(swaps);
+            ground.applySwaps(swaps);
+            grass.applySwaps(swaps);
+            shadowMaps.applySwaps(swaps);
+            gpuCuller.applySwaps(swaps);
+            treeImpostor.applySwaps(swaps);
+            hiZ.applySwaps(swaps);
+            for (const ProgramSwap& swap : swaps)
+                std::replace(litPrograms.begin(), litPrograms.end(), swap.oldProgram, swap.newProgram);
+        }
 
-    // Cargar modelos
-    std::vector<Model> models;
-    models.push_back(Model(out + "\\glfw-master\\OwnProjects\\Project_01\\modelos\\tree_in_OBJ.obj"));
-    models.push_back(Model(out + "\\glfw-master\\OwnProjects\\Project_01\\modelos\\002_obj.obj"));
-    models.push_back(Model(out + "\\glfw-master\\OwnProjects\\Project_01\\modelos\\10438_Circular_Grass_Patch_v1_iterations-2.obj"));
-    
-    models.push_back(Model(out + "\\glfw-master\\OwnProjects\\Project_01\\modelos\\cowTM08New00RTime02.obj"));
-    models.push_back(Model(out + "\\glfw-master\\OwnProjects\\Project_01\\modelos\\Low_poly_UFO.obj"));
-    models.push_back(Model(out + "\\glfw-master\\OwnProjects\\Project_01\\modelos\\10438_Circular_Grass_Patch_v1_iterations-1.obj"));
-    std::vector<Object> objects;
+        // Actualizar rotación del OVNI
+        ufoRotationAngle += 0.03f;
+        if (ufoRotationAngle > 360.0f)
+            ufoRotationAngle -= 360.0f;
 
+        // Actualizar posición del OVNI
+        if (ufoDescending) {
+            ufoPositionY -= 0.7f;
+            if (ufoPositionY <= 30.0f) {
+                ufoDescending = false;
+                ufoMovingRight = true;
+            }
+        }
 
+        if (ufoMovingRight) {
+            ufoPositionX += 0.5f;
+            if (ufoPositionX >= 0.0f) {
+                ufoMovingRight = false;
+                cowAscending = true;
+            }
+        }
 
-    float treeStartX = -250.0f; // Ajusta el inicio en X para que los árboles estén más lejos en la dirección de la vista de la cámara
+        // Actualizar posición y escala de la vaca
+        if (cowAscending) {
+            cowPositionOffsetY += 0.7f; // Incrementar la velocidad de ascenso
+            cowScale -= 0.025f; // Reducir la velocidad de cambio de escala
+            if (cowScale <= 0.0f) {
+                cowScale = 0.0f;
+                cowAscending = false;
+                cowAbducted = true; // Indicar que la vaca ha sido completamente abducida
+                ufoRetreating = true; // Activar el retiro del UFO
+            }
+            // Comenzar la rotación de la vaca cuando empiece a ascender
+            if (cowPositionOffsetY >= 6.0f && !cowRotating) {
+                cowRotating = true;
+            }
+        }
+
+        if (cowRotating) {
+            cowRotationAngle += 0.05f; // Velocidad de rotación de la vaca
+            if (cowRotationAngle > glm::radians(180.0f)) {
+                cowRotationAngle = 0.0f;
+                cowRotating = false;
+            }
+        }
+
+        // Lógica de retiro del UFO
+        if (ufoRetreating) {
+            ufoPositionY += 0.15f; // Incrementa la posición Y del UFO para que se retire
+            if (ufoPositionY >= 70.0f) { // Verifica si el UFO ha salido de la escena
+                ufoRetreating = false; // Detén el movimiento del UFO cuando esté fuera de la escena
+                ufoExiting = true; // Activar la salida del OVNI hacia la izquierda
+            }
+        }
+
+        // Lógica de salida del OVNI hacia la izquierda y reducción de tamaño
+        if (ufoExiting) {
+            ufoPositionX -= 0.05f; // Mover el OVNI hacia la izquierda
+            ufoScale -= 0.008f; // Reducir el tamaño del OVNI
+            if (ufoScale <= 0.0f) {
+                ufoScale = 0.0f;
+                ufoExiting = false; // Detener la salida del OVNI cuando desaparezca
+                cameraStopped = true; // Detener la cámara cuando el OVNI desaparezca
+            }
+        }
+
+        // Las matrices del OVNI y la vaca en un trabajo; a la vez, el suelo y los
+        // impostores eligen su nivel de detalle (sus datos se suben más abajo)
+        JobCounter animated, lodSelected, particlesSimulated;
+        jobs.run("animacion", [&] {
+            glm::mat4 ufoModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(ufoPositionX, ufoPositionY, 50.0f));
+            ufoModelMatrix = glm::rotate(ufoModelMatrix, ufoRotationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+            ufoModelMatrix = glm::scale(ufoModelMatrix, glm::vec3(ufoScale));
+            objects[objects.size() - 1].updateTransformation(ufoModelMatrix);
+
+            glm::mat4 cowModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, cowPositionOffsetY, 50.0f));
+            cowModelMatrix = glm::scale(cowModelMatrix, glm::vec3(cowScale));
+            if (cowRotating) {
+                cowModelMatrix = glm::rotate(cowModelMatrix, cowRotationAngle, glm::vec3(1.0f, 0.0f, 0.0f));
+            }
+            objects[objects.size() - 2].updateTransformation(cowModelMatrix);
+        }, &animated);
+
+        glm::mat4 viewProj = camera->getProjMatrix() * camera->getViewMatrix();
+        jobs.run("lod_suelo", [&] { ground.selectNodes(camera->getPosition(), viewProj); }, &lodSelected);
+        if (gpuCulling && treeImpostors)
+            jobs.run("lod_impostores", [&] { treeImpostor.select(camera->getPosition(), viewProj); }, &lodSelected);
+
+        // // Actualizar la posición de la cámara
+        // camera->updateCameraPosition(ufoPositionX, ufoPositionY, 50.0f, cowPositionOffsetY, cowAscending, cowAbducted, ufoRetreating, cameraStopped);
+		
+		bool coneActive = !ufoDescending && !cowAbducted;
+
+        // Con el rayo encendido, chispas alrededor de la vaca y polvo donde el haz toca
+        // el suelo; nacen donde ya está la vaca, así que esperan a la animación
+        if (beamParticles)
+            jobs.run("particulas", [&] {
+                if (coneActive) {
+                    float groundY = std::max(ground.heightAt(ufoPositionX, 50.0f), terrain.heightAt(ufoPositionX, 50.0f));
+                    particles.spawn(sparkleEmitter(objects[objects.size() - 2].worldCenter(), coneRadius), (unsigned)(sparkleRate * frameSeconds));
+                    particles.spawn(dustEmitter(glm::vec3(ufoPositionX, groundY, 50.0f), coneRadius), (unsigned)(dustRate * frameSeconds));
+                }
+                particles.update(frameSeconds);
+            }, &particlesSimulated, &animated);
+        jobs.wait(animated);
+
+        // Pedir más o menos detalle de textura según el tamaño en pantalla
+        if (textureStreaming) {
+            textureStreamer.beginFrame();
+            for (size_t i = 0; i < objects.size(); ++i)
+                objects[i].noteTextureUsage(textureStreamer, camera->getViewMatrix(), camera->getProjMatrix(), (float)renderSize.y);
+            // Las instancias en la GPU, igual: por su esfera y su distancia a la cámara
+            if (gpuCulling)
+                for (const Object& object : gpuObjects)
+                    object.noteTextureUsage(textureStreamer, camera->getViewMatrix(), camera->getProjMatrix(), (float)renderSize.y);
+            textureStreamer.noteUsage(ground.getTexture(), ground.textureFootprint(camera->getPosition(), camera->getProjMatrix(), (float)renderSize.y));
+            textureStreamer.update();
+        }
+
+
+        // Sombras: la vaca tapa el foco, el OVNI (de donde sale) solo la luna
+        if (shadows) {
+            objects[objects.size() - 2].castShadow(shadowMaps, true);
+            objects[objects.size() - 1].castShadow(shadowMaps, false);
+            if (coneActive)
+                shadowMaps.setSpot(glm::vec3(ufoPositionX, ufoPositionY + coneHeight / 2.0f, 50.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+                                   std::atan(coneRadius / coneHeight), 2.0f * coneHeight, objectColor);
+            else
+                shadowMaps.disableSpot();
+            shadowMaps.update(camera->getViewMatrix(), camera->getProjMatrix(), dynamicBuffer);
+            shadowCasters += shadowMaps.getCasterCount();
+        }
+
+        // Luces del OVNI: las de posición giran con él y cambian de color en cadena;
+        // con el cono encendido, otras bajan por el rayo
+        if (clusteredLighting) {
+            float ufoRadius = objects[objects.size() - 1].worldRadius();
+            for (int i = 0; i < ufoRunningLights && ufoRadius > 0.0f; ++i) {
+                float angle = ufoRotationAngle + 2.0f * 3.14159265359f * i / ufoRunningLights;
+                float chase = 0.5f + 0.5f * std::sin((float)glfwGetTime() * 6.0f - i * 0.8f);
+                glm::vec3 color = (i % 3 == 0 ? glm::vec3(1.0f, 0.2f, 0.1f) : i % 3 == 1 ? glm::vec3(0.2f, 1.0f, 0.3f) : glm::vec3(0.3f, 0.4f, 1.0f)) * (0.3f + 1.2f * chase);
+                lights.addLight(glm::vec3(ufoPositionX + ufoRadius * 0.8f * std::cos(angle), ufoPositionY, 50.0f + ufoRadius * 0.8f * std::sin(angle)), 25.0f, color);
+            }
+            if (coneActive)
+                for (int i = 0; i < beamLights; ++i) {
+                    float height = ufoPositionY + coneHeight / 2.0f - coneHeight * (i + 0.5f) / beamLights;
+                    lights.addLight(glm::vec3(ufoPositionX, height, 50.0f), 15.0f, objectColor * 0.4f);
+                }
+            lights.update(camera->getViewMatrix(), camera->getProjMatrix(), glm::vec2(renderSize), dynamicBuffer);
+            lightsAssigned += lights.getIndexCount();
+        }
+        for (GLuint program : litPrograms) {
+            shadowMaps.bindReceiver(program);
+            lights.bindReceiver(program);
+        }
+
+        unsigned occludedThisFrame = 0;
+        if (occlusionCulling && softwareOcclusion) {
+            occluderRaster.setViewProj(viewProj);
+            occluderRaster.clear();
+            for (const Object& occluder : occluders)
+                occluder.rasterize(occluderRaster, false);
+            terrain.rasterize(occluderRaster, camera->getPosition(), nullptr);
+            occluderRaster.render();
+            hiZ.setCpuDepth(occluderRaster.getDepth(), glm::ivec2(occluderRaster.getWidth(), occluderRaster.getHeight()), viewProj);
+        }
+        else if (occlusionCulling)
+            hiZ.beginFrame();
+
+        // La oclusión de los objetos en paralelo; la cola se llena después, en orden
+        JobCounter culled;
+        if (occlusionCulling)
+            jobs.parallelFor("oclusion", objects.size(), 8, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                    objectOccluded[i] = hiZ.isOccluded(objects[i].worldCenter(), objects[i].worldRadius());
+            }, &culled);
+        jobs.wait(culled);
+        for (size_t i = 0; i < objects.size(); ++i)
+        {
+            bool occluded = objectOccluded[i] != 0;
+            if (debugViews.getView() == DEBUG_VIEW_CULLED)
+                debugViews.addSphereBox(objects[i].worldCenter(), objects[i].worldRadius(), occluded ? glm::vec3(1.0f, 0.1f, 0.1f) : glm::vec3(0.1f, 1.0f, 0.1f));
+            if (occluded) {
+                ++occludedThisFrame;
+                continue;
+            }
+            unsigned features = sceneFeatures(objects[i].getShaderFeatures() | batchedFeatures);
+            objects[i].submit(queueFor(features), sceneShaders.get(features), camera->getPosition(), depthProgramFor(features));
+        }
+        unsigned terrainFeatures = sceneFeatures(terrainShaderFeatures | batchedFeatures);
+        terrain.submit(renderQueue, sceneShaders.get(terrainFeatures), camera->getPosition(), depthProgramFor(terrainFeatures));
+        jobs.wait(lodSelected);
+        ground.upload(&dynamicBuffer);
+        groundNodes += (unsigned)ground.getSelectedCount();
+        groundTriangles += ground.getTriangleCount();
+        if (grassBlades) {
+            grass.update(camera->getPosition(), viewProj, dynamicBuffer);
+            grassBladesDrawn += grass.getBladeCount();
+        }
+        if (gpuCulling && treeImpostors) {
+            treeImpostor.upload(dynamicBuffer);
+            impostorsDrawn += (unsigned)treeImpostor.getVisibleCount();
+        }
+        // La lista de instancias también se escribe con trabajos, directamente en el búfer
+        jobs.wait(particlesSimulated);
+        if (beamParticles) {
+            particleRenderer.upload(particles);
+            particlesDrawn += particleRenderer.getInstanceCount();
+        }
+        occludedObjects += occludedThisFrame;
+        testedObjects += (unsigned)objects.size();
+
+        // Los árboles y el pasto los descarta la GPU: para la vista se prueban
+        // aquí contra la misma pirámide
+        if (debugViews.getView() == DEBUG_VIEW_CULLED)
+            for (const Object& object : gpuObjects) {
+                bool occluded = occlusionCulling && hiZ.isOccluded(object.worldCenter(), object.worldRadius());
+                debugViews.addSphereBox(object.worldCenter(), object.worldRadius(), occluded ? glm::vec3(1.0f, 0.1f, 0.1f) : glm::vec3(0.1f, 1.0f, 0.1f));
+            }
+        if (debugViews.getView() == DEBUG_VIEW_LOD)
+            addLodBoxes(debugViews, gpuObjects, &models[0], camera->getPosition());
+		
+		if (!cowAscending && !cowAbducted && !coneActive) {
+			Beam laser;
+			laser.start = glm::vec3(ufoPositionX, ufoPositionY + 10.0f, 50.0f); // Punto de inicio en el OVNI
+			laser.end = glm::vec3(ufoPositionX + 10.0f * cos(time_laser), ufoPositionY - coneHeight, 50.0f + 10.0f * sin(time_laser)); // Punto de finalización en el suelo en movimiento circular
+			laser.startWidth = laser.endWidth = 0.8f; // Cambia este valor para ajustar el grosor del láser
+			laser.color = glm::vec4(1.0f, 0.0f, 0.0f, 0.9f);
+			laser.core = 0.8f;
+			beams.add(laser);
+		}
+
+        // El haz una vez que el OVNI ha terminado de bajar y antes de que la vaca sea completamente abducida:
+        // un cono desde el foco hasta el suelo con bandas que suben hacia el OVNI
+        if (coneActive) {
+            Beam tractor;
+            tractor.start = glm::vec3(ufoPositionX, ufoPositionY + coneHeight / 2.0f, 50.0f);
+            tractor.end = glm::vec3(ufoPositionX, ufoPositionY - coneHeight / 2.0f, 50.0f);
+            tractor.startWidth = 0.0f;
+            tractor.endWidth = 2.0f * coneRadius;
+            tractor.color = glm::vec4(objectColor, 0.35f);
+            tractor.bands = 0.15f;
+            tractor.speed = -8.0f;
+            beams.add(tractor);
+        }
+
+        // Uniforms por fotograma de todas las variantes ya usadas, incluidas las
+        // compiladas en este fotograma; "model" lo fija la cola
+        GLuint cullerProgram = gpuCulling ? sceneShaders.get(cullerShaderFeatures) : 0;
+        GLuint cullerDepthProgram = gpuCulling && depthPrepass ? sceneShaders.get(ShaderPermutations::depthOnly(cullerShaderFeatures)) : 0;
+        for (const ShaderVariant& variant : sceneShaders.getVariants()) {
+            glUseProgram(variant.program);
+            glUniformMatrix4fv(glGetUniformLocation(variant.program, "view"), 1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
+            glUniformMatrix4fv(glGetUniformLocation(variant.program, "projection"), 1, GL_FALSE, glm::value_ptr(camera->getProjMatrix()));
+            if (variant.features & SHADER_INSTANCED)
+                glUniform3fv(glGetUniformLocation(variant.program, "eye"), 1, glm::value_ptr(camera->getPosition()));
+            if (variant.features & SHADER_GBUFFER)
+                continue;
+            if (variant.features & SHADER_SHADOWED)
+                shadowMaps.bindReceiver(variant.program);
+            if (variant.features & SHADER_LIT)
+                lights.bindReceiver(variant.program);
+        }
+
+        // Las sombras van antes que cualquier receptor, incluidos los árboles de la GPU
+        debugViews.upload(dynamicBuffer);
+        dynamicBuffer.commit();
+        shadowMaps.render();
+        resolution.bindTarget();
+
+        if (deferredShading)
+            deferred.beginGeometry();
+        if (gpuCulling) {
+            if (occlusionCulling && hiZ.isReady())
+                gpuCuller.setOcclusion(hiZ.getTexture(), hiZ.getSize(), hiZ.getLevelCount(), hiZ.getViewProj());
+            gpuCuller.cull(viewProj, camera->getPosition());
+        }
+
+        // Pasada previa: árboles y opacos de la cola solo en profundidad; el pasto
+        // y el suelo que quedan detrás ya no pasan la prueba
+        if (depthPrepass) {
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            if (gpuCulling)
+                gpuCuller.draw(cullerDepthProgram);
+            renderQueue.flushDepth();
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        }
+
+        overdraw.begin();
+        debugViews.beginScene();
+        if (gpuCulling) {
+            if (depthPrepass) {
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            gpuCuller.draw(cullerProgram);
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+
+        // Opacos agrupados por estado y luego transparentes de atrás hacia delante
+        ground.draw(dynamicBuffer, camera->getViewMatrix(), camera->getProjMatrix());
+        if (gpuCulling && treeImpostors && !deferredShading)
+            treeImpostor.draw(dynamicBuffer, camera->getViewMatrix(), camera->getProjMatrix(), camera->getPosition());
+        if (grassBlades)
+            grass.draw(dynamicBuffer, camera->getViewMatrix(), camera->getProjMatrix(), camera->getPosition(), (float)glfwGetTime());
+        renderQueue.flush();
+        overdraw.end();
+
+        // Diferido: las luces sobre el G-buffer y después lo que no lo escribe
+        if (deferredShading) {
+            deferred.shade(camera->getViewMatrix(), camera->getProjMatrix(), shadowMaps, lights);
+            if (gpuCulling && treeImpostors)
+                treeImpostor.draw(dynamicBuffer, camera->getViewMatrix(), camera->getProjMatrix(), camera->getPosition());
+            forwardQueue.flush();
+        }
+        beams.draw(viewProj, camera->getPosition(), (float)glfwGetTime());
+        particleRenderer.draw(camera->getViewMatrix(), camera->getProjMatrix());
+
+        // La vaca y el OVNI se mueven por su cuenta; lo demás se reproyecta con la profundidad
+        if (taa.isEnabled()) {
+            taa.beginMotion(camera->getPreviousViewProj(), camera->getUnjitteredViewProj(), viewProj, renderSize, staticMeshes.getVao());
+            objects[objects.size() - 2].drawMotion(taa);
+            objects[objects.size() - 1].drawMotion(taa);
+            taa.endMotion();
+        }
+        debugViews.endScene(viewProj);
+
+        // Los transparentes no escriben profundidad: ya se puede construir la pirámide
+        if (occlusionCulling)
+            hiZ.build(viewProj);
+        resolution.present(taa.resolve(resolution.getColorTexture()));
+
+        // F12: el fotograma de OpenGL contra la referencia por software
+        if (referenceRequested) {
+            referenceRequested = false;
+            std::vector<Object> sceneObjects = gpuObjects;
+            sceneObjects.insert(sceneObjects.end(), objects.begin(), objects.end());
+            compareWithReference(sceneObjects, loadSoftTexture(groundTexturePath, groundSoftTexture, groundSoftTextureLoaded), viewProj);
+        }
+		
+		// Actualizar la posición de la cámara
+        camera->updateCameraPosition(ufoPositionX, ufoPositionY, 50.0f, cowPositionOffsetY, cowAscending, cowAbducted, ufoRetreating, cameraStopped);
+
+        dynamicBuffer.endFrame();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    // Resumen de cambios de estado de la cola de dibujo
+    const RenderStats& stats = renderQueue.getTotalStats();
+    unsigned frames = renderQueue.getFrameCount() > 0 ? renderQueue.getFrameCount() : 1;
+    std::cout << "Dibujos por fotograma: " << stats.draws / frames << " en " << stats.apiCalls / frames << " llamadas"
+              << " (" << stats.depthDraws / frames << " de la pasada previa)"
+              << "\nCambios de programa: " << stats.programChanges / frames << " (evitados " << stats.programChangesAvoided / frames << ")"
+              << "\nCambios de textura: " << stats.textureChanges / frames << " (evitados " << stats.textureChangesAvoided / frames << ")"
+              << "\nCambios de VAO: " << stats.vaoChanges / frames << " (evitados " << stats.vaoChangesAvoided / frames << ")" << std::endl;
+    if (deferredShading)
+        std::cout << "Diferido: G-buffer de " << deferred.getSize().x << "x" << deferred.getSize().y << ", "
+                  << forwardQueue.getTotalStats().draws / frames << " dibujos forward por fotograma" << std::endl;
+    if (resolution.isEnabled())
+        std::cout << "Resolución dinámica: escala media " << resolution.getAverageScale() << ", " << resolution.getAverageMilliseconds()
+                  << " ms de GPU en las pasadas escaladas (objetivo " << resolution.getTargetMilliseconds() << " ms)" << std::endl;
+    std::cout << "Sobredibujo: " << overdraw.getAverage() << " fragmentos sombreados por píxel" << std::endl;
+    if (occlusionCulling)
+        std::cout << "Objetos ocultos por oclusión: " << occludedObjects / frames << " de " << testedObjects / frames << " por fotograma" << std::endl;
+    std::cout << "Suelo: " << groundNodes / frames << " nodos, " << groundTriangles / frames << " triangulos por fotograma" << std::endl;
+    if (grassBlades)
+        std::cout << "Pasto: " << grassBladesDrawn / frames << " briznas por fotograma" << std::endl;
+    if (gpuCulling && treeImpostors)
+        std::cout << "Impostores: " << impostorsDrawn / frames << " por fotograma" << std::endl;
+    if (shadows)
+        std::cout << "Sombras: " << shadowCasters / frames << " objetos por fotograma en "
+                  << shadowMaps.getGpuMilliseconds() << " ms de GPU" << std::endl;
+    const ProgramCacheStats& programStats = programCache.getStats();
+    std::cout << "Shaders: " << sceneShaders.getVariants().size() << " variantes de la escena, " << programStats.programs << " programas (" << programStats.binaryHits << " de la caché en disco), "
+              << programStats.shadersCompiled << " shaders compilados, " << programStats.shadersReused << " reutilizados, "
+              << programStats.milliseconds << " ms" << std::endl;
+    if (beamParticles)
+        std::cout << "Partículas: " << particlesDrawn / frames << " por fotograma" << std::endl;
+    std::cout << "Trabajos: " << jobs.getThreadCount() << " hilos, " << jobs.getSteals() / frames << " robados por fotograma";
+    for (const JobProfile& profile : jobs.getProfile())
+        std::cout << "\n  " << profile.name << ": " << profile.jobs / frames << " por fotograma, " << profile.milliseconds / frames << " ms";
+    std::cout << std::endl;
+    if (clusteredLighting)
+        std::cout << "Luces: " << lights.getLightCount() << " luces, " << lightsAssigned / frames << " entradas de cluster por fotograma" << std::endl;
+
+    grass.shutdown();
+    shadowMaps.destroy();
+    lights.destroy();
+    treeImpostor.destroy();
+    ground.destroy();
+    hiZ.destroy();
+    gpuCuller.destroy();
+    deferred.destroy();
+    overdraw.destroy();
+    debugViews.destroy();
+    beams.destroy();
+    particleRenderer.destroy();
+    taa.destroy();
+    resolution.destroy();
+    if (prepassVao)
+        glDeleteVertexArrays(1, &prepassVao);
+    jobs.shutdown();
+    programCache.destroy();
+    dynamicBuffer.destroy();
+    textureStreamer.shutdown();
+    glfwTerminate();
+    return 0;
+}
+
+void renderSoftware(SoftRasterizer& raster, const std::vector<Object>& objects, const SoftTexture* terrainTexture, const glm::mat4& viewProj)
+{
+    raster.setViewProj(viewProj);
+    raster.clear(glm::vec4(0.1f, 0.12f, 0.1f, 1.0f));
+    for (const Object& object : objects)
+        object.rasterize(raster, true);
+    terrain.rasterize(raster, camera->getPosition(), terrainTexture);
+    ground.select(camera->getPosition(), viewProj, nullptr);
+    ground.rasterize(raster, terrainTexture);
+    raster.render();
+}
+
+// Primer fotograma de la escena a media resolución, solo con la CPU
+int renderReferenceOffline(const std::string& modelsDir, const std::string& outputPath)
+{
+    headless = true;
+    std::vector<Model> models;
+    std::vector<Object> objects;
+    buildScene(models, objects, modelsDir);
+
+    camera = new Camera(glm::vec3(120.0f, 20.0f, 120.0f), glm::vec3(-50.0f, 10.0f, 0.0f), glm::radians(45.0f), WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 1000.0f);
+    SoftRasterizer raster;
+    raster.init((int)WINDOW_WIDTH / 2, (int)WINDOW_HEIGHT / 2, true);
+
+    auto start = std::chrono::steady_clock::now();
+    renderSoftware(raster, objects, loadSoftTexture(groundTexturePath, groundSoftTexture, groundSoftTextureLoaded), camera->getProjMatrix() * camera->getViewMatrix());
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Referencia: " << raster.getTriangleCount() << " triangulos en " << milliseconds << " ms" << std::endl;
+
+    if (!writeTga(outputPath, raster.getWidth(), raster.getHeight(), raster.getColor())) {
+        std::cerr << "Error al escribir " << outputPath << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Chispas que nacen alrededor de la vaca y suben con ella por el rayo
+ParticleEmitter sparkleEmitter(const glm::vec3& center, float beamRadius)
+{
+    ParticleEmitter emitter;
+    emitter.position = center;
+    emitter.spread = glm::vec3(beamRadius * 0.5f, 2.0f, beamRadius * 0.5f);
+    emitter.velocity = glm::vec3(0.0f, 6.0f, 0.0f);
+    emitter.velocitySpread = glm::vec3(1.5f, 2.0f, 1.5f);
+    emitter.lift = 4.0f;
+    emitter.drag = 0.5f;
+    emitter.life = 2.0f;
+    emitter.size = 0.3f;
+    emitter.color = glm::vec4(1.0f, 0.95f, 0.6f, 1.0f);
+    emitter.additive = true;
+    return emitter;
+}
+
+// Polvo que levanta el rayo donde toca el suelo y que vuelve a caer
+ParticleEmitter dustEmitter(const glm::vec3& base, float beamRadius)
+{
+    ParticleEmitter emitter;
+    emitter.position = base + glm::vec3(0.0f, 0.3f, 0.0f);
+    emitter.spread = glm::vec3(beamRadius, 0.2f, beamRadius);
+    emitter.velocity = glm::vec3(0.0f, 2.5f, 0.0f);
+    emitter.velocitySpread = glm::vec3(3.0f, 1.5f, 3.0f);
+    emitter.lift = -4.0f;
+    emitter.drag = 1.5f;
+    emitter.life = 1.5f;
+    emitter.size = 0.8f;
+    emitter.color = glm::vec4(0.45f, 0.38f, 0.3f, 0.5f);
+    return emitter;
+}
+
+// El rayo con el sistema lleno: lo que muere cada fotograma vuelve a nacer.
+// Mide la simulación y la lista de instancias sin GPU
+int runParticlesOffline(unsigned count)
+{
+    jobs.init();
+    ParticleSystem system;
+    system.init(jobs, count);
+    std::vector<ParticleInstance> instances(count);
+    ParticleEmitter sparkles = sparkleEmitter(glm::vec3(0.0f, 10.0f, 50.0f), coneRadius);
+    ParticleEmitter dust = dustEmitter(glm::vec3(0.0f, 0.0f, 50.0f), coneRadius);
+
+    const float dt = 1.0f / 60.0f;
+    const int warmUpFrames = 240, measuredFrames = 120;
+    double spawnMilliseconds = 0.0, updateMilliseconds = 0.0, writeMilliseconds = 0.0;
+    size_t written = 0;
+    for (int frame = 0; frame < warmUpFrames + measuredFrames; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        unsigned missing = count - (unsigned)system.getLiveCount();
+        system.spawn(sparkles, missing / 2);
+        system.spawn(dust, missing - missing / 2);
+        auto spawned = std::chrono::steady_clock::now();
+        system.update(dt);
+        auto updated = std::chrono::steady_clock::now();
+        written = system.write(instances.data(), instances.size());
+        auto end = std::chrono::steady_clock::now();
+        if (frame >= warmUpFrames) {
+            spawnMilliseconds += std::chrono::duration<double, std::milli>(spawned - start).count();
+            updateMilliseconds += std::chrono::duration<double, std::milli>(updated - spawned).count();
+            writeMilliseconds += std::chrono::duration<double, std::milli>(end - updated).count();
+        }
+    }
+    std::cout << "Partículas: " << written << " de " << count << " por fotograma; nacer " << spawnMilliseconds / measuredFrames
+              << " ms, integrar " << updateMilliseconds / measuredFrames << " ms, instancias " << writeMilliseconds / measuredFrames
+              << " ms en " << jobs.getThreadCount() << " hilos" << std::endl;
+    jobs.shutdown();
+    return 0;
+}
+
+// Las cajas de la vista lod: chunks del terreno, nodos del último select() del
+// suelo y árboles (0 malla, 1 fundido con el impostor, 2 impostor)
+void addLodBoxes(DebugViews& views, const std::vector<Object>& objects, const Model* treeModel, const glm::vec3& eye)
+{
+    auto addLevelBox = [&](const glm::vec3& low, const glm::vec3& high, int level) { views.addBox(low, high, DebugViews::levelColor(level)); };
+    terrain.forEachChunkLod(eye, addLevelBox);
+    ground.forEachSelectedNode(addLevelBox);
+    for (const Object& tree : objects) {
+        if (tree.getModel() != treeModel)
+            continue;
+        float distance = glm::length(tree.worldCenter() - eye);
+        int level = !treeImpostors || distance < impostorFade.x ? 0 : distance < impostorFade.y ? 1 : 2;
+        views.addSphereBox(tree.worldCenter(), tree.worldRadius(), DebugViews::levelColor(level));
+    }
+}
+
+// Una vista de depuración del primer fotograma a media resolución, solo con la
+// CPU: el recuento de SoftRasterizer o las cajas sobre la imagen de referencia
+int renderDebugViewOffline(const std::string& modelsDir, const std::string& viewName, const std::string& outputPath)
+{
+    DebugView view = DebugViews::parse(viewName);
+    if (view == DEBUG_VIEW_NONE) {
+        std::cerr << "Vista desconocida: " << viewName << " (sobredibujo, triangulos, lod o descartados)" << std::endl;
+        return 1;
+    }
+    headless = true;
+    std::vector<Model> models;
+    std::vector<Object> objects;
+    buildScene(models, objects, modelsDir);
+
+    camera = new Camera(glm::vec3(120.0f, 20.0f, 120.0f), glm::vec3(-50.0f, 10.0f, 0.0f), glm::radians(45.0f), WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 1000.0f);
+    glm::mat4 viewProj = camera->getProjMatrix() * camera->getViewMatrix();
+    SoftRasterizer raster;
+    raster.init((int)WINDOW_WIDTH / 2, (int)WINDOW_HEIGHT / 2, true);
+    raster.setCounters(view == DEBUG_VIEW_OVERDRAW || view == DEBUG_VIEW_TRIANGLES);
+    renderSoftware(raster, objects, loadSoftTexture(groundTexturePath, groundSoftTexture, groundSoftTextureLoaded), viewProj);
+
+    std::vector<uint32_t> image;
+    if (view == DEBUG_VIEW_OVERDRAW)
+        image = DebugViews::heatImage(raster.getFragmentCounts());
+    else if (view == DEBUG_VIEW_TRIANGLES)
+        image = DebugViews::heatImage(raster.getEdgeCounts());
+    else {
+        image = raster.getColor();
+        DebugViews views;
+        if (view == DEBUG_VIEW_LOD)
+            addLodBoxes(views, objects, &models[0], camera->getPosition());
+        else {
+            // Los mismos oclusores que softwareOcclusion
+            SoftRasterizer occluders;
+            occluders.init((int)WINDOW_WIDTH / softwareOcclusionDivisor, (int)WINDOW_HEIGHT / softwareOcclusionDivisor, false);
+            occluders.setViewProj(viewProj);
+            occluders.clear();
+            for (const Object& object : objects)
+                if (object.getModel() == &models[1])
+                    object.rasterize(occluders, false);
+            terrain.rasterize(occluders, camera->getPosition(), nullptr);
+            occluders.render();
+            hiZ.setCpuDepth(occluders.getDepth(), glm::ivec2(occluders.getWidth(), occluders.getHeight()), viewProj);
+            unsigned occluded = 0;
+            for (const Object& object : objects) {
+                bool hidden = hiZ.isOccluded(object.worldCenter(), object.worldRadius());
+                occluded += hidden ? 1 : 0;
+                views.addSphereBox(object.worldCenter(), object.worldRadius(), hidden ? glm::vec3(1.0f, 0.1f, 0.1f) : glm::vec3(0.1f, 1.0f, 0.1f));
+            }
+            std::cout << "Descartados por oclusión: " << occluded << " de " << objects.size() << std::endl;
+        }
+        views.drawLines(image, raster.getWidth(), raster.getHeight(), viewProj);
+    }
+
+    if (!writeTga(outputPath, raster.getWidth(), raster.getHeight(), image)) {
+        std::cerr << "Error al escribir " << outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "Vista " << debugViewNames[view] << ": " << outputPath << std::endl;
+    return 0;
+}
+
+// Escribe referencia_gl.tga y referencia_soft.tga a media resolución y su PSNR.
+// El láser y el cono (transparentes) y las sombras solo están en la de OpenGL.
+void compareWithReference(const std::vector<Object>& objects, const SoftTexture* terrainTexture, const glm::mat4& viewProj)
+{
+    int width = (int)WINDOW_WIDTH / 2, height = (int)WINDOW_HEIGHT / 2;
+    std::vector<uint32_t> full((int)WINDOW_WIDTH * (int)WINDOW_HEIGHT);
+    glReadPixels(0, 0, (int)WINDOW_WIDTH, (int)WINDOW_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, full.data());
+
+    // Media de cada bloque de 2x2
+    std::vector<uint32_t> gl(width * height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            uint32_t sum[3] = { 0, 0, 0 };
+            for (int k = 0; k < 4; ++k) {
+                uint32_t pixel = full[(y * 2 + k / 2) * (int)WINDOW_WIDTH + x * 2 + k % 2];
+                for (int c = 0; c < 3; ++c)
+                    sum[c] += (pixel >> (8 * c)) & 0xFF;
+            }
+            gl[y * width + x] = (sum[0] / 4) | ((sum[1] / 4) << 8) | ((sum[2] / 4) << 16) | 0xFF000000u;
+        }
+
+    SoftRasterizer raster;
+    raster.init(width, height, true);
+    renderSoftware(raster, objects, terrainTexture, viewProj);
+    std::vector<uint32_t> soft = raster.getColor();
+
+    double error = 0.0;
+    for (size_t i = 0; i < gl.size(); ++i)
+        for (int c = 0; c < 3; ++c) {
+            double difference = double((gl[i] >> (8 * c)) & 0xFF) - double((soft[i] >> (8 * c)) & 0xFF);
+            error += difference * difference;
+        }
+    error /= gl.size() * 3.0;
+    double psnr = error > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / error) : 99.0;
+
+    writeTga("referencia_gl.tga", width, height, gl);
+    writeTga("referencia_soft.tga", width, height, soft);
+    std::cout << "Referencia por software: PSNR " << psnr << " dB (" << raster.getTriangleCount() << " triangulos)" << std::endl;
+}
+
+// Modelos y objetos de la escena; fuera de las texturas no llama a OpenGL
+void buildScene(std::vector<Model>& models, std::vector<Object>& objects, const std::string& modelsDir)
+{
+    // Cargar modelos
+    models.push_back(Model(modelsDir + "tree_in_OBJ.obj"));
+    models.push_back(Model(modelsDir + "002_obj.obj"));
+    models.push_back(Model(modelsDir + "cowTM08New00RTime02.obj"));
+    models.push_back(Model(modelsDir + "Low_poly_UFO.obj"));
+    models.push_back(Model(modelsDir + "10438_Circular_Grass_Patch_v1_iterations-1.obj"));
+
+
+
+    float treeStartX = -250.0f; // Ajusta el inicio en X para que los árboles estén más lejos en la dirección de la vista de la cámara
     float treeStartZ = -200.0f; // Ajusta el inicio en Z para que los árboles estén en un área visible desde la cámara
     float treeSpacing = 100.0f; // Espaciado entre árboles
     int treeRows = 5; // Número de filas de árboles
@@ -592,7 +1594,7 @@ float skyHeight = 250.0f; // Altura sobre el suelo o la cámara
 float skyScale = 10.0f; // Escala del cielo, ajusta este valor según sea necesario para el tamaño deseado
 
 // Asumiendo que el modelo del cielo es el último que se agregó a la lista de modelos
-int skyModelIndex = 5; // Cambiar esto según el índice correcto del modelo de cielo en 'models'
+int skyModelIndex = 4; // Cambiar esto según el índice correcto del modelo de cielo en 'models'
 
 // Crear la matriz de transformación para el modelo de cielo
 glm::mat4 skyModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(skyStartX, skyHeight, skyStartZ));
@@ -607,34 +1609,48 @@ objects.push_back(
         skyModelMatrix
     )
 );
+// El cielo no recibe sombras ni luces: solo su textura
+objects.back().setShaderFeatures(SHADER_TEXTURED);
 
 
 
 
-    float grassStartX = -1500.0f; // Ajusta según el tamaño del escenario
-    float grassStartZ = -1500.0f; // Ajusta según el tamaño del escenario
-    float grassSpacing = 100.0f;
-    int grassRows = 20; // Número de filas de pasto
-    int grassCols = 20; // Número de columnas de pasto
+    // Antes el suelo eran 20x20 parches de pasto a y = -10 entre -1500 y 500; ahora un
+    // terreno CDLOD centrado en esa zona. El heightmap sale de modelos/heightmap.png
+    // (16 bits, de 0 a groundHeightScale) o, si no está, de una función que deja llana
+    // la zona de antes y levanta colinas a partir de ella.
+    float groundLevel = -10.0f;
+    glm::vec2 groundCenter(-550.0f, -550.0f);
+    float groundFlatHalfSize = 1000.0f;
+    glm::vec2 groundMin = groundCenter - glm::vec2(groundSize * 0.5f);
 
-    for (int i = 0; i < grassRows; ++i) {
-        for (int j = 0; j < grassCols; ++j) {
-            float grassX = grassStartX + i * grassSpacing;
-            float grassZ = grassStartZ + j * grassSpacing;
-            objects.push_back(
-                Object(&models[2],
-                    glm::rotate(
-                        glm::translate(
-                            glm::mat4x4(1.0f),
-                            glm::vec3(grassX, -10.0f, grassZ)
-                        ),
-                        glm::radians(-90.0f),
-                        glm::vec3(1.0f, 0.0f, 0.0f)
-                    )
-                )
-            );
+    std::vector<float> groundHeights;
+    int heightmapSize = 0, heightmapHeight = 0, heightmapChannels = 0;
+    stbi_us* heightmap = stbi_load_16((modelsDir + "heightmap.png").c_str(), &heightmapSize, &heightmapHeight, &heightmapChannels, 1);
+    if (heightmap && heightmapSize == heightmapHeight && heightmapSize > 1) {
+        for (int i = 0; i < heightmapSize * heightmapSize; ++i)
+            groundHeights.push_back(groundLevel + heightmap[i] / 65535.0f * groundHeightScale);
+    }
+    else {
+        heightmapSize = groundResolution;
+        float sampleSpacing = groundSize / (heightmapSize - 1);
+        for (int j = 0; j < heightmapSize; ++j) {
+            for (int i = 0; i < heightmapSize; ++i) {
+                float x = groundMin.x + i * sampleSpacing;
+                float z = groundMin.y + j * sampleSpacing;
+                float dx = std::max(std::abs(x - groundCenter.x) - groundFlatHalfSize, 0.0f);
+                float dz = std::max(std::abs(z - groundCenter.y) - groundFlatHalfSize, 0.0f);
+                float hills = 0.5f + 0.25f * glm::sin(x * 0.0021f) * glm::cos(z * 0.0017f) + 0.25f * glm::sin(x * 0.0053f + z * 0.0041f);
+                groundHeights.push_back(groundLevel + glm::smoothstep(0.0f, 1500.0f, glm::length(glm::vec2(dx, dz))) * hills * groundHeightScale);
+            }
         }
     }
+    if (heightmap)
+        stbi_image_free(heightmap);
+    ground.build(groundHeights, heightmapSize, groundMin, groundSize, groundLeafRange);
+    groundTexturePath = modelsDir + "10438_Circular_Grass_Patch_v1_Diffuse.jpg";
+    GLuint groundTexture = requestTexture(groundTexturePath);
+    ground.setTexture(groundTexture);
 
     // Primera montaña
     float mountainGrassStartX = -1200.0f; // Ajusta según la posición de la casa y la cámara
@@ -645,27 +1661,6 @@ objects.push_back(
     float mountainHeightScale = 50.0f; // Escala de altura para crear una montaña más alta
     float mountainBaseHeight = -20.0f; // Altura de inicio de las montañas, valor negativo para comenzar más abajo
 
-    for (int i = 0; i < mountainGrassRows; ++i) {
-        for (int j = 0; j < mountainGrassCols; ++j) {
-            float grassX = mountainGrassStartX + i * mountainGrassSpacing;
-            float grassZ = mountainGrassStartZ + j * mountainGrassSpacing;
-            float distanceFromCenter = glm::length(glm::vec2(grassX - mountainGrassStartX, grassZ - mountainGrassStartZ));
-            float grassY = glm::sin(glm::radians((float)distanceFromCenter / (float)(mountainGrassRows * mountainGrassSpacing) * 180.0f)) * mountainHeightScale + mountainBaseHeight;
-            objects.push_back(
-                Object(&models[2],
-                    glm::rotate(
-                        glm::translate(
-                            glm::mat4x4(1.0f),
-                            glm::vec3(grassX, grassY, grassZ)
-                        ),
-                        glm::radians(-90.0f),
-                        glm::vec3(1.0f, 0.0f, 0.0f)
-                    )
-                )
-            );
-        }
-    }
-
     // Segunda montaña
     float secondMountainGrassStartX2 = -1500.0f; // Ajusta según la posición de la casa y la cámara
     float secondMountainGrassStartZ2 = 0.0f; // Ajusta según la posición de la casa y la cámara
@@ -675,26 +1670,31 @@ objects.push_back(
     float secondMountainHeightScale2 = 40.0f; // Escala de altura para crear una montaña más alta
     float secondMountainBaseHeight2 = -20.0f; // Altura de inicio de las montañas, valor negativo para comenzar más abajo
 
-    for (int i = 0; i < secondMountainGrassRows2; ++i) {
-        for (int j = 0; j < secondMountainGrassCols2; ++j) {
-            float grassX = secondMountainGrassStartX2 + i * secondMountainGrassSpacing2;
-            float grassZ = secondMountainGrassStartZ2 + j * secondMountainGrassSpacing2;
-            float distanceFromCenter = glm::length(glm::vec2(grassX - secondMountainGrassStartX2, grassZ - secondMountainGrassStartZ2));
-            float grassY = glm::sin(glm::radians((float)distanceFromCenter / (float)(secondMountainGrassRows2 * secondMountainGrassSpacing2) * 180.0f)) * secondMountainHeightScale2 + secondMountainBaseHeight2;
-            objects.push_back(
-                Object(&models[2],
-                    glm::rotate(
-                        glm::translate(
-                            glm::mat4x4(1.0f),
-                            glm::vec3(grassX, grassY, grassZ)
-                        ),
-                        glm::radians(-90.0f),
-                        glm::vec3(1.0f, 0.0f, 0.0f)
-                    )
-                )
-            );
-        }
-    }
+    // Antes cada montaña eran filas x columnas de parches de pasto a la altura del seno
+    // de la distancia a su esquina; ahora esa misma función genera el terreno por chunks
+    auto mountainHeight = [=](float x, float z) {
+        float height = glm::min(mountainBaseHeight, secondMountainBaseHeight2); // bajo el suelo de pasto
+        auto hill = [&](float startX, float startZ, float spacing, int rows, int cols, float heightScale, float baseHeight) {
+            if (x < startX - spacing * 0.5f || z < startZ - spacing * 0.5f ||
+                x > startX + (rows - 0.5f) * spacing || z > startZ + (cols - 0.5f) * spacing)
+                return;
+            float distanceFromCenter = glm::length(glm::vec2(x - startX, z - startZ));
+            height = glm::max(height, glm::sin(glm::radians(distanceFromCenter / (float)(rows * spacing) * 180.0f)) * heightScale + baseHeight);
+        };
+        hill(mountainGrassStartX, mountainGrassStartZ, mountainGrassSpacing, mountainGrassRows, mountainGrassCols, mountainHeightScale, mountainBaseHeight);
+        hill(secondMountainGrassStartX2, secondMountainGrassStartZ2, secondMountainGrassSpacing2, secondMountainGrassRows2, secondMountainGrassCols2,
+             secondMountainHeightScale2, secondMountainBaseHeight2);
+        return height;
+    };
+    glm::vec2 terrainMin(glm::min(mountainGrassStartX, secondMountainGrassStartX2) - mountainGrassSpacing * 0.5f,
+                         glm::min(mountainGrassStartZ, secondMountainGrassStartZ2) - mountainGrassSpacing * 0.5f);
+    glm::vec2 terrainMax(glm::max(mountainGrassStartX + (mountainGrassRows - 0.5f) * mountainGrassSpacing,
+                                  secondMountainGrassStartX2 + (secondMountainGrassRows2 - 0.5f) * secondMountainGrassSpacing2),
+                         glm::max(mountainGrassStartZ + (mountainGrassCols - 0.5f) * mountainGrassSpacing,
+                                  secondMountainGrassStartZ2 + (secondMountainGrassCols2 - 0.5f) * secondMountainGrassSpacing2));
+    terrain.build(staticMeshes, terrainMin, terrainMax, terrainCellSize, mountainHeight);
+    terrain.setTexture(groundTexture);
+    std::cout << "Terreno: " << terrain.getChunkCount() << " chunks" << std::endl;
 
     // Agregar otros objetos (casa, vaca, OVNI)
     objects.push_back(
@@ -711,7 +1711,7 @@ objects.push_back(
 
     // Asegurarse de que la vaca y el OVNI sean los últimos objetos en la lista de `objects`
     objects.push_back(
-        Object(&models[3], // cow
+        Object(&models[2], // cow
             glm::scale(
                 glm::translate(
                     glm::mat4x4(1.2f),
@@ -723,7 +1723,7 @@ objects.push_back(
     );
 
     objects.push_back(
-        Object(&models[4], // UFO
+        Object(&models[3], // UFO
             glm::translate(
                 glm::scale(
                     glm::mat4x4(1.0f),
@@ -733,184 +1733,42 @@ objects.push_back(
             )
         )
     );
+}
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // Habilitar blending para transparencia
-    glClearColor(0.05f, 0.05f, 0.2f, 1.0f);
-	time_laser += 0.05f; // Ajusta la velocidad del movimiento del láser aquí
-
-    // Configuración inicial de la cámara
-    camera = new Camera(glm::vec3(120.0f, 20.0f, 120.0f), glm::vec3(-50.0f, 10.0f, 0.0f), glm::radians(45.0f), WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 1000.0f);
-
-    float ufoRotationAngle = 0.0f;
-    float ufoPositionY = 50.0f;
-    float ufoPositionX = -50.0f;
-    float ufoScale = 1.0f;
-    float cowPositionOffsetY = 5.0f;
-    float cowScale = 1.2f;
-    float cowRotationAngle = 0.0f;
-    bool ufoDescending = true;
-    bool ufoMovingRight = false;
-    bool cowAscending = false;
-    bool cowRotating = false;
-    bool cowAbducted = false; // Variable para controlar si la vaca ha sido completamente abducida
-    bool ufoRetreating = false; // Variable para controlar el retiro del UFO
-    bool ufoExiting = false; // Variable para controlar la salida del OVNI
-    bool cameraStopped = false; // Variable para controlar si la cámara se detiene
-
-    glm::vec3 lightPos(50.0f, 50.0f, 50.0f);
-    glm::vec3 lightColor(1.0f, 1.0f, 1.0f);
-    glm::vec3 objectColor(1.0f, 1.0f, 0.0f);
-
-    // Bucle de renderizado
-    while (!glfwWindowShouldClose(window))
-    {
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glClearColor(0.1f, 0.12f, 0.1f, 1.0f);
-
-
-        // Actualizar rotación del OVNI
-        ufoRotationAngle += 0.03f;
-        if (ufoRotationAngle > 360.0f)
-            ufoRotationAngle -= 360.0f;
-
-        // Actualizar posición del OVNI
-        if (ufoDescending) {
-            ufoPositionY -= 0.7f;
-            if (ufoPositionY <= 30.0f) {
-                ufoDescending = false;
-                ufoMovingRight = true;
-            }
-        }
-
-        if (ufoMovingRight) {
-            ufoPositionX += 0.5f;
-            if (ufoPositionX >= 0.0f) {
-                ufoMovingRight = false;
-                cowAscending = true;
-            }
-        }
-
-        // Actualizar posición y escala de la vaca
-        if (cowAscending) {
-            cowPositionOffsetY += 0.7f; // Incrementar la velocidad de ascenso
-            cowScale -= 0.025f; // Reducir la velocidad de cambio de escala
-            if (cowScale <= 0.0f) {
-                cowScale = 0.0f;
-                cowAscending = false;
-                cowAbducted = true; // Indicar que la vaca ha sido completamente abducida
-                ufoRetreating = true; // Activar el retiro del UFO
-            }
-            // Comenzar la rotación de la vaca cuando empiece a ascender
-            if (cowPositionOffsetY >= 6.0f && !cowRotating) {
-                cowRotating = true;
-            }
-        }
-
-        if (cowRotating) {
-            cowRotationAngle += 0.05f; // Velocidad de rotación de la vaca
-            if (cowRotationAngle > glm::radians(180.0f)) {
-                cowRotationAngle = 0.0f;
-                cowRotating = false;
-            }
-        }
-
-        // Lógica de retiro del UFO
-        if (ufoRetreating) {
-            ufoPositionY += 0.15f; // Incrementa la posición Y del UFO para que se retire
-            if (ufoPositionY >= 70.0f) { // Verifica si el UFO ha salido de la escena
-                ufoRetreating = false; // Detén el movimiento del UFO cuando esté fuera de la escena
-                ufoExiting = true; // Activar la salida del OVNI hacia la izquierda
-            }
-        }
-
-        // Lógica de salida del OVNI hacia la izquierda y reducción de tamaño
-        if (ufoExiting) {
-            ufoPositionX -= 0.05f; // Mover el OVNI hacia la izquierda
-            ufoScale -= 0.008f; // Reducir el tamaño del OVNI
-            if (ufoScale <= 0.0f) {
-                ufoScale = 0.0f;
-                ufoExiting = false; // Detener la salida del OVNI cuando desaparezca
-                cameraStopped = true; // Detener la cámara cuando el OVNI desaparezca
+// Densidad del pasto en la zona llana del suelo: modelos/grass_density.png (8 bits) o,
+// si no está, manchas de ruido con claros bajo la casa y donde el OVNI recoge a la vaca
+GrassDensityMap buildGrassDensity(const std::string& modelsDir)
+{
+    GrassDensityMap density;
+    density.worldMin = glm::vec2(-1750.0f, -1750.0f);
+    density.worldSize = 2400.0f;
+
+    int width = 0, height = 0, channels = 0;
+    unsigned char* image = stbi_load((modelsDir + "grass_density.png").c_str(), &width, &height, &channels, 1);
+    if (image && width == height && width > 1) {
+        density.size = width;
+        for (int i = 0; i < width * height; ++i)
+            density.values.push_back(image[i] / 255.0f);
+    }
+    else {
+        density.size = 512;
+        const glm::vec2 clearings[] = { glm::vec2(-70.0f, -30.0f), glm::vec2(0.0f, 50.0f) };
+        const float clearingRadius[] = { 45.0f, 12.0f };
+        float sampleSpacing = density.worldSize / (density.size - 1);
+        for (int j = 0; j < density.size; ++j) {
+            for (int i = 0; i < density.size; ++i) {
+                glm::vec2 position = density.worldMin + glm::vec2(i * sampleSpacing, j * sampleSpacing);
+                float patches = 0.6f + 0.25f * glm::sin(position.x * 0.031f) * glm::sin(position.y * 0.027f)
+                                     + 0.15f * glm::sin(position.x * 0.013f + position.y * 0.017f);
+                for (int c = 0; c < 2; ++c)
+                    patches *= glm::smoothstep(clearingRadius[c], clearingRadius[c] * 1.5f, glm::length(position - clearings[c]));
+                density.values.push_back(glm::clamp(patches, 0.0f, 1.0f));
             }
         }
-
-        glm::mat4 ufoModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(ufoPositionX, ufoPositionY, 50.0f));
-        ufoModelMatrix = glm::rotate(ufoModelMatrix, ufoRotationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
-        ufoModelMatrix = glm::scale(ufoModelMatrix, glm::vec3(ufoScale));
-        objects[objects.size() - 1].updateTransformation(ufoModelMatrix);
-
-        glm::mat4 cowModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, cowPositionOffsetY, 50.0f));
-        cowModelMatrix = glm::scale(cowModelMatrix, glm::vec3(cowScale));
-        if (cowRotating) {
-            cowModelMatrix = glm::rotate(cowModelMatrix, cowRotationAngle, glm::vec3(1.0f, 0.0f, 0.0f));
-        }
-        objects[objects.size() - 2].updateTransformation(cowModelMatrix);
-
-        // // Actualizar la posición de la cámara
-        // camera->updateCameraPosition(ufoPositionX, ufoPositionY, 50.0f, cowPositionOffsetY, cowAscending, cowAbducted, ufoRetreating, cameraStopped);
-		
-		bool coneActive = !ufoDescending && !cowAbducted;
-
-        // Renderizar objetos
-        glUseProgram(shaderProgram);
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(camera->getProjMatrix()));
-        for (size_t i = 0; i < objects.size(); ++i)
-        {
-            objects[i].draw();
-        }
-		
-		if (!cowAscending && !cowAbducted && !coneActive) {
-			glm::vec3 laserVertices[] = {
-				glm::vec3(ufoPositionX, ufoPositionY + 10.0f, 50.0f),         // Punto de inicio en el OVNI
-				glm::vec3(ufoPositionX + 10.0f * cos(time_laser), ufoPositionY - coneHeight, 50.0f + 10.0f * sin(time_laser)) // Punto de finalización en el suelo en movimiento circular
-			};
-
-			glUseProgram(laserShaderProgram);
-			glUniformMatrix4fv(glGetUniformLocation(laserShaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
-			glUniformMatrix4fv(glGetUniformLocation(laserShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(camera->getProjMatrix()));
-			glm::mat4 laserModelMatrix = glm::mat4(1.0f);
-			glUniformMatrix4fv(glGetUniformLocation(laserShaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(laserModelMatrix));
-
-			glBindBuffer(GL_ARRAY_BUFFER, laserVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(laserVertices), laserVertices);
-			glBindVertexArray(laserVAO);
-
-			// Ajustar el ancho del láser
-			glLineWidth(5.0f); // Cambia este valor para ajustar el grosor del láser
-
-			glDrawArrays(GL_LINES, 0, 2);
-			glBindVertexArray(0);
-		}
-
-        // Dibujar el cono una vez que el OVNI ha terminado de bajar y antes de que la vaca sea completamente abducida
-        if (coneActive) {
-            glUseProgram(coneShaderProgram);
-            glUniform3fv(glGetUniformLocation(coneShaderProgram, "lightPos"), 1, glm::value_ptr(lightPos));
-            glUniform3fv(glGetUniformLocation(coneShaderProgram, "viewPos"), 1, glm::value_ptr(camera->getPosition()));
-            glUniform3fv(glGetUniformLocation(coneShaderProgram, "lightColor"), 1, glm::value_ptr(lightColor));
-            glUniform3fv(glGetUniformLocation(coneShaderProgram, "objectColor"), 1, glm::value_ptr(objectColor));
-            glm::mat4 coneModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(ufoPositionX, ufoPositionY - coneHeight / 2.0f, 50.0f)); // Ajustar la posición del cono
-            coneModelMatrix = glm::rotate(coneModelMatrix, ufoRotationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
-            glUniformMatrix4fv(glGetUniformLocation(coneShaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(coneModelMatrix));
-            glUniformMatrix4fv(glGetUniformLocation(coneShaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(camera->getViewMatrix()));
-            glUniformMatrix4fv(glGetUniformLocation(coneShaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(camera->getProjMatrix()));
-            glBindVertexArray(coneVAO);
-            glDrawElements(GL_TRIANGLES, coneIndices.size(), GL_UNSIGNED_INT, 0);
-            glBindVertexArray(0);
-        }
-		
-		// Actualizar la posición de la cámara
-        camera->updateCameraPosition(ufoPositionX, ufoPositionY, 50.0f, cowPositionOffsetY, cowAscending, cowAbducted, ufoRetreating, cameraStopped);
-
-        glfwSwapBuffers(window);
-        glfwPollEvents();
     }
-
-    glfwTerminate();
-    return 0;
+    if (image)
+        stbi_image_free(image);
+    return density;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -923,6 +1781,12 @@ void processKeyInput(GLFWwindow* window, int key, int scancode, int action, int
     if (action == GLFW_PRESS && key == GLFW_KEY_ESCAPE)
         glfwSetWindowShouldClose(window, true);
 
+    if (action == GLFW_PRESS && key == GLFW_KEY_F12)
+        referenceRequested = true;
+
+    if (action == GLFW_PRESS && key >= GLFW_KEY_F1 && key <= GLFW_KEY_F4)
+        debugViews.toggle(DebugView(DEBUG_VIEW_OVERDRAW + (key - GLFW_KEY_F1)));
+
     if (action == GLFW_PRESS && key == GLFW_KEY_LEFT)
         camera->move(-1.0f * CAMERA_STEP * glm::normalize(glm::cross(camera->getCenter() - camera->getPosition(), glm::vec3(0.0f, 1.0f, 0.0f))));
     if (action == GLFW_PRESS && key == GLFW_KEY_RIGHT)
@@ -938,23 +1802,6 @@ void processKeyInput(GLFWwindow* window, int key, int scancode, int action, int
         camera->turn(0.5f * CAMERA_STEP * glm::normalize(glm::cross(camera->getCenter() - camera->getPosition(), glm::vec3(0.0f, 1.0f, 0.0f))));
 }
 
-GLuint loadShader(GLenum type, const char* source)
-{
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
-
-    int success;
-    char infoLog[512];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    return shader;
-}
-
 GLuint loadTextures(const char* filename)
 {
     int width, height, nrChannels;
@@ -977,30 +1824,51 @@ GLuint loadTexture(const std::string& path)
     GLuint textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else if (nrChannels == 4)
-            format = GL_RGBA;
-
+    // Todos los niveles vienen ya generados (y comprimidos) del horneado
+    BakedTexture texture;
+    if (loadOrBakeTexture(path, textureBakeOptions, texture)) {
         glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        for (size_t level = 0; level < texture.levels.size(); ++level) {
+            const BakedLevel& baked = texture.levels[level];
+            uploadTextureLevel(texture.format, (GLint)level, baked.width, baked.height, baked.data.size(), baked.data.data());
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
     } else {
         std::cerr << "Error al cargar la textura: " << path << std::endl;
-        stbi_image_free(data);
     }
 
     return textureID;
-}
\ No newline at end of file
+}
+
+int bakeTexturesOffline(const std::string& directory)
+{
+    std::error_code error;
+    std::filesystem::directory_iterator entries(directory, error);
+    if (error)
+    {
+        std::cerr << "Error al leer el directorio " << directory << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    for (const auto& entry : entries)
+    {
+        std::string extension = entry.path().extension().string();
+        if (extension != ".png" && extension != ".jpg")
+            continue;
+
+        BakedTexture texture;
+        std::string path = entry.path().string();
+        if (loadOrBakeTexture(path, textureBakeOptions, texture)) {
+            std::cout << "Horneada: " << path << " (" << texture.levels.size() << " niveles, " << texture.byteSize() << " bytes)" << std::endl;
+        } else {
+            std::cerr << "Error al hornear la textura: " << path << std::endl;
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
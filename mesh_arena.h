@@ -0,0 +1,161 @@
+#ifndef MESH_ARENA_H
+#define MESH_ARENA_H
+
+// Arena de mallas estáticas: todos los modelos comparten un único VBO
+// (posición + coordenada de textura intercaladas), un único EBO y un único VAO.
+// Cada malla es un MeshRange dentro de la arena y se dibuja con
+// glDrawElementsBaseVertex o, si hay GL 4.3, agrupada en un
+// glMultiDrawElementsIndirect.
+//
+// Los atributos 2-5 del VAO son la matriz "model" por instancia (divisor 1),
+// leída de instanceBuffer; en los dibujos indirectos baseInstance elige la
+// matriz de cada comando. createVao() crea más VAOs sobre la misma geometría
+// con otro búfer de instancias.
+//
+// Las pasadas de solo profundidad (sombras) no necesitan la coordenada de
+// textura: upload() guarda también las posiciones solas en depthVbo (12 bytes
+// por vértice en lugar de 20) y createDepthVao() las usa con el mismo EBO.
+
+#include <iostream>
+#include <vector>
+
+struct MeshRange
+{
+    GLint baseVertex = 0;
+    GLint firstIndex = 0;
+    GLsizei indexCount = 0;
+};
+
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+class MeshArena
+{
+public:
+    static const int VERTEX_FLOATS = 5;
+
+    // texcoords puede estar vacío; entonces se rellena con ceros
+    MeshRange add(const std::vector<float>& positions, const std::vector<float>& texcoords, const std::vector<unsigned int>& indices)
+    {
+        MeshRange range;
+        range.baseVertex = (GLint)vertexCount;
+        range.firstIndex = (GLint)indexData.size();
+        range.indexCount = (GLsizei)indices.size();
+
+        size_t count = positions.size() / 3;
+        bool textured = texcoords.size() >= count * 2;
+        for (size_t i = 0; i < count; ++i)
+        {
+            vertexData.push_back(positions[i * 3 + 0]);
+            vertexData.push_back(positions[i * 3 + 1]);
+            vertexData.push_back(positions[i * 3 + 2]);
+            vertexData.push_back(textured ? texcoords[i * 2 + 0] : 0.0f);
+            vertexData.push_back(textured ? texcoords[i * 2 + 1] : 0.0f);
+        }
+        indexData.insert(indexData.end(), indices.begin(), indices.end());
+        vertexCount += count;
+        return range;
+    }
+
+    // Una sola subida cuando ya están todas las mallas
+    void upload(GLuint instanceBuffer)
+    {
+        std::cout << "Arena: " << vertexCount << " vertices, " << indexData.size() << " indices" << std::endl;
+
+        std::vector<float> positions;
+        positions.reserve(vertexCount * 3);
+        for (size_t i = 0; i < vertexCount; ++i)
+            positions.insert(positions.end(), vertexData.begin() + i * VERTEX_FLOATS, vertexData.begin() + i * VERTEX_FLOATS + 3);
+
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &depthVbo);
+        glGenBuffers(1, &ebo);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), vertexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, depthVbo);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(unsigned int), indexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        vao = createVao(instanceBuffer);
+
+        std::vector<float>().swap(vertexData);
+        std::vector<unsigned int>().swap(indexData);
+    }
+
+    // La geometría de la arena con las matrices por instancia de instanceBuffer
+    GLuint createVao(GLuint instanceBuffer) const
+    {
+        GLuint newVao;
+        glGenVertexArrays(1, &newVao);
+        glBindVertexArray(newVao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, VERTEX_FLOATS * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int column = 0; column < 4; ++column)
+        {
+            glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(column * 4 * sizeof(float)));
+            glVertexAttribDivisor(2 + column, 1);
+            glEnableVertexAttribArray(2 + column);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return newVao;
+    }
+
+    // Solo la posición (atributo 0) y las matrices por instancia de instanceBuffer
+    GLuint createDepthVao(GLuint instanceBuffer) const
+    {
+        GLuint newVao;
+        glGenVertexArrays(1, &newVao);
+        glBindVertexArray(newVao);
+
+        glBindBuffer(GL_ARRAY_BUFFER, depthVbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int column = 0; column < 4; ++column)
+        {
+            glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), (void*)(column * 4 * sizeof(float)));
+            glVertexAttribDivisor(2 + column, 1);
+            glEnableVertexAttribArray(2 + column);
+        }
+
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return newVao;
+    }
+
+    GLuint getVao() const
+    {
+        return vao;
+    }
+
+private:
+    std::vector<float> vertexData;
+    std::vector<unsigned int> indexData;
+    size_t vertexCount = 0;
+    GLuint vao = 0, vbo = 0, depthVbo = 0, ebo = 0;
+};
+
+#endif
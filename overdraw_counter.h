@@ -0,0 +1,95 @@
+#ifndef OVERDRAW_COUNTER_H
+#define OVERDRAW_COUNTER_H
+
+// Fragmentos sombreados por píxel de pantalla, para medir el sobredibujo.
+//
+// begin() y end() rodean los pases de color con una consulta GL_SAMPLES_PASSED
+// (las muestras que pasan la prueba de profundidad) y el resultado se divide
+// por los píxeles del viewport y las muestras por píxel del destino. Como los
+// tiempos de ShadowMaps, cada consulta se lee QUERY_COUNT fotogramas después,
+// sin esperar a la GPU. Con la pantalla cubierta lo mínimo es 1: con la pasada
+// previa de profundidad los opacos se acercan a eso y lo que sobra es lo que
+// se sombrea para nada.
+
+#include <algorithm>
+
+class OverdrawCounter
+{
+public:
+    static const int QUERY_COUNT = 3;
+
+    void init()
+    {
+        glGenQueries(QUERY_COUNT, queries);
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if (initialized) glDeleteQueries(QUERY_COUNT, queries);
+        initialized = false;
+    }
+
+    void begin()
+    {
+        if (!initialized)
+            return;
+        readQuery();
+        glBeginQuery(GL_SAMPLES_PASSED, queries[queryIndex]);
+    }
+
+    // Con el mismo destino que los dibujos medidos aún enlazado
+    void end()
+    {
+        if (!initialized)
+            return;
+        glEndQuery(GL_SAMPLES_PASSED);
+
+        GLint viewport[4], samples = 0;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_SAMPLES, &samples);
+        queryPixels[queryIndex] = double(viewport[2]) * viewport[3] * std::max(samples, 1);
+        queryPending[queryIndex] = true;
+        queryIndex = (queryIndex + 1) % QUERY_COUNT;
+    }
+
+    // De la última consulta leída
+    double getLast() const
+    {
+        return last;
+    }
+
+    double getAverage() const
+    {
+        return measuredFrames > 0 ? total / measuredFrames : 0.0;
+    }
+
+private:
+    GLuint queries[QUERY_COUNT] = {};
+    bool queryPending[QUERY_COUNT] = {};
+    double queryPixels[QUERY_COUNT] = {};
+    int queryIndex = 0;
+    bool initialized = false;
+
+    double last = 0.0, total = 0.0;
+    unsigned measuredFrames = 0;
+
+    void readQuery()
+    {
+        if (!queryPending[queryIndex])
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[queryIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available && queryPixels[queryIndex] > 0.0)
+        {
+            GLuint samples = 0;
+            glGetQueryObjectuiv(queries[queryIndex], GL_QUERY_RESULT, &samples);
+            last = samples / queryPixels[queryIndex];
+            total += last;
+            ++measuredFrames;
+        }
+        queryPending[queryIndex] = false;
+    }
+};
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+// Partículas del rayo del OVNI: chispas que suben con la vaca y polvo en la base.
+//
+// ParticleSystem es solo la simulación, sin OpenGL (también corre sin ventana
+// con --particles). Cada atributo es un array propio (posición x, y, z,
+// velocidad x, y, z, vida...) con sitio para todas las partículas, así update()
+// integra varias a la vez con los vectores de softraster (AVX2, SSE2 o escalar)
+// como ClusteredLights. Los huecos libres están en una pila: spawn() toma de
+// ella y lo que muere en update() vuelve, sin mover ni reservar nada.
+//
+// update() lanza un trabajo de JobSystem por bloque de CHUNK_SIZE huecos y
+// cada bloque cuenta sus vivas y apunta las que mueren. write() hace la suma
+// de prefijos de esos recuentos y, otra vez un trabajo por bloque, cada uno
+// copia sus vivas a su tramo de la lista de instancias, sin huecos. Los dos
+// esperan a sus trabajos ayudando, así que también pueden llamarse desde uno.
+//
+// ParticleRenderer dibuja esa lista como sprites instanciados: 4 vértices por
+// partícula abiertos hacia la cámara en el vertex shader, con posición, tamaño
+// y color por instancia en su propio StreamBuffer (un millón no cabe en el de
+// la escena). El color va premultiplicado; con alfa 0 la partícula se suma, así
+// las chispas brillan y el polvo tapa en el mismo dibujo.
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "job_system.h"
+#include "program_cache.h"
+#include "soft_raster.h"
+#include "stream_buffer.h"
+
+inline const char* particleVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec4 aPosition; // posición y tamaño
+    layout (location = 1) in vec4 aColor;    // premultiplicado; alfa 0: se suma
+
+    uniform mat4 view;
+    uniform mat4 projection;
+
+    out vec2 Corner;
+    out vec4 Color;
+
+    void main()
+    {
+        Corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+        vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+        vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+        vec3 world = aPosition.xyz + (right * Corner.x + up * Corner.y) * 0.5 * aPosition.w;
+        gl_Position = projection * view * vec4(world, 1.0);
+        Color = aColor;
+    }
+)glsl";
+
+inline const char* particleFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    in vec2 Corner;
+    in vec4 Color;
+
+    void main()
+    {
+        float falloff = max(1.0 - dot(Corner, Corner), 0.0);
+        if (falloff == 0.0)
+            discard;
+        FragColor = Color * (falloff * falloff);
+    }
+)glsl";
+
+// Lo que va a la GPU por partícula viva
+struct ParticleInstance
+{
+    float x, y, z, size;
+    uint32_t color; // RGBA8 premultiplicado (r en el byte bajo)
+};
+
+// Cómo nacen las partículas de un spawn(); lo "spread" es ± al azar
+struct ParticleEmitter
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 spread = glm::vec3(0.0f);
+    glm::vec3 velocity = glm::vec3(0.0f);
+    glm::vec3 velocitySpread = glm::vec3(0.0f);
+    float lift = 0.0f;   // aceleración vertical; negativa: cae
+    float drag = 0.0f;   // fracción de la velocidad que se pierde por segundo
+    float life = 1.0f;   // segundos, ±25 %
+    float size = 0.1f;
+    glm::vec4 color = glm::vec4(1.0f);
+    bool additive = false;
+};
+
+class ParticleSystem
+{
+public:
+    static const unsigned MAX_PARTICLES = 1u << 20;
+    static const unsigned CHUNK_SIZE = 16384; // múltiplo de LANE_COUNT
+
+    void init(JobSystem& _jobs, unsigned _capacity = MAX_PARTICLES)
+    {
+        jobs = &_jobs;
+        capacity = _capacity;
+        size_t padded = (capacity + softraster::LANE_COUNT - 1) / softraster::LANE_COUNT * softraster::LANE_COUNT;
+        for (std::vector<float>* component : { &positionX, &positionY, &positionZ, &velocityX, &velocityY, &velocityZ,
+                                               &lifts, &drags, &lives, &inverseLifetimes, &sizes })
+            component->assign(padded, 0.0f);
+        colors.assign(padded, 0);
+        resetFreeSlots();
+    }
+
+    // Las que quepan; devuelve cuántas han nacido
+    unsigned spawn(const ParticleEmitter& emitter, unsigned count)
+    {
+        uint32_t color = premultiplied(emitter.color, emitter.additive);
+        unsigned spawned = 0;
+        for (; spawned < count && !freeSlots.empty(); ++spawned)
+        {
+            uint32_t slot = freeSlots.back();
+            freeSlots.pop_back();
+            used = std::max(used, (size_t)slot + 1);
+
+            positionX[slot] = emitter.position.x + emitter.spread.x * random();
+            positionY[slot] = emitter.position.y + emitter.spread.y * random();
+            positionZ[slot] = emitter.position.z + emitter.spread.z * random();
+            velocityX[slot] = emitter.velocity.x + emitter.velocitySpread.x * random();
+            velocityY[slot] = emitter.velocity.y + emitter.velocitySpread.y * random();
+            velocityZ[slot] = emitter.velocity.z + emitter.velocitySpread.z * random();
+            lifts[slot] = emitter.lift;
+            drags[slot] = emitter.drag;
+            float life = emitter.life * (1.0f + 0.25f * random());
+            lives[slot] = life;
+            inverseLifetimes[slot] = life > 0.0f ? 1.0f / life : 0.0f;
+            sizes[slot] = emitter.size;
+            colors[slot] = color;
+        }
+        liveCount += spawned;
+        return spawned;
+    }
+
+    void update(float dt)
+    {
+        chunkCount = (used + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunkLive.assign(chunkCount, 0);
+        if (dead.size() < chunkCount)
+            dead.resize(chunkCount);
+        JobCounter integrated;
+        jobs->parallelFor("particulas_integrar", chunkCount, 1, [this, dt](size_t chunk, size_t) { integrate(chunk, dt, dead[chunk]); }, &integrated);
+        jobs->wait(integrated);
+
+        liveCount = 0;
+        for (unsigned live : chunkLive)
+            liveCount += live;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            std::vector<uint32_t>& slots = dead[chunk];
+            freeSlots.insert(freeSlots.end(), slots.begin(), slots.end());
+            slots.clear();
+        }
+        // Sin vivas se vuelve a empezar por el principio y update() no recorre nada
+        if (liveCount == 0 && used > 0)
+            resetFreeSlots();
+    }
+
+    // Las vivas del último update(), como mucho maxCount; devuelve cuántas ha escrito
+    size_t write(ParticleInstance* out, size_t maxCount)
+    {
+        chunkOffsets.resize(chunkCount);
+        size_t total = 0;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            chunkOffsets[chunk] = total;
+            total += chunkLive[chunk];
+        }
+        total = std::min(total, maxCount);
+
+        JobCounter written;
+        jobs->parallelFor("particulas_instancias", chunkCount, 1, [this, out, total](size_t chunk, size_t) {
+            if (chunkOffsets[chunk] < total)
+                writeChunk(chunk, out + chunkOffsets[chunk], std::min((size_t)chunkLive[chunk], total - chunkOffsets[chunk]));
+        }, &written);
+        jobs->wait(written);
+        return total;
+    }
+
+    size_t getLiveCount() const
+    {
+        return liveCount;
+    }
+
+    unsigned getCapacity() const
+    {
+        return capacity;
+    }
+
+private:
+    JobSystem* jobs = nullptr;
+    unsigned capacity = 0;
+
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> velocityX, velocityY, velocityZ;
+    std::vector<float> lifts, drags, lives, inverseLifetimes, sizes;
+    std::vector<uint32_t> colors;
+
+    std::vector<uint32_t> freeSlots;
+    std::vector<std::vector<uint32_t>> dead; // por bloque, las que mueren en update()
+    size_t used = 0;                         // hasta dónde hay huecos ocupados alguna vez
+    size_t liveCount = 0;
+
+    size_t chunkCount = 0;
+    std::vector<unsigned> chunkLive;
+    std::vector<size_t> chunkOffsets;
+    uint32_t seed = 0x9E3779B9u;
+
+    // xorshift en -1..1; spawn() solo corre en un hilo
+    float random()
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return (seed >> 8) * (2.0f / 16777216.0f) - 1.0f;
+    }
+
+    static uint32_t premultiplied(const glm::vec4& color, bool additive)
+    {
+        return softraster::packColor(glm::vec4(glm::vec3(color) * color.w, additive ? 0.0f : color.w));
+    }
+
+    // Los cuatro canales por fade (0..256), dos a la vez
+    static uint32_t fadeColor(uint32_t color, uint32_t fade)
+    {
+        return (((color & 0x00FF00FFu) * fade >> 8) & 0x00FF00FFu) | ((((color >> 8) & 0x00FF00FFu) * fade) & 0xFF00FF00u);
+    }
+
+    // Las primeras en salir de la pila son las de índice más bajo
+    void resetFreeSlots()
+    {
+        freeSlots.resize(capacity);
+        for (unsigned i = 0; i < capacity; ++i)
+            freeSlots[i] = capacity - 1 - i;
+        std::fill(lives.begin(), lives.end(), 0.0f);
+        used = 0;
+        liveCount = 0;
+    }
+
+    void integrate(size_t chunk, float dt, std::vector<uint32_t>& died)
+    {
+        using namespace softraster;
+
+        size_t begin = chunk * CHUNK_SIZE;
+        size_t end = std::min(begin + CHUNK_SIZE, (used + LANE_COUNT - 1) / LANE_COUNT * LANE_COUNT);
+        Lanes step = splat(dt), zero = splat(0.0f), one = splat(1.0f);
+        unsigned live = 0;
+        for (size_t i = begin; i < end; i += LANE_COUNT)
+        {
+            Lanes life = load(&lives[i]);
+            int alive = bits(less(zero, life));
+            if (!alive)
+                continue;
+
+            Lanes damping = maximum(zero, sub(one, mul(load(&drags[i]), step)));
+            Lanes vx = mul(load(&velocityX[i]), damping);
+            Lanes vy = add(mul(load(&velocityY[i]), damping), mul(load(&lifts[i]), step));
+            Lanes vz = mul(load(&velocityZ[i]), damping);
+            store(&velocityX[i], vx);
+            store(&velocityY[i], vy);
+            store(&velocityZ[i], vz);
+            store(&positionX[i], add(load(&positionX[i]), mul(vx, step)));
+            store(&positionY[i], add(load(&positionY[i]), mul(vy, step)));
+            store(&positionZ[i], add(load(&positionZ[i]), mul(vz, step)));
+            life = sub(life, step);
+            store(&lives[i], life);
+
+            int survivors = bits(less(zero, life));
+            for (int lane = 0, gone = alive & ~survivors; gone; ++lane, gone >>= 1)
+                if (gone & 1)
+                    died.push_back((uint32_t)(i + lane));
+            for (; survivors; survivors &= survivors - 1)
+                ++live;
+        }
+        chunkLive[chunk] = live;
+    }
+
+    // Se apagan en el último cuarto de su vida
+    void writeChunk(size_t chunk, ParticleInstance* out, size_t room)
+    {
+        size_t begin = chunk * CHUNK_SIZE, end = std::min(begin + CHUNK_SIZE, used);
+        size_t written = 0;
+        for (size_t i = begin; i < end && written < room; ++i)
+        {
+            if (lives[i] <= 0.0f)
+                continue;
+            float fade = std::min(lives[i] * inverseLifetimes[i] * 4.0f, 1.0f);
+            out[written++] = { positionX[i], positionY[i], positionZ[i], sizes[i], fadeColor(colors[i], (uint32_t)(fade * 256.0f)) };
+        }
+    }
+};
+
+class ParticleRenderer
+{
+public:
+    void init(ProgramCache& cache, unsigned capacity)
+    {
+        program = cache.getProgram({ { GL_VERTEX_SHADER, particleVertexShaderSource },
+                                     { GL_FRAGMENT_SHADER, particleFragmentShaderSource } });
+        maxInstances = capacity;
+        stream.init(GL_ARRAY_BUFFER, capacity * sizeof(ParticleInstance));
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(0, 1);
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if (!initialized)
+            return;
+        glDeleteVertexArrays(1, &vao);
+        stream.destroy();
+        // El programa es de ProgramCache
+        initialized = false;
+    }
+
+    // Después de ParticleSystem::update(); las instancias quedan listas para draw()
+    void upload(ParticleSystem& system)
+    {
+        instanceCount = 0;
+        if (!initialized)
+            return;
+        stream.beginFrame();
+        size_t count = std::min(system.getLiveCount(), maxInstances);
+        if (count > 0)
+        {
+            instanceData = stream.allocate(count * sizeof(ParticleInstance), sizeof(ParticleInstance));
+            if (instanceData.data)
+                instanceCount = system.write((ParticleInstance*)instanceData.data, count);
+        }
+        stream.commit();
+    }
+
+    // Con la profundidad de lo opaco escrita; no la modifica
+    void draw(const glm::mat4x4& view, const glm::mat4x4& proj)
+    {
+        if (!initialized)
+            return;
+        if (instanceCount > 0)
+        {
+            glUseProgram(program);
+            glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+            glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(proj));
+
+            glDepthMask(GL_FALSE);
+            glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            glBindVertexArray(vao);
+            glBindBuffer(GL_ARRAY_BUFFER, stream.getBuffer());
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void*)instanceData.offset);
+            glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleInstance), (void*)(instanceData.offset + 4 * sizeof(float)));
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)instanceCount);
+            glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDepthMask(GL_TRUE);
+        }
+        stream.endFrame();
+    }
+
+    size_t getInstanceCount() const
+    {
+        return instanceCount;
+    }
+
+private:
+    GLuint program = 0;
+    GLuint vao = 0;
+    bool initialized = false;
+
+    StreamBuffer stream;
+    StreamBuffer::Allocation instanceData = {};
+    size_t maxInstances = 0;
+    size_t instanceCount = 0;
+};
+
+#endif
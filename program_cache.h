@@ -0,0 +1,592 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+// Caché de programas de shaders.
+//
+// Cada programa se describe por sus fuentes (tipo + texto, pueden repetirse
+// etapas para enlazar "bibliotecas" como applyShadows()) y una cadena de
+// #defines que se inserta tras la línea #version de cada fuente que no sea
+// compartida. La clave es un hash FNV-1a de todo eso más el fabricante, el
+// renderer y la versión del driver, así que un binario nunca se reutiliza con
+// otro driver.
+//
+// Dentro de una ejecución, getShader() compila cada fuente una sola vez (el
+// vertex shader común de varias variantes, las bibliotecas de iluminación que
+// enlazan varios programas) y getProgram() devuelve el mismo programa para la
+// misma clave. Entre ejecuciones, con ARB_get_program_binary (4.1) y algún
+// formato de binario disponible, el programa enlazado se guarda en
+// "<directorio>/<clave>.bin" y el siguiente arranque lo carga con
+// glProgramBinary() sin compilar nada. Si el driver rechaza el binario (p. ej.
+// tras actualizarse sin cambiar de versión) se compila de las fuentes y se
+// sobrescribe.
+//
+// feedbackVaryings (transform feedback, intercalados) se fijan antes de enlazar
+// y entran en la clave; el binario guardado ya los lleva.
+//
+// requestProgram() manda compilar y enlazar sin preguntar por el resultado:
+// con ARB_parallel_shader_compile (o un driver que compile en diferido) el
+// trabajo sigue en otros hilos y solo se espera en el primer getProgram().
+//
+// Recarga en caliente: con enableHotReload(), las fuentes registradas con
+// watchSource() se leen de un fichero del directorio (si no existe se escribe
+// con el texto del código). Cuando el fichero cambia, update() vuelve a
+// compilar sin esperar cada programa que usa esa fuente y, cuando el driver
+// termina, lo sustituye al principio de un fotograma; si no compila se queda
+// el anterior. Quien guarde GLuint de programas los cambia con lo que devuelve
+// update() (las clases que los guardan tienen su applySwaps()).
+//
+// La caché es dueña de los shaders y programas que devuelve: destroy() los
+// borra todos.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_watcher.h"
+#include "gl_ext.h"
+
+struct ShaderSource
+{
+    GLenum type;
+    const char* source;
+    bool shared = false; // se compila sin los defines del programa (bibliotecas)
+};
+
+struct ProgramSwap
+{
+    GLuint oldProgram, newProgram;
+};
+
+struct ProgramCacheStats
+{
+    unsigned programs = 0;       // programas distintos pedidos
+    unsigned binaryHits = 0;     // cargados de disco
+    unsigned linked = 0;         // compilados y enlazados de las fuentes
+    unsigned shadersCompiled = 0;
+    unsigned shadersReused = 0;  // fuentes ya compiladas en esta ejecución
+    double milliseconds = 0.0;   // tiempo total dentro de la caché
+};
+
+namespace progcache
+{
+    const char MAGIC[4] = { 'P', 'B', 'I', 'N' };
+    const uint32_t VERSION = 1;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t length;
+        uint64_t key; // por si dos claves acaban en el mismo nombre de fichero
+    };
+
+    inline uint64_t hash(const void* data, size_t size, uint64_t h = 0xCBF29CE484222325ull)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i)
+            h = (h ^ bytes[i]) * 0x100000001B3ull;
+        return h;
+    }
+
+    inline uint64_t hash(const char* text, uint64_t h)
+    {
+        // El terminador separa cadenas consecutivas: "ab" + "c" != "a" + "bc"
+        return hash(text ? text : "", text ? std::strlen(text) + 1 : 1, h);
+    }
+}
+
+class ProgramCache
+{
+public:
+    ProgramCache() = default;
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    // Tras loadGLExtensions(). Con directory vacío no se guardan binarios.
+    void init(const std::string& directory)
+    {
+        driverKey = progcache::hash((const char*)glGetString(GL_VENDOR), 0xCBF29CE484222325ull);
+        driverKey = progcache::hash((const char*)glGetString(GL_RENDERER), driverKey);
+        driverKey = progcache::hash((const char*)glGetString(GL_VERSION), driverKey);
+
+        // Que el driver use todos los hilos que quiera para compilar
+        if (glext.maxShaderCompilerThreads)
+            glext.maxShaderCompilerThreads(0xFFFFFFFFu);
+
+        GLint formats = 0;
+        if (glext.programBinary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        cacheDirectory.clear();
+        if (formats > 0 && !directory.empty())
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(directory, ec);
+            if (!ec)
+                cacheDirectory = directory;
+            else
+                std::cerr << "No se pudo crear la caché de shaders: " << directory << std::endl;
+        }
+    }
+
+    void destroy()
+    {
+        for (const auto& entry : programs)
+            glDeleteProgram(entry.second.program);
+        for (const Rebuild& rebuild : rebuilds)
+            glDeleteProgram(rebuild.entry.program);
+        for (GLuint program : retired)
+            glDeleteProgram(program);
+        for (const auto& entry : shaders)
+            glDeleteShader(entry.second);
+        programs.clear();
+        rebuilds.clear();
+        retired.clear();
+        shaders.clear();
+        watcher.stop();
+    }
+
+    // Antes de pedir ningún programa
+    void enableHotReload(const std::string& directory)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if (ec)
+        {
+            std::cerr << "No se pudo crear el directorio de shaders: " << directory << std::endl;
+            return;
+        }
+        reloadDirectory = directory;
+        watcher.start(directory);
+    }
+
+    // source es el puntero de la fuente en el código, el que llega en ShaderSource.
+    // "<nombre>.base" guarda el hash del texto del código con el que se escribió
+    // el fichero: si el código cambia, el fichero se vuelve a escribir.
+    void watchSource(const char* source, const std::string& name)
+    {
+        if (reloadDirectory.empty())
+            return;
+        WatchedSource& watchedSource = watched[source];
+        watchedSource.path = (std::filesystem::path(reloadDirectory) / name).string();
+        std::string base, sourceHash = std::to_string(progcache::hash(source, 0xCBF29CE484222325ull));
+        if (!readFile(watchedSource.path + ".base", base) || base != sourceHash ||
+            !readFile(watchedSource.path, watchedSource.text))
+        {
+            watchedSource.text = source;
+            std::ofstream(watchedSource.path, std::ios::binary) << source;
+            std::ofstream(watchedSource.path + ".base", std::ios::binary) << sourceHash;
+        }
+        watcher.watchFile(name);
+    }
+
+    // Una vez por fotograma, antes de usar los programas. Devuelve los que se
+    // han sustituido en este fotograma; los antiguos se borran en el siguiente.
+    const std::vector<ProgramSwap>& update()
+    {
+        swaps.clear();
+        for (GLuint program : retired)
+            glDeleteProgram(program);
+        retired.clear();
+        if (reloadDirectory.empty())
+            return swaps;
+
+        for (const std::string& path : watcher.poll())
+            reload(path);
+        for (size_t i = 0; i < rebuilds.size();)
+        {
+            if (!isComplete(rebuilds[i].entry.program))
+            {
+                ++i;
+                continue;
+            }
+            completeRebuild(rebuilds[i]);
+            rebuilds.erase(rebuilds.begin() + i);
+        }
+        return swaps;
+    }
+
+    // Un shader compilado; el mismo objeto para la misma fuente y defines
+    GLuint getShader(GLenum type, const char* source, const std::string& defines = std::string())
+    {
+        auto start = std::chrono::steady_clock::now();
+        unsigned compiled = stats.shadersCompiled;
+        GLuint shader = findShader(type, source, defines);
+        if (stats.shadersCompiled != compiled)
+            checkShader(shader);
+        stats.milliseconds += elapsed(start);
+        return shader;
+    }
+
+    GLuint getProgram(const std::vector<ShaderSource>& sources, const std::string& defines = std::string(),
+                      const std::vector<std::string>& feedbackVaryings = std::vector<std::string>())
+    {
+        auto start = std::chrono::steady_clock::now();
+        Entry& entry = request(sources, defines, feedbackVaryings);
+        if (entry.pending)
+            finish(entry);
+        stats.milliseconds += elapsed(start);
+        return entry.program;
+    }
+
+    // Empieza a compilar y enlazar sin esperar; getProgram() recoge el resultado
+    void requestProgram(const std::vector<ShaderSource>& sources, const std::string& defines = std::string())
+    {
+        auto start = std::chrono::steady_clock::now();
+        request(sources, defines, std::vector<std::string>());
+        stats.milliseconds += elapsed(start);
+    }
+
+    bool hasBinaryCache() const { return !cacheDirectory.empty(); }
+    const ProgramCacheStats& getStats() const { return stats; }
+
+private:
+    struct Entry
+    {
+        uint64_t key = 0;
+        GLuint program = 0;
+        bool pending = false; // enlazado pedido, sin comprobar
+        std::vector<GLuint> attached;
+        std::vector<ShaderSource> sources;
+        std::string defines;
+        std::vector<std::string> feedbackVaryings;
+    };
+
+    struct WatchedSource
+    {
+        std::string path;
+        std::string text; // contenido actual del fichero
+    };
+
+    struct Rebuild
+    {
+        uint64_t oldKey;
+        Entry entry;
+    };
+
+    std::string cacheDirectory;
+    uint64_t driverKey = 0;
+    std::unordered_map<uint64_t, GLuint> shaders;
+    std::unordered_map<uint64_t, Entry> programs;
+    ProgramCacheStats stats;
+
+    std::string reloadDirectory;
+    FileWatcher watcher;
+    std::unordered_map<const char*, WatchedSource> watched;
+    std::vector<Rebuild> rebuilds;
+    std::vector<GLuint> retired;
+    std::vector<ProgramSwap> swaps;
+
+    static double elapsed(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static const std::string& definesFor(const ShaderSource& source, const std::string& defines)
+    {
+        static const std::string none;
+        return source.shared ? none : defines;
+    }
+
+    // El texto actual de una fuente: el del fichero si se vigila
+    const char* textOf(const char* source) const
+    {
+        auto found = watched.find(source);
+        return found != watched.end() ? found->second.text.c_str() : source;
+    }
+
+    uint64_t keyFor(const std::vector<ShaderSource>& sources, const std::string& defines,
+                    const std::vector<std::string>& feedbackVaryings) const
+    {
+        uint64_t key = progcache::hash(defines.c_str(), driverKey);
+        for (const std::string& varying : feedbackVaryings)
+            key = progcache::hash(varying.c_str(), key);
+        for (const ShaderSource& source : sources)
+        {
+            key = progcache::hash(textOf(source.source), key);
+            key = progcache::hash(&source.type, sizeof(source.type), key);
+            key = progcache::hash(&source.shared, sizeof(source.shared), key);
+        }
+        return key;
+    }
+
+    Entry& request(const std::vector<ShaderSource>& sources, const std::string& defines,
+                   const std::vector<std::string>& feedbackVaryings)
+    {
+        uint64_t key = keyFor(sources, defines, feedbackVaryings);
+        auto found = programs.find(key);
+        if (found != programs.end())
+            return found->second;
+
+        Entry& entry = programs[key];
+        entry.key = key;
+        entry.sources = sources;
+        entry.defines = defines;
+        entry.feedbackVaryings = feedbackVaryings;
+        stats.programs++;
+        entry.program = loadBinary(key);
+        if (entry.program)
+        {
+            stats.binaryHits++;
+            return entry;
+        }
+        link(entry);
+        stats.linked++;
+        return entry;
+    }
+
+    void link(Entry& entry)
+    {
+        entry.program = glCreateProgram();
+        for (const ShaderSource& source : entry.sources)
+        {
+            entry.attached.push_back(findShader(source.type, source.source, definesFor(source, entry.defines)));
+            glAttachShader(entry.program, entry.attached.back());
+        }
+        if (!entry.feedbackVaryings.empty())
+        {
+            std::vector<const char*> names;
+            for (const std::string& varying : entry.feedbackVaryings)
+                names.push_back(varying.c_str());
+            glTransformFeedbackVaryings(entry.program, (GLsizei)names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+        if (hasBinaryCache() && glext.programParameteri)
+            glext.programParameteri(entry.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(entry.program);
+        entry.pending = true;
+    }
+
+    // Aquí se espera al driver si aún no ha terminado
+    bool finish(Entry& entry)
+    {
+        int success;
+        char infoLog[512];
+        glGetProgramiv(entry.program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            for (GLuint shader : entry.attached)
+                checkShader(shader);
+            glGetProgramInfoLog(entry.program, 512, NULL, infoLog);
+            std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+        }
+        // Los shaders siguen en la caché para otros programas
+        for (GLuint shader : entry.attached)
+            glDetachShader(entry.program, shader);
+        entry.attached.clear();
+        entry.pending = false;
+        if (success)
+            saveBinary(entry.key, entry.program);
+        return success;
+    }
+
+    // Sin ARB_parallel_shader_compile no se puede preguntar sin esperar
+    static bool isComplete(GLuint program)
+    {
+        GLint complete = GL_TRUE;
+        if (glext.maxShaderCompilerThreads)
+            glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &complete);
+        return complete != GL_FALSE;
+    }
+
+    static bool readFile(const std::string& path, std::string& text)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    void reload(const std::string& path)
+    {
+        for (auto& item : watched)
+        {
+            std::string text;
+            if (item.second.path != path || !readFile(path, text) || text == item.second.text)
+                continue;
+            item.second.text = text;
+            std::cout << "Recompilando los programas con " << path << std::endl;
+            for (const auto& entry : programs)
+                for (const ShaderSource& source : entry.second.sources)
+                    if (source.source == item.first)
+                    {
+                        startRebuild(entry.second);
+                        break;
+                    }
+        }
+    }
+
+    void startRebuild(const Entry& old)
+    {
+        // Una recompilación del mismo programa que aún no ha terminado ya no vale
+        for (size_t i = 0; i < rebuilds.size(); ++i)
+            if (rebuilds[i].oldKey == old.key)
+            {
+                glDeleteProgram(rebuilds[i].entry.program);
+                rebuilds.erase(rebuilds.begin() + i);
+                break;
+            }
+
+        Rebuild rebuild;
+        rebuild.oldKey = old.key;
+        rebuild.entry.sources = old.sources;
+        rebuild.entry.defines = old.defines;
+        rebuild.entry.feedbackVaryings = old.feedbackVaryings;
+        rebuild.entry.key = keyFor(old.sources, old.defines, old.feedbackVaryings);
+        rebuild.entry.program = loadBinary(rebuild.entry.key);
+        if (!rebuild.entry.program)
+            link(rebuild.entry);
+        rebuilds.push_back(rebuild);
+    }
+
+    void completeRebuild(Rebuild& rebuild)
+    {
+        Entry& entry = rebuild.entry;
+        auto old = programs.find(rebuild.oldKey);
+        if ((entry.pending && !finish(entry)) || old == programs.end() || programs.count(entry.key))
+        {
+            std::cerr << "Se mantiene el programa anterior" << std::endl;
+            glDeleteProgram(entry.program);
+            return;
+        }
+        swaps.push_back({ old->second.program, entry.program });
+        retired.push_back(old->second.program);
+        programs.erase(old);
+        programs[entry.key] = entry;
+    }
+
+    GLuint findShader(GLenum type, const char* source, const std::string& defines)
+    {
+        source = textOf(source);
+        uint64_t key = progcache::hash(defines.c_str(), 0xCBF29CE484222325ull);
+        key = progcache::hash(&type, sizeof(type), progcache::hash(source, key));
+        auto found = shaders.find(key);
+        if (found != shaders.end())
+        {
+            stats.shadersReused++;
+            return found->second;
+        }
+        GLuint shader = compileShader(type, source, defines);
+        shaders[key] = shader;
+        stats.shadersCompiled++;
+        return shader;
+    }
+
+    std::string binaryPath(uint64_t key) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return (std::filesystem::path(cacheDirectory) / name).string();
+    }
+
+    // Los defines van tras la línea #version; #line mantiene los números de
+    // línea de los errores iguales a los de la fuente original. No se pregunta
+    // por el resultado para no esperar al compilador: lo hace checkShader().
+    static GLuint compileShader(GLenum type, const char* source, const std::string& defines)
+    {
+        GLuint shader = glCreateShader(type);
+        const char* body = source;
+        std::string header;
+        if (!defines.empty())
+        {
+            const char* version = std::strstr(source, "#version");
+            const char* newline = version ? std::strchr(version, '\n') : nullptr;
+            long line = 1;
+            if (newline)
+            {
+                header.assign(source, newline + 1);
+                body = newline + 1;
+                line += std::count(source, body, '\n');
+            }
+            header += defines;
+            if (defines.back() != '\n')
+                header += '\n';
+            header += "#line " + std::to_string(line) + "\n";
+        }
+        const char* strings[2] = { header.c_str(), body };
+        glShaderSource(shader, 2, strings, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    static void checkShader(GLuint shader)
+    {
+        int success;
+        char infoLog[512];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            std::cerr << "ERROR::SHADER::COMPILATION_FAILED\n" << infoLog << std::endl;
+        }
+    }
+
+    GLuint loadBinary(uint64_t key)
+    {
+        if (!hasBinaryCache())
+            return 0;
+        std::ifstream file(binaryPath(key), std::ios::binary);
+        progcache::FileHeader header;
+        if (!file || !file.read((char*)&header, sizeof(header)))
+            return 0;
+        if (std::memcmp(header.magic, progcache::MAGIC, 4) != 0 || header.version != progcache::VERSION ||
+            header.key != key || header.length == 0)
+            return 0;
+        std::vector<char> data(header.length);
+        if (!file.read(data.data(), data.size()))
+            return 0;
+
+        GLuint program = glCreateProgram();
+        glext.programBinary(program, header.format, data.data(), (GLsizei)data.size());
+        GLint success = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void saveBinary(uint64_t key, GLuint program)
+    {
+        if (!hasBinaryCache() || !glext.getProgramBinary)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+
+        std::vector<char> data(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        glext.getProgramBinary(program, length, &written, &format, data.data());
+        if (written <= 0)
+            return;
+
+        progcache::FileHeader header;
+        std::memcpy(header.magic, progcache::MAGIC, 4);
+        header.version = progcache::VERSION;
+        header.format = format;
+        header.length = (uint32_t)written;
+        header.key = key;
+
+        std::string path = binaryPath(key);
+        std::ofstream file(path, std::ios::binary);
+        file.write((const char*)&header, sizeof(header));
+        file.write(data.data(), written);
+        if (!file)
+            std::cerr << "No se pudo guardar el binario del shader: " << path << std::endl;
+    }
+};
+
+#endif
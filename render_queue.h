@@ -0,0 +1,424 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+// Cola de dibujo ordenada por claves de 64 bits.
+//
+// Cada fotograma se envían DrawItems en cualquier orden; flush() construye una
+// clave por envío, las ordena con radix sort y dibuja cambiando solo el estado
+// que difiere del dibujo anterior. Los opacos se agrupan por programa, textura
+// y VAO (y de delante hacia atrás dentro de cada grupo); los transparentes van
+// después, de atrás hacia delante y sin escribir profundidad.
+//
+//   opaco:        | pase 2 | programa 8 | textura 14 | VAO 14 | profundidad 24 |
+//   transparente: | pase 2 | ~profundidad 24 | programa 8 | textura 14 | VAO 14 |
+//
+// Los uniforms por programa (view, projection, luces...) se fijan antes del
+// flush(); la cola solo escribe "model" en cada dibujo.
+//
+// Con una pasada previa de profundidad (flushDepth() antes de flush()), los
+// opacos con depthProgram se dibujan primero solo en profundidad, de delante
+// hacia atrás dentro de cada programa y con el VAO de solo posiciones de
+// setDepthVao(); después flush() los dibuja con GL_EQUAL y cada píxel se
+// sombrea una vez. Los dos programas deben calcular gl_Position igual
+// (invariant).
+//
+// Con enableIndirect(), los tramos consecutivos de dibujos "batchable" con el
+// mismo estado se emiten en un único glMultiDrawElementsIndirect: comandos y
+// matrices se escriben en el StreamBuffer y el programa lee la matriz como
+// atributo por instancia (ver MeshArena).
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_arena.h"
+#include "stream_buffer.h"
+
+enum RenderPass
+{
+    PASS_OPAQUE = 0,
+    PASS_TRANSPARENT = 1
+};
+
+struct DrawItem
+{
+    RenderPass pass = PASS_OPAQUE;
+    GLuint program = 0;
+    GLuint texture = 0; // 0: sin textura
+    GLuint vao = 0;
+    GLenum mode = GL_TRIANGLES;
+    bool indexed = true;
+    GLint first = 0;    // primer vértice, o primer índice si indexed
+    GLsizei count = 0;
+    GLint baseVertex = 0;
+    bool batchable = false; // el programa lee "model" por instancia
+    GLuint depthProgram = 0; // pasada previa de profundidad (solo opacos); 0: no entra
+    glm::mat4x4 model = glm::mat4x4(1.0f);
+    float depth = 0.0f; // distancia a la cámara
+};
+
+struct RenderStats
+{
+    unsigned draws = 0;
+    unsigned apiCalls = 0; // llamadas de dibujo reales (un multi-draw cuenta una)
+    unsigned programChanges = 0, programChangesAvoided = 0;
+    unsigned textureChanges = 0, textureChangesAvoided = 0;
+    unsigned vaoChanges = 0, vaoChangesAvoided = 0;
+    unsigned depthDraws = 0; // de la pasada previa, incluidos en draws
+
+    void add(const RenderStats& other)
+    {
+        draws += other.draws;
+        depthDraws += other.depthDraws;
+        apiCalls += other.apiCalls;
+        programChanges += other.programChanges;
+        programChangesAvoided += other.programChangesAvoided;
+        textureChanges += other.textureChanges;
+        textureChangesAvoided += other.textureChangesAvoided;
+        vaoChanges += other.vaoChanges;
+        vaoChangesAvoided += other.vaoChangesAvoided;
+    }
+};
+
+class RenderQueue
+{
+public:
+    // Distancia a partir de la cual la profundidad de la clave se satura
+    void setDepthRange(float _maxDepth)
+    {
+        maxDepth = _maxDepth;
+    }
+
+    // Solo si glext.multiDrawElementsIndirect está disponible
+    void enableIndirect(StreamBuffer* _indirectBuffer)
+    {
+        indirectBuffer = _indirectBuffer;
+    }
+
+    bool isIndirect() const
+    {
+        return indirectBuffer != nullptr;
+    }
+
+    // En la pasada previa, los dibujos con vao usan depthVao (solo posiciones, ver
+    // MeshArena::createDepthVao()); sin coordenadas de textura, tampoco textura
+    void setDepthVao(GLuint vao, GLuint depthVao)
+    {
+        depthVaos[vao] = depthVao;
+    }
+
+    void submit(const DrawItem& item)
+    {
+        items.push_back(item);
+    }
+
+    // Pasada previa de solo profundidad, antes de flush() y con la escritura de
+    // color ya desactivada por quien llama
+    void flushDepth()
+    {
+        sortKeys(items, entries);
+        depthItems.clear();
+        for (const SortEntry& entry : entries)
+        {
+            const DrawItem& item = items[entry.index];
+            if (item.pass != PASS_OPAQUE || item.depthProgram == 0)
+                continue;
+            DrawItem depthItem = item;
+            depthItem.program = item.depthProgram;
+            depthItem.depthProgram = 0;
+            auto found = depthVaos.find(item.vao);
+            if (found != depthVaos.end())
+            {
+                depthItem.vao = found->second;
+                depthItem.texture = 0;
+            }
+            depthItems.push_back(depthItem);
+        }
+        sortKeys(depthItems, depthEntries);
+
+        frameStats = RenderStats();
+        drawEntries(depthItems, depthEntries);
+        frameStats.depthDraws = frameStats.draws;
+        sorted = true;
+    }
+
+    void flush()
+    {
+        if (!sorted)
+        {
+            sortKeys(items, entries);
+            frameStats = RenderStats();
+        }
+        drawEntries(items, entries);
+
+        totalStats.add(frameStats);
+        ++frames;
+        items.clear();
+        sorted = false;
+    }
+
+    const RenderStats& getFrameStats() const
+    {
+        return frameStats;
+    }
+
+    const RenderStats& getTotalStats() const
+    {
+        return totalStats;
+    }
+
+    unsigned getFrameCount() const
+    {
+        return frames;
+    }
+
+private:
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    std::vector<DrawItem> items;
+    std::vector<SortEntry> entries, scratch;
+    float maxDepth = 1000.0f;
+    StreamBuffer* indirectBuffer = nullptr;
+    bool skipWarned = false;
+
+    // Nombres de OpenGL -> identificadores pequeños y estables para la clave
+    std::unordered_map<GLuint, uint32_t> programIds, textureIds, vaoIds;
+    std::unordered_map<GLuint, GLint> modelLocations;
+
+    RenderStats frameStats, totalStats;
+    unsigned frames = 0;
+
+    // La pasada previa: copias de los opacos con su programa y VAO de profundidad
+    std::vector<DrawItem> depthItems;
+    std::vector<SortEntry> depthEntries;
+    std::unordered_map<GLuint, GLuint> depthVaos;
+    bool sorted = false; // flushDepth() ya ordenó este fotograma
+
+    // Dibuja source en el orden de list cambiando solo el estado que difiere
+    void drawEntries(const std::vector<DrawItem>& source, const std::vector<SortEntry>& list)
+    {
+        GLuint currentProgram = 0, currentTexture = 0, currentVao = 0;
+        GLint modelLocation = -1;
+        bool transparentPass = false, depthEqual = false;
+
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            const DrawItem& item = source[list[i].index];
+
+            if (item.pass == PASS_TRANSPARENT && !transparentPass)
+            {
+                glDepthMask(GL_FALSE);
+                transparentPass = true;
+            }
+
+            // Lo que ya está en la profundidad solo se sombrea donde es visible
+            bool equal = item.pass == PASS_OPAQUE && item.depthProgram != 0;
+            if (equal != depthEqual)
+            {
+                glDepthFunc(equal ? GL_EQUAL : GL_LESS);
+                glDepthMask(equal || transparentPass ? GL_FALSE : GL_TRUE);
+                depthEqual = equal;
+            }
+
+            if (item.program != currentProgram)
+            {
+                glUseProgram(item.program);
+                currentProgram = item.program;
+                modelLocation = uniformLocation(item.program);
+                ++frameStats.programChanges;
+            }
+            else
+                ++frameStats.programChangesAvoided;
+
+            if (item.texture != 0)
+            {
+                if (item.texture != currentTexture)
+                {
+                    glBindTexture(GL_TEXTURE_2D, item.texture);
+                    currentTexture = item.texture;
+                    ++frameStats.textureChanges;
+                }
+                else
+                    ++frameStats.textureChangesAvoided;
+            }
+
+            if (item.vao != currentVao)
+            {
+                glBindVertexArray(item.vao);
+                currentVao = item.vao;
+                ++frameStats.vaoChanges;
+            }
+            else
+                ++frameStats.vaoChangesAvoided;
+
+            if (indirectBuffer && item.batchable)
+            {
+                size_t run = batchLength(source, list, i);
+                if (drawIndirect(source, list, i, run))
+                {
+                    i += run - 1;
+                    continue;
+                }
+                // El programa lee la matriz por instancia, no del uniform model
+                drawSingleInstance(item);
+                continue;
+            }
+
+            glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(item.model));
+            if (item.indexed)
+                glDrawElementsBaseVertex(item.mode, item.count, GL_UNSIGNED_INT, (void*)(item.first * sizeof(GLuint)), item.baseVertex);
+            else
+                glDrawArrays(item.mode, item.first, item.count);
+            ++frameStats.draws;
+            ++frameStats.apiCalls;
+        }
+
+        if (depthEqual)
+            glDepthFunc(GL_LESS);
+        if (transparentPass || depthEqual)
+            glDepthMask(GL_TRUE);
+        glBindVertexArray(0);
+    }
+
+    static uint32_t denseId(std::unordered_map<GLuint, uint32_t>& ids, GLuint name, uint32_t mask)
+    {
+        auto found = ids.find(name);
+        if (found != ids.end())
+            return found->second;
+        uint32_t id = (uint32_t)ids.size() & mask;
+        ids[name] = id;
+        return id;
+    }
+
+    // Dibujos consecutivos (ya ordenados) que comparten todo el estado
+    size_t batchLength(const std::vector<DrawItem>& source, const std::vector<SortEntry>& list, size_t start) const
+    {
+        const DrawItem& first = source[list[start].index];
+        size_t end = start + 1;
+        while (end < list.size())
+        {
+            const DrawItem& item = source[list[end].index];
+            if (!item.batchable || !item.indexed || item.pass != first.pass || item.program != first.program ||
+                item.texture != first.texture || item.vao != first.vao || item.mode != first.mode ||
+                (item.depthProgram != 0) != (first.depthProgram != 0))
+                break;
+            ++end;
+        }
+        return end - start;
+    }
+
+    bool drawIndirect(const std::vector<DrawItem>& source, const std::vector<SortEntry>& list, size_t start, size_t run)
+    {
+        StreamBuffer::Allocation commands = indirectBuffer->allocate(run * sizeof(DrawElementsIndirectCommand), 4);
+        StreamBuffer::Allocation matrices = indirectBuffer->allocate(run * sizeof(glm::mat4x4), sizeof(glm::mat4x4));
+        if (!commands.data || !matrices.data)
+            return false;
+
+        DrawElementsIndirectCommand* command = (DrawElementsIndirectCommand*)commands.data;
+        unsigned char* matrix = (unsigned char*)matrices.data;
+        GLuint baseInstance = (GLuint)(matrices.offset / sizeof(glm::mat4x4));
+        for (size_t k = 0; k < run; ++k)
+        {
+            const DrawItem& item = source[list[start + k].index];
+            command[k] = DrawElementsIndirectCommand{ (GLuint)item.count, 1, (GLuint)item.first, item.baseVertex, baseInstance + (GLuint)k };
+            std::memcpy(matrix + k * sizeof(glm::mat4x4), glm::value_ptr(item.model), sizeof(glm::mat4x4));
+        }
+        indirectBuffer->commit();
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer->getBuffer());
+        glext.multiDrawElementsIndirect(source[list[start].index].mode, GL_UNSIGNED_INT, (void*)commands.offset, (GLsizei)run, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        frameStats.draws += (unsigned)run;
+        ++frameStats.apiCalls;
+        return true;
+    }
+
+    // Si no cupo el tramo: la matriz sola y un dibujo con su baseInstance
+    void drawSingleInstance(const DrawItem& item)
+    {
+        StreamBuffer::Allocation matrix = indirectBuffer->allocate(sizeof(glm::mat4x4), sizeof(glm::mat4x4));
+        if (!matrix.data)
+        {
+            if (!skipWarned)
+                std::cerr << "RenderQueue: sin espacio para la matriz, se omiten dibujos" << std::endl;
+            skipWarned = true;
+            return;
+        }
+        std::memcpy(matrix.data, glm::value_ptr(item.model), sizeof(glm::mat4x4));
+        indirectBuffer->commit();
+
+        glext.drawElementsInstancedBaseVertexBaseInstance(item.mode, item.count, GL_UNSIGNED_INT, (void*)(item.first * sizeof(GLuint)), 1,
+            item.baseVertex, (GLuint)(matrix.offset / sizeof(glm::mat4x4)));
+        ++frameStats.draws;
+        ++frameStats.apiCalls;
+    }
+
+    GLint uniformLocation(GLuint program)
+    {
+        auto found = modelLocations.find(program);
+        if (found != modelLocations.end())
+            return found->second;
+        GLint location = glGetUniformLocation(program, "model");
+        modelLocations[program] = location;
+        return location;
+    }
+
+    uint64_t buildKey(const DrawItem& item)
+    {
+        uint64_t program = denseId(programIds, item.program, 0xFF);
+        uint64_t texture = denseId(textureIds, item.texture, 0x3FFF);
+        uint64_t vao = denseId(vaoIds, item.vao, 0x3FFF);
+        float normalized = item.depth / maxDepth;
+        normalized = normalized < 0.0f ? 0.0f : (normalized > 1.0f ? 1.0f : normalized);
+        uint64_t depth = (uint64_t)(normalized * 0xFFFFFF);
+        uint64_t state = (program << 28) | (texture << 14) | vao;
+
+        if (item.pass == PASS_TRANSPARENT)
+            return (uint64_t(PASS_TRANSPARENT) << 62) | ((0xFFFFFF - depth) << 36) | state;
+        return (uint64_t(PASS_OPAQUE) << 62) | (state << 24) | depth;
+    }
+
+    // LSD radix sort de 8 bits; se saltan los bytes que son iguales en todas las claves
+    void sortKeys(const std::vector<DrawItem>& source, std::vector<SortEntry>& list)
+    {
+        list.resize(source.size());
+        for (size_t i = 0; i < source.size(); ++i)
+            list[i] = SortEntry{ buildKey(source[i]), (uint32_t)i };
+        scratch.resize(list.size());
+
+        uint32_t histograms[8][256] = {};
+        for (const SortEntry& entry : list)
+            for (int b = 0; b < 8; ++b)
+                ++histograms[b][(entry.key >> (8 * b)) & 0xFF];
+
+        for (int b = 0; b < 8; ++b)
+        {
+            uint32_t* histogram = histograms[b];
+            bool trivial = false;
+            for (int v = 0; v < 256 && !trivial; ++v)
+                trivial = histogram[v] == list.size();
+            if (trivial)
+                continue;
+
+            uint32_t offset = 0;
+            for (int v = 0; v < 256; ++v)
+            {
+                uint32_t count = histogram[v];
+                histogram[v] = offset;
+                offset += count;
+            }
+            for (const SortEntry& entry : list)
+                scratch[histogram[(entry.key >> (8 * b)) & 0xFF]++] = entry;
+            list.swap(scratch);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef SHADER_PERMUTATIONS_H
+#define SHADER_PERMUTATIONS_H
+
+// Variantes del shader de la escena.
+//
+// Los objetos, los árboles instanciados y el suelo salen de un mismo par de
+// fuentes (sceneVertexShaderSource y sceneFragmentShaderSource); cada bit de
+// ShaderFeature se convierte en un #define y el preprocesador de GLSL quita lo
+// que la variante no usa, así que cada objeto solo paga por lo que necesita
+// (el cielo no muestrea sombras). El haz y el láser van aparte (beam_effects.h).
+// depthOnly() da la variante de la pasada previa de profundidad de cada una.
+// applyShadows() y applyLights() solo se enlazan en las variantes que los usan;
+// con SHADER_GBUFFER son los de gBufferWriteShaderSource (ver DeferredRenderer).
+//
+// get() compila una variante la primera vez que se pide y después es una
+// consulta en una tabla indexada por la máscara. warmUp() pide de golpe las
+// que ya se sabe que se van a usar sin esperar al driver (ver
+// ProgramCache::requestProgram()); la primera llamada a get() recoge cada una.
+//
+// Si se recargan los shaders en caliente, applySwaps() cambia las variantes
+// por las recompiladas. Los uniforms por fotograma (view, projection, eye,
+// sombras, luces) se fijan en todas las variantes de getVariants() después de
+// la última llamada a get() del fotograma y antes de RenderQueue::flush().
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "clustered_lights.h"
+#include "deferred_renderer.h"
+#include "program_cache.h"
+#include "shadow_maps.h"
+
+enum ShaderFeature : unsigned
+{
+    SHADER_TEXTURED = 1u << 0,     // color de texture1; sin él, baseColor
+    SHADER_ALPHA_TESTED = 1u << 1, // descarta los texels con alfa < 0.5 (hojas)
+    SHADER_INSTANCED = 1u << 2,    // "model" por instancia (atributo 2) y fundido con el impostor
+    SHADER_SHADOWED = 1u << 3,     // applyShadows(): luna y foco del OVNI
+    SHADER_LIT = 1u << 4,          // applyLights(): luces del OVNI por clusters
+    SHADER_GBUFFER = 1u << 5,      // albedo y normal al G-buffer; las luces van después
+    SHADER_DEPTH_ONLY = 1u << 6,   // pasada previa de profundidad: solo los descartes
+    SHADER_FEATURE_COUNT = 7
+};
+
+// Sin bones en los modelos OBJ no hay variante con skinning
+inline const char* shaderFeatureDefines[SHADER_FEATURE_COUNT] = {
+    "TEXTURED", "ALPHA_TESTED", "INSTANCED", "SHADOWED", "LIT", "GBUFFER", "DEPTH_ONLY"
+};
+
+inline const char* sceneVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 1) in vec2 aTexCoord;
+    #ifdef INSTANCED
+    layout (location = 2) in mat4 aModel;
+
+    uniform vec3 eye;
+    uniform vec2 lodFade; // fundido con el impostor; y = 0: sin fundido
+
+    out float Fade;
+    #else
+    uniform mat4 model;
+    #endif
+
+    uniform mat4 view;
+    uniform mat4 projection;
+
+    // La misma profundidad en la pasada previa y en la de color (GL_EQUAL)
+    invariant gl_Position;
+
+    out vec2 TexCoord;
+    out vec3 FragPos;
+
+    void main()
+    {
+    #ifdef INSTANCED
+        mat4 world = aModel;
+        Fade = lodFade.y > 0.0 ? clamp((lodFade.y - length(eye - aModel[3].xyz)) / (lodFade.y - lodFade.x), 0.0, 1.0) : 1.0;
+    #else
+        mat4 world = model;
+    #endif
+        vec4 worldPos = world * vec4(aPos, 1.0);
+        gl_Position = projection * view * worldPos;
+        FragPos = worldPos.xyz;
+        TexCoord = aTexCoord;
+    }
+)glsl";
+
+inline const char* sceneFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor; // con GBUFFER, el albedo
+
+    in vec2 TexCoord;
+    in vec3 FragPos;
+    #ifdef INSTANCED
+    in float Fade;
+    #endif
+    #ifdef TEXTURED
+    uniform sampler2D texture1;
+    #else
+    uniform vec4 baseColor;
+    #endif
+    #ifdef SHADOWED
+    vec3 applyShadows(vec3 color, vec3 worldPos); // shadowSampleShaderSource
+    #endif
+    #ifdef LIT
+    vec3 applyLights(vec3 albedo, vec3 worldPos); // clusteredLightsShaderSource
+    #endif
+
+    void main()
+    {
+    #ifdef INSTANCED
+        // Tramado del fundido; el ruido es el de fadeNoise() en impostor.h
+        if (Fade < 1.0 && fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715)))) >= Fade)
+            discard;
+    #endif
+    #ifdef TEXTURED
+        vec4 albedo = texture(texture1, TexCoord);
+    #else
+        vec4 albedo = baseColor;
+    #endif
+    #ifdef ALPHA_TESTED
+        if (albedo.a < 0.5)
+            discard;
+    #endif
+    #ifdef DEPTH_ONLY
+        FragColor = vec4(0.0);
+        return;
+    #endif
+        vec3 color = albedo.rgb;
+    #ifdef SHADOWED
+        color = applyShadows(color, FragPos);
+    #endif
+    #ifdef LIT
+        color += applyLights(albedo.rgb, FragPos);
+    #endif
+        FragColor = vec4(color, albedo.a);
+    }
+)glsl";
+
+struct ShaderVariant
+{
+    unsigned features;
+    GLuint program;
+};
+
+class ShaderPermutations
+{
+public:
+    static const unsigned VARIANT_COUNT = 1u << SHADER_FEATURE_COUNT;
+
+    void init(ProgramCache& _cache)
+    {
+        cache = &_cache;
+    }
+
+    GLuint get(unsigned features)
+    {
+        features &= VARIANT_COUNT - 1;
+        GLuint& program = programs[features];
+        if (!program)
+        {
+            program = cache->getProgram(sources(features), defines(features));
+            variants.push_back({ features, program });
+        }
+        return program;
+    }
+
+    // Manda compilar las variantes sin esperar; get() las recoge al usarlas
+    void warmUp(const std::vector<unsigned>& featureSets)
+    {
+        for (unsigned features : featureSets)
+        {
+            features &= VARIANT_COUNT - 1;
+            if (!programs[features])
+                cache->requestProgram(sources(features), defines(features));
+        }
+    }
+
+    // Con lo que devuelve ProgramCache::update(), antes del primer get() del fotograma
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+            for (ShaderVariant& variant : variants)
+                if (variant.program == swap.oldProgram)
+                    variant.program = programs[variant.features] = swap.newProgram;
+    }
+
+    // Las variantes que ya se han usado, para fijarles los uniforms por fotograma
+    const std::vector<ShaderVariant>& getVariants() const { return variants; }
+
+    // La variante de la pasada previa: solo lo que cambia qué píxeles cubre
+    static unsigned depthOnly(unsigned features)
+    {
+        unsigned kept = features & (SHADER_INSTANCED | SHADER_ALPHA_TESTED);
+        if (features & SHADER_ALPHA_TESTED)
+            kept |= SHADER_TEXTURED;
+        return kept | SHADER_DEPTH_ONLY;
+    }
+
+    static std::string defines(unsigned features)
+    {
+        std::string result;
+        for (unsigned bit = 0; bit < SHADER_FEATURE_COUNT; ++bit)
+            if (features & (1u << bit))
+                result += std::string("#define ") + shaderFeatureDefines[bit] + "\n";
+        return result;
+    }
+
+private:
+    ProgramCache* cache = nullptr;
+    std::array<GLuint, VARIANT_COUNT> programs = {};
+    std::vector<ShaderVariant> variants;
+
+    static std::vector<ShaderSource> sources(unsigned features)
+    {
+        std::vector<ShaderSource> result = { { GL_VERTEX_SHADER, sceneVertexShaderSource },
+                                             { GL_FRAGMENT_SHADER, sceneFragmentShaderSource } };
+        if ((features & SHADER_GBUFFER) && (features & (SHADER_SHADOWED | SHADER_LIT)))
+        {
+            result.push_back({ GL_FRAGMENT_SHADER, gBufferWriteShaderSource, true });
+            return result;
+        }
+        if (features & SHADER_SHADOWED)
+            result.push_back({ GL_FRAGMENT_SHADER, shadowSampleShaderSource, true });
+        if (features & SHADER_LIT)
+            result.push_back({ GL_FRAGMENT_SHADER, clusteredLightsShaderSource, true });
+        return result;
+    }
+};
+
+#endif
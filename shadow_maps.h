@@ -0,0 +1,554 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+// Sombras de la luna (luz direccional, con cascadas) y del foco del OVNI.
+//
+// La distancia de sombra de la cámara (hasta SHADOW_DISTANCE) se parte en
+// CASCADE_COUNT tramos, entre el reparto logarítmico y el uniforme. Cada
+// cascada es una proyección ortográfica desde la luna que encierra la esfera de
+// su tramo; el radio solo depende del reparto y el centro se ajusta a la
+// rejilla de texels, así que las sombras no tiemblan al mover la cámara. Hacia
+// la luna la caja se alarga CASTER_DEPTH para que también proyecten los objetos
+// que quedan fuera del tramo. El foco del OVNI es una proyección en perspectiva
+// desde el vértice del cono y solo se dibuja mientras el cono está encendido.
+//
+// Coste: las pasadas son de solo profundidad, con el VAO de posiciones de
+// MeshArena::createDepthVao() y un fragment shader vacío. Cada capa descarta
+// por CPU contra su propio volumen y dibuja un glDrawElementsInstanced por
+// malla con las matrices en el StreamBuffer; la última cascada (la que más
+// ocupa y menos cambia) se redibuja uno de cada FAR_CASCADE_INTERVAL
+// fotogramas. getGpuMilliseconds() mide las pasadas con GL_TIME_ELAPSED.
+//
+// Los receptores enlazan shadowSampleShaderSource junto a su fragment shader, que solo
+// declara vec3 applyShadows(vec3 color, vec3 worldPos), y cada fotograma
+// bindReceiver() les da las matrices y las texturas (unidades CASCADE_UNIT y
+// SPOT_UNIT). Sin init(), applyShadows() devuelve el color tal cual.
+//
+// Uso por fotograma: addDynamicCaster() y setSpot()/disableSpot(), update()
+// antes de StreamBuffer::commit() y render() después, antes de los receptores.
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "gpu_culling.h"
+#include "mesh_arena.h"
+#include "program_cache.h"
+#include "stream_buffer.h"
+
+inline const char* shadowDepthVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+    layout (location = 2) in mat4 aModel;
+
+    uniform mat4 lightViewProj;
+
+    void main()
+    {
+        gl_Position = lightViewProj * aModel * vec4(aPos, 1.0);
+    }
+)glsl";
+
+inline const char* shadowDepthFragmentShaderSource = R"glsl(
+    #version 330 core
+
+    void main()
+    {
+    }
+)glsl";
+
+// El fragment shader con applyShadows(); no necesita init(), así los receptores
+// enlazan igual con las sombras desactivadas. Los arrays admiten hasta 4 cascadas
+inline const char* shadowSampleShaderSource = R"glsl(
+    #version 330 core
+    uniform sampler2DArrayShadow cascadeMaps;
+    uniform sampler2DShadow spotMap;
+    uniform int cascadeCount; // 0: sin sombras
+    uniform mat4 cascadeViewProj[4];
+    uniform vec4 cascadeSplits; // fin de cada cascada en profundidad de la vista
+    uniform vec4 cascadeBias;
+    uniform mat4 shadowView;
+    uniform float shadowStrength;
+
+    uniform bool spotEnabled;
+    uniform mat4 spotViewProj;
+    uniform vec3 spotPosition;
+    uniform vec3 spotDirection;
+    uniform vec3 spotColor;
+    uniform vec3 spotCone; // coseno del borde exterior, del interior y alcance
+
+    float cascadeLight(int cascade, vec3 worldPos)
+    {
+        vec3 coord = (cascadeViewProj[cascade] * vec4(worldPos, 1.0)).xyz * 0.5 + 0.5;
+        vec2 texel = 1.0 / vec2(textureSize(cascadeMaps, 0).xy);
+        // Cuatro muestras con comparación bilineal: PCF sobre 3x3 texels
+        float light = 0.0;
+        for (int i = 0; i < 4; ++i)
+            light += texture(cascadeMaps, vec4(coord.xy + (vec2(i & 1, i >> 1) - 0.5) * texel, float(cascade), coord.z - cascadeBias[cascade]));
+        return light * 0.25;
+    }
+
+    float spotLight(vec3 worldPos)
+    {
+        vec3 toPoint = worldPos - spotPosition;
+        float distance = length(toPoint);
+        float cone = smoothstep(spotCone.x, spotCone.y, dot(toPoint / distance, spotDirection));
+        cone *= 1.0 - smoothstep(0.8 * spotCone.z, spotCone.z, distance);
+        if (cone <= 0.0)
+            return 0.0;
+        vec4 coord = spotViewProj * vec4(worldPos, 1.0);
+        coord.xyz = coord.xyz / coord.w * 0.5 + 0.5;
+        return cone * texture(spotMap, vec3(coord.xy, coord.z - 0.0005));
+    }
+
+    vec3 applyShadows(vec3 color, vec3 worldPos)
+    {
+        if (cascadeCount == 0)
+            return color;
+
+        float depth = -(shadowView * vec4(worldPos, 1.0)).z;
+        float light = 1.0;
+        for (int i = 0; i < cascadeCount; ++i)
+        {
+            if (depth < cascadeSplits[i])
+            {
+                light = cascadeLight(i, worldPos);
+                break;
+            }
+        }
+        // Al final de la última cascada la sombra se desvanece en lugar de cortarse
+        float end = cascadeSplits[cascadeCount - 1];
+        light = mix(light, 1.0, smoothstep(0.8 * end, end, depth));
+
+        vec3 result = color * mix(1.0 - shadowStrength, 1.0, light);
+        if (spotEnabled)
+            result += color * spotColor * spotLight(worldPos);
+        return result;
+    }
+)glsl";
+
+class ShadowMaps
+{
+public:
+    static const int CASCADE_COUNT = 3;                // hasta 4, el tamaño de los arrays del shader
+    static const int CASCADE_SIZE = 2048;
+    static const int SPOT_SIZE = 1024;
+    static constexpr float SHADOW_DISTANCE = 200.0f;   // más allá la luna no da sombra
+    static constexpr float SPLIT_LAMBDA = 0.75f;       // 1: reparto logarítmico, 0: uniforme
+    static constexpr float CASTER_DEPTH = 400.0f;      // alargamiento de cada cascada hacia la luna
+    static constexpr float SPOT_NEAR = 1.0f;
+    static const int FAR_CASCADE_INTERVAL = 2;
+    static const int CASCADE_UNIT = 6;
+    static const int SPOT_UNIT = 7;
+    static const int TIMER_COUNT = 3;                  // consultas en vuelo: se leen con retraso
+
+    // Tras MeshArena::upload(); las matrices por instancia se escriben en instanceBuffer
+    void init(ProgramCache& cache, const MeshArena& arena, GLuint _instanceBuffer)
+    {
+        instanceBuffer = _instanceBuffer;
+
+        glGenTextures(1, &cascadeTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cascadeTexture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, CASCADE_SIZE, CASCADE_SIZE, CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        setShadowParameters(GL_TEXTURE_2D_ARRAY);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        glGenTextures(1, &spotTexture);
+        glBindTexture(GL_TEXTURE_2D, spotTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, SPOT_SIZE, SPOT_SIZE, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        setShadowParameters(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeTexture, 0, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Error: el framebuffer de las sombras no está completo" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        vao = arena.createDepthVao(instanceBuffer);
+        program = cache.getProgram({ { GL_VERTEX_SHADER, shadowDepthVertexShaderSource },
+                                     { GL_FRAGMENT_SHADER, shadowDepthFragmentShaderSource } });
+        glGenQueries(TIMER_COUNT, timers);
+
+        for (int cascade = 0; cascade < 4; ++cascade)
+            splits[cascade] = SHADOW_DISTANCE;
+        initialized = true;
+        std::cout << "Sombras: " << CASCADE_COUNT << " cascadas de " << CASCADE_SIZE << "x" << CASCADE_SIZE
+                  << " y foco de " << SPOT_SIZE << "x" << SPOT_SIZE << std::endl;
+    }
+
+    void destroy()
+    {
+        if (initialized) glDeleteQueries(TIMER_COUNT, timers);
+        if (cascadeTexture) glDeleteTextures(1, &cascadeTexture);
+        if (spotTexture) glDeleteTextures(1, &spotTexture);
+        if (fbo) glDeleteFramebuffers(1, &fbo);
+        if (vao) glDeleteVertexArrays(1, &vao);
+        // El programa es de ProgramCache
+        cascadeTexture = spotTexture = fbo = vao = program = 0;
+        initialized = false;
+    }
+
+    // Para instancias que no se mueven
+    void addCaster(const MeshRange& range, const glm::mat4x4& model, const glm::vec3& center, float radius)
+    {
+        casters.push_back(Caster{ findRange(range), model, glm::vec4(center, radius), true });
+    }
+
+    // Solo para el próximo update(); spot: si también tapa el foco (el propio OVNI no)
+    void addDynamicCaster(const MeshRange& range, const glm::mat4x4& model, const glm::vec3& center, float radius, bool spot)
+    {
+        frameCasters.push_back(Caster{ findRange(range), model, glm::vec4(center, radius), spot });
+    }
+
+    // Dirección en la que viaja la luz
+    void setMoonDirection(const glm::vec3& direction, float strength)
+    {
+        moonDirection = glm::normalize(direction);
+        shadowStrength = strength;
+    }
+
+    // angle: semiángulo del cono; range: hasta dónde llega la luz
+    void setSpot(const glm::vec3& position, const glm::vec3& direction, float angle, float range, const glm::vec3& color)
+    {
+        spotEnabled = true;
+        spotPosition = position;
+        spotDirection = glm::normalize(direction);
+        spotColor = color;
+        spotCone = glm::vec3(std::cos(angle), std::cos(angle * 0.8f), range);
+
+        glm::vec3 up = std::abs(spotDirection.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+        spotViewProj = glm::perspective(2.0f * angle * 1.1f, 1.0f, SPOT_NEAR, range) *
+                       glm::lookAt(spotPosition, spotPosition + spotDirection, up);
+    }
+
+    void disableSpot()
+    {
+        spotEnabled = false;
+    }
+
+    // El foco del último setSpot(), para dibujarlo como volumen de luz (DeferredRenderer)
+    bool isSpotEnabled() const { return initialized && spotEnabled; }
+    const glm::vec3& getSpotPosition() const { return spotPosition; }
+    const glm::vec3& getSpotDirection() const { return spotDirection; }
+    const glm::vec3& getSpotCone() const { return spotCone; } // cosenos de los bordes y alcance
+
+    // Antes de StreamBuffer::commit(): ajusta las cascadas a la cámara, descarta los
+    // objetos por capa y escribe sus matrices
+    void update(const glm::mat4x4& view, const glm::mat4x4& proj, StreamBuffer& stream)
+    {
+        batches.clear();
+        casterCount = 0;
+        if (!initialized)
+        {
+            frameCasters.clear();
+            return;
+        }
+
+        cameraView = view;
+        glm::mat4x4 inverseView = glm::inverse(view);
+        glm::vec2 tanHalf(1.0f / proj[0][0], 1.0f / proj[1][1]);
+        float near = proj[3][2] / (proj[2][2] - 1.0f);
+        float far = glm::min(proj[3][2] / (proj[2][2] + 1.0f), SHADOW_DISTANCE);
+
+        glm::vec3 up = std::abs(moonDirection.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+        glm::mat4x4 lightView = glm::lookAt(glm::vec3(0.0f), moonDirection, up);
+
+        float splitNear = near;
+        for (int cascade = 0; cascade < CASCADE_COUNT; ++cascade)
+        {
+            float ratio = float(cascade + 1) / CASCADE_COUNT;
+            float splitFar = SPLIT_LAMBDA * near * std::pow(far / near, ratio) + (1.0f - SPLIT_LAMBDA) * (near + (far - near) * ratio);
+
+            refreshed[cascade] = !rendered[cascade] || cascade < CASCADE_COUNT - 1 || frame % FAR_CASCADE_INTERVAL == 0;
+            if (refreshed[cascade])
+            {
+                // Se guarda todo lo de la cascada: si no se redibuja, se sigue leyendo con lo de entonces
+                splits[cascade] = splitFar;
+                cascadeViewProj[cascade] = fitCascade(inverseView, lightView, tanHalf, splitNear, splitFar, cascadeBias[cascade]);
+                addBatches(cascade, cascadeViewProj[cascade], stream);
+                rendered[cascade] = true;
+            }
+            splitNear = splitFar;
+        }
+
+        refreshed[CASCADE_COUNT] = spotEnabled;
+        if (spotEnabled)
+            addBatches(CASCADE_COUNT, spotViewProj, stream);
+
+        frameCasters.clear();
+        ++frame;
+    }
+
+    // Tras StreamBuffer::commit() y antes de dibujar los receptores
+    void render()
+    {
+        if (!initialized)
+            return;
+
+        readTimer();
+        glBeginQuery(GL_TIME_ELAPSED, timers[timerIndex]);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glEnable(GL_DEPTH_TEST);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glUseProgram(program);
+        GLint lightViewProjLocation = glGetUniformLocation(program, "lightViewProj");
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int layer = 0; layer <= CASCADE_COUNT; ++layer)
+        {
+            if (!refreshed[layer])
+                continue;
+
+            if (layer < CASCADE_COUNT)
+            {
+                glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, cascadeTexture, 0, layer);
+                glViewport(0, 0, CASCADE_SIZE, CASCADE_SIZE);
+                glUniformMatrix4fv(lightViewProjLocation, 1, GL_FALSE, glm::value_ptr(cascadeViewProj[layer]));
+            }
+            else
+            {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, spotTexture, 0);
+                glViewport(0, 0, SPOT_SIZE, SPOT_SIZE);
+                glUniformMatrix4fv(lightViewProjLocation, 1, GL_FALSE, glm::value_ptr(spotViewProj));
+            }
+            glClear(GL_DEPTH_BUFFER_BIT);
+
+            for (const Batch& batch : batches)
+            {
+                if (batch.layer != layer)
+                    continue;
+                for (int column = 0; column < 4; ++column)
+                    glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4x4), (void*)(batch.offset + column * sizeof(glm::vec4)));
+                const MeshRange& range = ranges[batch.range];
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                    (void*)(range.firstIndex * sizeof(GLuint)), batch.count, range.baseVertex);
+            }
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        if (!depthTest) glDisable(GL_DEPTH_TEST);
+
+        glEndQuery(GL_TIME_ELAPSED);
+        timerPending[timerIndex] = true;
+        timerIndex = (timerIndex + 1) % TIMER_COUNT;
+    }
+
+    // Uniforms y texturas de applyShadows() para un programa receptor (lo deja en uso)
+    void bindReceiver(GLuint receiver) const
+    {
+        glUseProgram(receiver);
+        glUniform1i(glGetUniformLocation(receiver, "cascadeMaps"), CASCADE_UNIT);
+        glUniform1i(glGetUniformLocation(receiver, "spotMap"), SPOT_UNIT);
+        glUniform1i(glGetUniformLocation(receiver, "cascadeCount"), initialized ? CASCADE_COUNT : 0);
+        if (!initialized)
+            return;
+
+        glUniformMatrix4fv(glGetUniformLocation(receiver, "cascadeViewProj"), CASCADE_COUNT, GL_FALSE, glm::value_ptr(cascadeViewProj[0]));
+        glUniform4fv(glGetUniformLocation(receiver, "cascadeSplits"), 1, splits);
+        glUniform4fv(glGetUniformLocation(receiver, "cascadeBias"), 1, cascadeBias);
+        glUniformMatrix4fv(glGetUniformLocation(receiver, "shadowView"), 1, GL_FALSE, glm::value_ptr(cameraView));
+        glUniform1f(glGetUniformLocation(receiver, "shadowStrength"), shadowStrength);
+        glUniform1i(glGetUniformLocation(receiver, "spotEnabled"), spotEnabled);
+        glUniformMatrix4fv(glGetUniformLocation(receiver, "spotViewProj"), 1, GL_FALSE, glm::value_ptr(spotViewProj));
+        glUniform3fv(glGetUniformLocation(receiver, "spotPosition"), 1, glm::value_ptr(spotPosition));
+        glUniform3fv(glGetUniformLocation(receiver, "spotDirection"), 1, glm::value_ptr(spotDirection));
+        glUniform3fv(glGetUniformLocation(receiver, "spotColor"), 1, glm::value_ptr(spotColor));
+        glUniform3fv(glGetUniformLocation(receiver, "spotCone"), 1, glm::value_ptr(spotCone));
+
+        glActiveTexture(GL_TEXTURE0 + CASCADE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, cascadeTexture);
+        glActiveTexture(GL_TEXTURE0 + SPOT_UNIT);
+        glBindTexture(GL_TEXTURE_2D, spotTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Instancias dibujadas en todas las capas del último update()
+    unsigned getCasterCount() const
+    {
+        return casterCount;
+    }
+
+    // Media de las pasadas de sombra medidas hasta ahora
+    double getGpuMilliseconds() const
+    {
+        return timedFrames > 0 ? double(gpuNanoseconds) / timedFrames * 1e-6 : 0.0;
+    }
+
+    // El programa de profundidad es de ProgramCache y puede recargarse
+    void applySwaps(const std::vector<ProgramSwap>& swaps)
+    {
+        for (const ProgramSwap& swap : swaps)
+            if (program == swap.oldProgram)
+                program = swap.newProgram;
+    }
+
+private:
+    struct Caster
+    {
+        int range;         // índice en ranges
+        glm::mat4x4 model;
+        glm::vec4 sphere;  // centro y radio en el mundo
+        bool spot;
+    };
+
+    // Instancias consecutivas de una malla en el StreamBuffer para una capa
+    struct Batch
+    {
+        int layer;         // CASCADE_COUNT: el foco
+        int range;
+        GLintptr offset;
+        GLsizei count;
+    };
+
+    std::vector<MeshRange> ranges;
+    std::vector<Caster> casters, frameCasters;
+    std::vector<std::vector<glm::mat4x4>> visible; // por malla, reutilizado entre capas
+    std::vector<Batch> batches;
+    unsigned casterCount = 0;
+
+    glm::vec3 moonDirection = glm::normalize(glm::vec3(-0.35f, -1.0f, -0.45f));
+    float shadowStrength = 0.5f;
+    glm::mat4x4 cameraView = glm::mat4x4(1.0f);
+    glm::mat4x4 cascadeViewProj[CASCADE_COUNT];
+    float splits[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float cascadeBias[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    bool rendered[CASCADE_COUNT] = {};
+    bool refreshed[CASCADE_COUNT + 1] = {};
+    unsigned frame = 0;
+
+    bool spotEnabled = false;
+    glm::vec3 spotPosition = glm::vec3(0.0f), spotDirection = glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec3 spotColor = glm::vec3(1.0f), spotCone = glm::vec3(0.0f);
+    glm::mat4x4 spotViewProj = glm::mat4x4(1.0f);
+
+    bool initialized = false;
+    GLuint cascadeTexture = 0, spotTexture = 0, fbo = 0, vao = 0;
+    GLuint program = 0;
+    GLuint instanceBuffer = 0;
+
+    GLuint timers[TIMER_COUNT] = {};
+    bool timerPending[TIMER_COUNT] = {};
+    int timerIndex = 0;
+    GLuint64 gpuNanoseconds = 0;
+    unsigned timedFrames = 0;
+
+    int findRange(const MeshRange& range)
+    {
+        for (size_t i = 0; i < ranges.size(); ++i)
+            if (ranges[i].firstIndex == range.firstIndex && ranges[i].baseVertex == range.baseVertex)
+                return (int)i;
+        ranges.push_back(range);
+        visible.resize(ranges.size());
+        return (int)ranges.size() - 1;
+    }
+
+    // Ortográfica desde la luna que encierra la esfera del tramo [splitNear, splitFar]
+    static glm::mat4x4 fitCascade(const glm::mat4x4& inverseView, const glm::mat4x4& lightView, const glm::vec2& tanHalf,
+                                  float splitNear, float splitFar, float& bias)
+    {
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int i = 0; i < 8; ++i)
+        {
+            float depth = i < 4 ? splitNear : splitFar;
+            corners[i] = glm::vec3((i & 1 ? 1.0f : -1.0f) * tanHalf.x * depth, (i & 2 ? 1.0f : -1.0f) * tanHalf.y * depth, -depth);
+            center += corners[i] * 0.125f;
+        }
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners)
+            radius = glm::max(radius, glm::length(corner - center));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // El centro, en el espacio de la luna, avanza de texel en texel
+        float texelSize = 2.0f * radius / CASCADE_SIZE;
+        glm::vec3 lightCenter = glm::vec3(lightView * inverseView * glm::vec4(center, 1.0f));
+        lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+        lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+        // Profundidad de 0 a 1 sobre 2 * radius + CASTER_DEPTH: el sesgo es un texel y medio
+        float nearPlane = -lightCenter.z - radius - CASTER_DEPTH, farPlane = -lightCenter.z + radius;
+        bias = 1.5f * texelSize / (farPlane - nearPlane);
+        return glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius, lightCenter.y + radius, nearPlane, farPlane) * lightView;
+    }
+
+    void addBatches(int layer, const glm::mat4x4& viewProj, StreamBuffer& stream)
+    {
+        glm::vec4 planes[6];
+        GpuCuller::extractPlanes(viewProj, planes);
+
+        for (std::vector<glm::mat4x4>& models : visible)
+            models.clear();
+        for (const std::vector<Caster>* list : { &casters, &frameCasters })
+            for (const Caster& caster : *list)
+                if ((layer < CASCADE_COUNT || caster.spot) && caster.sphere.w > 0.0f && inFrustum(caster.sphere, planes))
+                    visible[caster.range].push_back(caster.model);
+
+        for (size_t range = 0; range < visible.size(); ++range)
+        {
+            if (visible[range].empty())
+                continue;
+            size_t size = visible[range].size() * sizeof(glm::mat4x4);
+            StreamBuffer::Allocation data = stream.allocate(size, sizeof(glm::mat4x4));
+            if (!data.data)
+                continue;
+            memcpy(data.data, visible[range].data(), size);
+            batches.push_back(Batch{ layer, (int)range, data.offset, (GLsizei)visible[range].size() });
+            casterCount += (unsigned)visible[range].size();
+        }
+    }
+
+    static bool inFrustum(const glm::vec4& sphere, const glm::vec4 planes[6])
+    {
+        for (int i = 0; i < 6; ++i)
+            if (glm::dot(glm::vec3(planes[i]), glm::vec3(sphere)) + planes[i].w < -sphere.w)
+                return false;
+        return true;
+    }
+
+    // Sin esperar a la GPU: solo se suma la consulta más antigua si ya tiene resultado
+    void readTimer()
+    {
+        if (!timerPending[timerIndex])
+            return;
+        GLint available = 0;
+        glGetQueryObjectiv(timers[timerIndex], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timers[timerIndex], GL_QUERY_RESULT, &elapsed);
+            gpuNanoseconds += elapsed;
+            ++timedFrames;
+        }
+        timerPending[timerIndex] = false;
+    }
+
+    static void setShadowParameters(GLenum target)
+    {
+        // Fuera del mapa todo está iluminado
+        const float border[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+};
+
+#endif
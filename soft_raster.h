@@ -0,0 +1,656 @@
+#ifndef SOFT_RASTER_H
+#define SOFT_RASTER_H
+
+// Rasterizador por software: profundidad y, opcionalmente, color con textura.
+//
+// Sirve de búfer de oclusores a resolución reducida (la profundidad tiene el
+// mismo convenio que la de OpenGL: [0,1], fila 0 abajo) y de referencia para
+// comparar con la imagen de OpenGL en máquinas sin GPU.
+//
+// render() trabaja en dos fases, ambas repartidas entre varios hilos:
+//   1. cada hilo toma dibujos enteros, transforma sus triángulos, los recorta
+//      contra el plano cercano y los reparte en sus propias listas por tile;
+//   2. cada hilo toma tiles de TILE_SIZE x TILE_SIZE y rasteriza todos los
+//      triángulos que tocan el tile. Un tile es de un solo hilo, así que no
+//      hacen falta bloqueos. Las listas de los hilos se mezclan por índice de
+//      dibujo, así que cada tile se rasteriza en el orden de submit() y el
+//      resultado no depende de qué hilo preparó cada dibujo.
+// Los píxeles cuyo centro cae justo en una arista compartida se asignan con la
+// regla superior-izquierda de OpenGL: se dibujan una sola vez.
+// Las funciones de arista y la prueba de profundidad se evalúan en 8 píxeles
+// a la vez con AVX2, en 4 con SSE2 y de uno en uno en otras arquitecturas.
+//
+// Con setCounters() se cuentan también, por píxel, los fragmentos que pasan la
+// profundidad (sobredibujo en el orden de envío) y los píxeles de arista de
+// todos los triángulos, tapados o no (densidad de triángulos), como las vistas
+// de DebugViews en la GPU.
+//
+// Los vectores que se pasan a submit() deben seguir vivos hasta render().
+//
+// No llama a OpenGL, pero trabaja con los tipos de glm: glm.hpp va antes.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SOFT_RASTER_SSE2
+#endif
+
+// Textura ya decodificada (filas de arriba abajo, como las sube loadTexture)
+struct SoftTexture
+{
+    int width = 0, height = 0, channels = 0;
+    std::vector<unsigned char> pixels;
+};
+
+namespace softraster
+{
+#if defined(__AVX2__)
+    typedef __m256 Lanes;
+    const int LANE_COUNT = 8;
+    inline Lanes splat(float value) { return _mm256_set1_ps(value); }
+    inline Lanes ramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+    inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+    inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+    inline Lanes div(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+    inline Lanes minimum(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+    inline Lanes maximum(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+    inline Lanes load(const float* p) { return _mm256_loadu_ps(p); }
+    inline void store(float* p, Lanes a) { _mm256_storeu_ps(p, a); }
+    inline Lanes greaterEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    inline Lanes less(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    inline Lanes both(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+    inline Lanes select(Lanes mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b, a, mask); }
+    inline int bits(Lanes mask) { return _mm256_movemask_ps(mask); }
+#elif defined(SOFT_RASTER_SSE2)
+    typedef __m128 Lanes;
+    const int LANE_COUNT = 4;
+    inline Lanes splat(float value) { return _mm_set1_ps(value); }
+    inline Lanes ramp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+    inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+    inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+    inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+    inline Lanes div(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+    inline Lanes minimum(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+    inline Lanes maximum(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+    inline Lanes load(const float* p) { return _mm_loadu_ps(p); }
+    inline void store(float* p, Lanes a) { _mm_storeu_ps(p, a); }
+    inline Lanes greaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+    inline Lanes less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+    inline Lanes both(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+    inline Lanes select(Lanes mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    inline int bits(Lanes mask) { return _mm_movemask_ps(mask); }
+#else
+    // Un píxel por "vector"; la máscara es 1.0 o 0.0
+    typedef float Lanes;
+    const int LANE_COUNT = 1;
+    inline Lanes splat(float value) { return value; }
+    inline Lanes ramp() { return 0.0f; }
+    inline Lanes add(Lanes a, Lanes b) { return a + b; }
+    inline Lanes sub(Lanes a, Lanes b) { return a - b; }
+    inline Lanes mul(Lanes a, Lanes b) { return a * b; }
+    inline Lanes div(Lanes a, Lanes b) { return a / b; }
+    inline Lanes minimum(Lanes a, Lanes b) { return std::min(a, b); }
+    inline Lanes maximum(Lanes a, Lanes b) { return std::max(a, b); }
+    inline Lanes load(const float* p) { return *p; }
+    inline void store(float* p, Lanes a) { *p = a; }
+    inline Lanes greaterEqual(Lanes a, Lanes b) { return a >= b ? 1.0f : 0.0f; }
+    inline Lanes less(Lanes a, Lanes b) { return a < b ? 1.0f : 0.0f; }
+    inline Lanes both(Lanes a, Lanes b) { return a * b; }
+    inline Lanes select(Lanes mask, Lanes a, Lanes b) { return mask != 0.0f ? a : b; }
+    inline int bits(Lanes mask) { return mask != 0.0f ? 1 : 0; }
+#endif
+
+    inline uint32_t packColor(const glm::vec4& color)
+    {
+        auto channel = [](float value) { return (uint32_t)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f); };
+        return channel(color.x) | (channel(color.y) << 8) | (channel(color.z) << 16) | (channel(color.w) << 24);
+    }
+}
+
+// RGBA empaquetado (r en el byte bajo), fila 0 abajo: el orden de TGA por defecto
+inline bool writeTga(const std::string& path, int width, int height, const std::vector<uint32_t>& pixels)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    unsigned char header[18] = {};
+    header[2] = 2; // RGB sin comprimir
+    header[12] = (unsigned char)(width & 0xFF);
+    header[13] = (unsigned char)(width >> 8);
+    header[14] = (unsigned char)(height & 0xFF);
+    header[15] = (unsigned char)(height >> 8);
+    header[16] = 24;
+    file.write((const char*)header, sizeof(header));
+
+    std::vector<unsigned char> row(width * 3);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            uint32_t pixel = pixels[y * width + x];
+            row[x * 3 + 0] = (unsigned char)(pixel >> 16);
+            row[x * 3 + 1] = (unsigned char)(pixel >> 8);
+            row[x * 3 + 2] = (unsigned char)pixel;
+        }
+        file.write((const char*)row.data(), row.size());
+    }
+    return (bool)file;
+}
+
+class SoftRasterizer
+{
+public:
+    static const int TILE_SIZE = 32;
+
+    // threadCount = 0: uno por núcleo
+    void init(int _width, int _height, bool _color, unsigned threadCount = 0)
+    {
+        width = _width;
+        height = _height;
+        color = _color;
+        // Cada fila se rellena hasta un múltiplo de LANE_COUNT: las cargas no se salen
+        stride = (width + softraster::LANE_COUNT - 1) / softraster::LANE_COUNT * softraster::LANE_COUNT;
+        tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+
+        threads = threadCount ? threadCount : std::max(1u, std::thread::hardware_concurrency());
+        triangles.assign(threads, std::vector<Triangle>());
+        bins.assign(threads, std::vector<std::vector<uint32_t>>(tilesX * tilesY));
+
+        depth.assign(stride * height, 1.0f);
+        if (color)
+            pixels.assign(stride * height, 0);
+    }
+
+    void setViewProj(const glm::mat4x4& _viewProj)
+    {
+        viewProj = _viewProj;
+    }
+
+    // Antes de clear()
+    void setCounters(bool enabled)
+    {
+        counters = enabled;
+        fragments.assign(counters ? stride * height : 0, 0);
+        edges.assign(counters ? stride * height : 0, 0);
+    }
+
+    void clear(const glm::vec4& clearColor = glm::vec4(0.0f))
+    {
+        std::fill(depth.begin(), depth.end(), 1.0f);
+        if (color)
+            std::fill(pixels.begin(), pixels.end(), softraster::packColor(clearColor));
+        std::fill(fragments.begin(), fragments.end(), 0);
+        std::fill(edges.begin(), edges.end(), 0);
+        draws.clear();
+    }
+
+    // positions xyz y texcoords uv por vértice, como los guarda Model
+    void submit(const std::vector<float>& positions, const std::vector<float>& texcoords, const std::vector<unsigned int>& indices,
+                const glm::mat4x4& model, const SoftTexture* texture = nullptr)
+    {
+        Draw draw;
+        draw.positions = &positions;
+        draw.texcoords = texcoords.size() * 3 >= positions.size() * 2 ? &texcoords : nullptr;
+        draw.indices = &indices;
+        draw.mvp = viewProj * model;
+        draw.texture = color && texture && !texture->pixels.empty() ? texture : nullptr;
+        draws.push_back(draw);
+    }
+
+    void render()
+    {
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            triangles[t].clear();
+            for (std::vector<uint32_t>& bin : bins[t])
+                bin.clear();
+        }
+
+        std::atomic<size_t> nextDraw(0);
+        parallel([&](unsigned thread) {
+            for (size_t d = nextDraw++; d < draws.size(); d = nextDraw++)
+                setupDraw(draws[d], (uint32_t)d, thread);
+        });
+
+        std::atomic<int> nextTile(0);
+        parallel([&](unsigned) {
+            for (int tile = nextTile++; tile < tilesX * tilesY; tile = nextTile++)
+                rasterizeTile(tile);
+        });
+
+        triangleCount = 0;
+        for (unsigned t = 0; t < threads; ++t)
+            triangleCount += (unsigned)triangles[t].size();
+        draws.clear();
+    }
+
+    int getWidth() const
+    {
+        return width;
+    }
+
+    int getHeight() const
+    {
+        return height;
+    }
+
+    const glm::mat4x4& getViewProj() const
+    {
+        return viewProj;
+    }
+
+    // Triángulos que llegaron a rasterizarse en el último render()
+    unsigned getTriangleCount() const
+    {
+        return triangleCount;
+    }
+
+    // Sin el relleno de cada fila
+    std::vector<float> getDepth() const
+    {
+        std::vector<float> out(width * height);
+        for (int y = 0; y < height; ++y)
+            std::copy(depth.begin() + y * stride, depth.begin() + y * stride + width, out.begin() + y * width);
+        return out;
+    }
+
+    std::vector<uint32_t> getColor() const
+    {
+        std::vector<uint32_t> out(width * height, 0);
+        if (color)
+            for (int y = 0; y < height; ++y)
+                std::copy(pixels.begin() + y * stride, pixels.begin() + y * stride + width, out.begin() + y * width);
+        return out;
+    }
+
+    // Con setCounters(): fragmentos que pasaron la profundidad por píxel
+    std::vector<uint16_t> getFragmentCounts() const
+    {
+        return unpadded(fragments);
+    }
+
+    // Con setCounters(): píxeles de arista de triángulo por píxel
+    std::vector<uint16_t> getEdgeCounts() const
+    {
+        return unpadded(edges);
+    }
+
+private:
+    struct Draw
+    {
+        const std::vector<float>* positions;
+        const std::vector<float>* texcoords;
+        const std::vector<unsigned int>* indices;
+        glm::mat4x4 mvp;
+        const SoftTexture* texture;
+    };
+
+    struct ClipVertex
+    {
+        glm::vec4 position;
+        float u, v;
+    };
+
+    // Ya en píxeles; u y v van divididas por w para interpolar con perspectiva
+    struct Triangle
+    {
+        float x[3], y[3], z[3];
+        float invW[3], u[3], v[3];
+        const SoftTexture* texture;
+        uint32_t draw; // posición en submit()
+    };
+
+    int width = 0, height = 0, stride = 0;
+    int tilesX = 0, tilesY = 0;
+    bool color = false, counters = false;
+    unsigned threads = 1;
+    glm::mat4x4 viewProj = glm::mat4x4(1.0f);
+
+    std::vector<Draw> draws;
+    std::vector<float> depth;
+    std::vector<uint32_t> pixels;
+    std::vector<uint16_t> fragments, edges; // con setCounters()
+    // Por hilo de la fase 1: sus triángulos y sus listas por tile. Un hilo toma
+    // los dibujos en orden creciente, así que cada lista ya va ordenada por dibujo
+    std::vector<std::vector<Triangle>> triangles;
+    std::vector<std::vector<std::vector<uint32_t>>> bins;
+    unsigned triangleCount = 0;
+
+    std::vector<uint16_t> unpadded(const std::vector<uint16_t>& padded) const
+    {
+        std::vector<uint16_t> out(width * height, 0);
+        if (!padded.empty())
+            for (int y = 0; y < height; ++y)
+                std::copy(padded.begin() + y * stride, padded.begin() + y * stride + width, out.begin() + y * width);
+        return out;
+    }
+
+    template <typename Work>
+    void parallel(Work work)
+    {
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t)
+            pool.emplace_back(work, t);
+        work(0);
+        for (std::thread& thread : pool)
+            thread.join();
+    }
+
+    void setupDraw(const Draw& draw, uint32_t drawIndex, unsigned thread)
+    {
+        const std::vector<float>& positions = *draw.positions;
+        const std::vector<unsigned int>& indices = *draw.indices;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            ClipVertex vertices[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                unsigned int index = indices[i + k];
+                vertices[k].position = draw.mvp * glm::vec4(positions[index * 3 + 0], positions[index * 3 + 1], positions[index * 3 + 2], 1.0f);
+                vertices[k].u = draw.texcoords ? (*draw.texcoords)[index * 2 + 0] : 0.0f;
+                vertices[k].v = draw.texcoords ? (*draw.texcoords)[index * 2 + 1] : 0.0f;
+            }
+            clipTriangle(vertices, draw.texture, drawIndex, thread);
+        }
+    }
+
+    // Recorte contra el plano cercano (z = -w); el resto de planos lo resuelve el recorte por tiles
+    void clipTriangle(const ClipVertex input[3], const SoftTexture* texture, uint32_t drawIndex, unsigned thread)
+    {
+        // Descarte rápido si los tres vértices quedan fuera del mismo plano
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (input[0].position[axis] > input[0].position.w && input[1].position[axis] > input[1].position.w &&
+                input[2].position[axis] > input[2].position.w)
+                return;
+            if (input[0].position[axis] < -input[0].position.w && input[1].position[axis] < -input[1].position.w &&
+                input[2].position[axis] < -input[2].position.w)
+                return;
+        }
+
+        ClipVertex polygon[4];
+        int count = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            const ClipVertex& a = input[k];
+            const ClipVertex& b = input[(k + 1) % 3];
+            float da = a.position.z + a.position.w;
+            float db = b.position.z + b.position.w;
+            if (da >= 0.0f)
+                polygon[count++] = a;
+            if ((da >= 0.0f) != (db >= 0.0f))
+            {
+                float t = da / (da - db);
+                ClipVertex mid;
+                mid.position = a.position + (b.position - a.position) * t;
+                mid.u = a.u + (b.u - a.u) * t;
+                mid.v = a.v + (b.v - a.v) * t;
+                polygon[count++] = mid;
+            }
+        }
+        for (int k = 1; k + 1 < count; ++k)
+            addTriangle(polygon[0], polygon[k], polygon[k + 1], texture, drawIndex, thread);
+    }
+
+    void addTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, const SoftTexture* texture, uint32_t drawIndex,
+                     unsigned thread)
+    {
+        const ClipVertex* vertices[3] = { &a, &b, &c };
+        Triangle triangle;
+        triangle.texture = texture;
+        triangle.draw = drawIndex;
+        for (int k = 0; k < 3; ++k)
+        {
+            const glm::vec4& p = vertices[k]->position;
+            float invW = 1.0f / std::max(p.w, 1e-6f);
+            triangle.x[k] = (p.x * invW * 0.5f + 0.5f) * width;
+            triangle.y[k] = (p.y * invW * 0.5f + 0.5f) * height;
+            triangle.z[k] = p.z * invW * 0.5f + 0.5f;
+            triangle.invW[k] = invW;
+            triangle.u[k] = vertices[k]->u * invW;
+            triangle.v[k] = vertices[k]->v * invW;
+        }
+
+        // Sin cara trasera descartada (como el resto de la escena); se ordena a área positiva
+        float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f)
+        {
+            std::swap(triangle.x[1], triangle.x[2]);
+            std::swap(triangle.y[1], triangle.y[2]);
+            std::swap(triangle.z[1], triangle.z[2]);
+            std::swap(triangle.invW[1], triangle.invW[2]);
+            std::swap(triangle.u[1], triangle.u[2]);
+            std::swap(triangle.v[1], triangle.v[2]);
+        }
+
+        int minX, minY, maxX, maxY;
+        if (!pixelBounds(triangle, minX, minY, maxX, maxY))
+            return;
+
+        uint32_t index = (uint32_t)triangles[thread].size();
+        triangles[thread].push_back(triangle);
+        for (int ty = minY / TILE_SIZE; ty <= maxY / TILE_SIZE; ++ty)
+            for (int tx = minX / TILE_SIZE; tx <= maxX / TILE_SIZE; ++tx)
+                bins[thread][ty * tilesX + tx].push_back(index);
+    }
+
+    // Píxeles cuyo centro puede caer dentro, recortados a la pantalla
+    bool pixelBounds(const Triangle& triangle, int& minX, int& minY, int& maxX, int& maxY) const
+    {
+        float lowX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+        float lowY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+        float highX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+        float highY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+        if (highX < 0.0f || highY < 0.0f || lowX > (float)width || lowY > (float)height)
+            return false;
+        minX = std::max(0, (int)std::floor(lowX - 0.5f));
+        minY = std::max(0, (int)std::floor(lowY - 0.5f));
+        maxX = std::min(width - 1, (int)std::ceil(highX - 0.5f));
+        maxY = std::min(height - 1, (int)std::ceil(highY - 0.5f));
+        return minX <= maxX && minY <= maxY;
+    }
+
+    void rasterizeTile(int tile)
+    {
+        int tileX0 = (tile % tilesX) * TILE_SIZE;
+        int tileY0 = (tile / tilesX) * TILE_SIZE;
+        int tileX1 = std::min(tileX0 + TILE_SIZE, width) - 1;
+        int tileY1 = std::min(tileY0 + TILE_SIZE, height) - 1;
+
+        // Mezcla de las listas de los hilos (cada una ordenada) por índice de dibujo
+        std::vector<size_t> cursor(threads, 0);
+        for (;;)
+        {
+            unsigned next = threads;
+            uint32_t nextDraw = 0;
+            for (unsigned t = 0; t < threads; ++t)
+            {
+                const std::vector<uint32_t>& bin = bins[t][tile];
+                if (cursor[t] == bin.size())
+                    continue;
+                uint32_t draw = triangles[t][bin[cursor[t]]].draw;
+                if (next == threads || draw < nextDraw)
+                {
+                    next = t;
+                    nextDraw = draw;
+                }
+            }
+            if (next == threads)
+                break;
+
+            const Triangle& triangle = triangles[next][bins[next][tile][cursor[next]++]];
+            int minX, minY, maxX, maxY;
+            pixelBounds(triangle, minX, minY, maxX, maxY);
+            minX = std::max(minX, tileX0);
+            minY = std::max(minY, tileY0);
+            maxX = std::min(maxX, tileX1);
+            maxY = std::min(maxY, tileY1);
+            if (minX <= maxX && minY <= maxY)
+                rasterizeTriangle(triangle, minX, minY, maxX, maxY);
+        }
+    }
+
+    void rasterizeTriangle(const Triangle& tri, int minX, int minY, int maxX, int maxY)
+    {
+        using namespace softraster;
+
+        // Arista k opuesta al vértice k: w = A * x + B * y + C, positiva dentro
+        float edgeA[3], edgeB[3], edgeC[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            int a = (k + 1) % 3, b = (k + 2) % 3;
+            edgeA[k] = -(tri.y[b] - tri.y[a]);
+            edgeB[k] = tri.x[b] - tri.x[a];
+            edgeC[k] = -edgeA[k] * tri.x[a] - edgeB[k] * tri.y[a];
+        }
+        float invArea = 1.0f / (edgeA[0] * tri.x[0] + edgeB[0] * tri.y[0] + edgeC[0]);
+
+        // Regla superior-izquierda: un centro con w = 0 solo es de la arista si es
+        // izquierda (el interior a su derecha) o superior (horizontal, el interior
+        // debajo; la fila 0 está abajo). Una arista compartida es izquierda o
+        // superior en uno solo de los dos triángulos.
+        bool topLeft[3];
+        for (int k = 0; k < 3; ++k)
+            topLeft[k] = edgeA[k] > 0.0f || (edgeA[k] == 0.0f && edgeB[k] < 0.0f);
+
+        // La profundidad es lineal en pantalla: z = zA * x + zB * y + zC
+        float zA = 0.0f, zB = 0.0f, zC = 0.0f;
+        for (int k = 0; k < 3; ++k)
+        {
+            zA += edgeA[k] * tri.z[k] * invArea;
+            zB += edgeB[k] * tri.z[k] * invArea;
+            zC += edgeC[k] * tri.z[k] * invArea;
+        }
+
+        // Para los contadores: distancia en píxeles a cada arista = w / |(A, B)|
+        float edgeScale[3];
+        for (int k = 0; k < 3; ++k)
+            edgeScale[k] = 1.0f / std::max(std::sqrt(edgeA[k] * edgeA[k] + edgeB[k] * edgeB[k]), 1e-6f);
+
+        Lanes zero = splat(0.0f);
+        Lanes laneX = ramp();
+        Lanes stepA[3], depthA = mul(splat(zA), splat((float)LANE_COUNT));
+        for (int k = 0; k < 3; ++k)
+            stepA[k] = splat(edgeA[k] * LANE_COUNT);
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float centerY = y + 0.5f;
+            int startX = minX / LANE_COUNT * LANE_COUNT;
+            Lanes centerX = add(splat(startX + 0.5f), laneX);
+            Lanes w[3];
+            for (int k = 0; k < 3; ++k)
+                w[k] = add(mul(splat(edgeA[k]), centerX), splat(edgeB[k] * centerY + edgeC[k]));
+            Lanes z = add(mul(splat(zA), centerX), splat(zB * centerY + zC));
+
+            float* depthRow = depth.data() + y * stride;
+            for (int x = startX; x <= maxX; x += LANE_COUNT)
+            {
+                Lanes covered[3];
+                for (int k = 0; k < 3; ++k)
+                    covered[k] = topLeft[k] ? greaterEqual(w[k], zero) : less(zero, w[k]);
+                Lanes inside = both(both(covered[0], covered[1]), covered[2]);
+                int coverage = bits(inside);
+                if (coverage && counters)
+                    countEdges(x, y, minX, maxX, coverage, w, edgeScale);
+                if (coverage)
+                {
+                    Lanes current = load(depthRow + x);
+                    Lanes pass = both(inside, less(z, current));
+                    int passed = bits(pass);
+                    // Fuera de [minX, maxX] en los extremos de la fila
+                    for (int lane = 0; lane < LANE_COUNT; ++lane)
+                        if (x + lane < minX || x + lane > maxX)
+                            passed &= ~(1 << lane);
+                    if (passed)
+                    {
+                        float zs[LANE_COUNT > 1 ? LANE_COUNT : 1], ds[LANE_COUNT > 1 ? LANE_COUNT : 1];
+                        store(zs, z);
+                        store(ds, current);
+                        for (int lane = 0; lane < LANE_COUNT; ++lane)
+                            if (passed & (1 << lane))
+                                ds[lane] = zs[lane];
+                        store(depthRow + x, load(ds));
+                        if (counters)
+                            for (int lane = 0; lane < LANE_COUNT; ++lane)
+                                if ((passed & (1 << lane)) && fragments[y * stride + x + lane] < 0xFFFF)
+                                    ++fragments[y * stride + x + lane];
+                        if (color)
+                            shade(tri, x, y, passed, edgeA, edgeB, edgeC, invArea);
+                    }
+                }
+                for (int k = 0; k < 3; ++k)
+                    w[k] = add(w[k], stepA[k]);
+                z = add(z, depthA);
+            }
+        }
+    }
+
+    // Píxeles cubiertos a menos de un píxel de alguna arista, pasen o no la profundidad
+    void countEdges(int x, int y, int minX, int maxX, int coverage, const softraster::Lanes* w, const float* edgeScale)
+    {
+        using namespace softraster;
+        float ws[3][LANE_COUNT > 1 ? LANE_COUNT : 1];
+        for (int k = 0; k < 3; ++k)
+            store(ws[k], w[k]);
+        for (int lane = 0; lane < LANE_COUNT; ++lane)
+        {
+            if (!(coverage & (1 << lane)) || x + lane < minX || x + lane > maxX)
+                continue;
+            float nearest = std::min(ws[0][lane] * edgeScale[0], std::min(ws[1][lane] * edgeScale[1], ws[2][lane] * edgeScale[2]));
+            uint16_t& count = edges[y * stride + x + lane];
+            if (nearest < 1.0f && count < 0xFFFF)
+                ++count;
+        }
+    }
+
+    // Color de los píxeles que pasaron la prueba de profundidad (muestreo nearest con repetición)
+    void shade(const Triangle& tri, int x, int y, int passed, const float* edgeA, const float* edgeB, const float* edgeC, float invArea)
+    {
+        uint32_t* row = pixels.data() + y * stride;
+        for (int lane = 0; lane < softraster::LANE_COUNT; ++lane)
+        {
+            if (!(passed & (1 << lane)))
+                continue;
+            float px = x + lane + 0.5f, py = y + 0.5f;
+            float b[3];
+            for (int k = 0; k < 3; ++k)
+                b[k] = (edgeA[k] * px + edgeB[k] * py + edgeC[k]) * invArea;
+
+            uint32_t value = 0xFFFFFFFFu;
+            if (tri.texture)
+            {
+                float invW = b[0] * tri.invW[0] + b[1] * tri.invW[1] + b[2] * tri.invW[2];
+                float u = (b[0] * tri.u[0] + b[1] * tri.u[1] + b[2] * tri.u[2]) / invW;
+                float v = (b[0] * tri.v[0] + b[1] * tri.v[1] + b[2] * tri.v[2]) / invW;
+                const SoftTexture& texture = *tri.texture;
+                int tx = (int)std::floor(u * texture.width) % texture.width;
+                int ty = (int)std::floor(v * texture.height) % texture.height;
+                if (tx < 0) tx += texture.width;
+                if (ty < 0) ty += texture.height;
+                const unsigned char* texel = &texture.pixels[(ty * texture.width + tx) * texture.channels];
+                unsigned char r = texel[0];
+                unsigned char g = texture.channels > 1 ? texel[1] : 0;
+                unsigned char bl = texture.channels > 2 ? texel[2] : 0;
+                value = r | (g << 8) | (bl << 16) | 0xFF000000u;
+            }
+            row[x + lane] = value;
+        }
+    }
+};
+
+#endif
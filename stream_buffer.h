@@ -0,0 +1,183 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+// Búfer de streaming para datos que cambian cada fotograma (el láser, y más
+// adelante matrices por instancia, partículas...).
+//
+// El búfer se divide en REGION_COUNT regiones; cada fotograma escribe en una y
+// deja una fence al terminar, así la CPU no pisa lo que la GPU aún está leyendo
+// y ninguna de las dos espera a la otra. Con ARB_buffer_storage el búfer se
+// mapea una sola vez de forma persistente y coherente. En 3.3 se mapea la
+// región sin sincronizar en cada fotograma y, si su fence aún no ha llegado,
+// se huérfana el búfer entero en lugar de esperar.
+//
+// Uso por fotograma: beginFrame(), allocate() las veces necesarias, commit()
+// antes de dibujar con lo escrito y endFrame() tras el último dibujo.
+
+#include <iostream>
+
+#include "gl_ext.h"
+
+class StreamBuffer
+{
+public:
+    static const int REGION_COUNT = 3;
+
+    struct Allocation
+    {
+        void* data;      // nullptr si la región está llena
+        GLintptr offset; // desplazamiento dentro de getBuffer()
+    };
+
+    void init(GLenum _target, size_t _regionSize)
+    {
+        target = _target;
+        regionSize = _regionSize;
+        persistent = glext.bufferStorage != nullptr;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        if (persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glext.bufferStorage(target, regionSize * REGION_COUNT, NULL, flags);
+            persistentMapping = (unsigned char*)glMapBufferRange(target, 0, regionSize * REGION_COUNT, flags);
+        }
+        else
+        {
+            glBufferData(target, regionSize * REGION_COUNT, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(target, 0);
+
+        for (int i = 0; i < REGION_COUNT; ++i)
+            fences[i] = 0;
+    }
+
+    void destroy()
+    {
+        for (int i = 0; i < REGION_COUNT; ++i)
+            if (fences[i]) glDeleteSync(fences[i]);
+        if (buffer) glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    void beginFrame()
+    {
+        region = (region + 1) % REGION_COUNT;
+        used = 0;
+
+        GLsync& fence = fences[region];
+        if (!fence)
+            return;
+
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            if (persistent)
+            {
+                // La GPU va tres fotogramas por detrás: no queda otra que esperar
+                ++stalls;
+                glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+            }
+            else
+            {
+                // Huérfano: el driver nos da memoria nueva y todas las regiones quedan libres
+                ++orphans;
+                glBindBuffer(target, buffer);
+                glBufferData(target, regionSize * REGION_COUNT, NULL, GL_STREAM_DRAW);
+                glBindBuffer(target, 0);
+                for (int i = 0; i < REGION_COUNT; ++i)
+                {
+                    if (fences[i]) glDeleteSync(fences[i]);
+                    fences[i] = 0;
+                }
+                return;
+            }
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    // alignment no tiene por qué ser potencia de dos (p. ej. el tamaño de un vértice)
+    Allocation allocate(size_t size, size_t alignment)
+    {
+        size_t regionStart = region * regionSize;
+        size_t offset = ((regionStart + used + alignment - 1) / alignment) * alignment;
+        if (offset + size > regionStart + regionSize)
+        {
+            std::cerr << "StreamBuffer: region llena (" << size << " bytes)" << std::endl;
+            return Allocation{ nullptr, 0 };
+        }
+
+        unsigned char* base = persistentMapping;
+        if (!persistent)
+        {
+            if (!transientMapping)
+            {
+                // Lo que queda de la región: la fence ya garantiza que está libre
+                mappedStart = regionStart + used;
+                glBindBuffer(target, buffer);
+                transientMapping = (unsigned char*)glMapBufferRange(target, mappedStart, regionStart + regionSize - mappedStart,
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                glBindBuffer(target, 0);
+            }
+            base = transientMapping - mappedStart;
+        }
+
+        used = offset + size - regionStart;
+        return Allocation{ base + offset, (GLintptr)offset };
+    }
+
+    // Antes de dibujar con lo escrito (sin mapeo persistente hay que desmapear)
+    void commit()
+    {
+        if (persistent || !transientMapping)
+            return;
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        transientMapping = nullptr;
+    }
+
+    void endFrame()
+    {
+        commit();
+        if (used > 0)
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    GLuint getBuffer() const
+    {
+        return buffer;
+    }
+
+    bool isPersistent() const
+    {
+        return persistent;
+    }
+
+    unsigned getStalls() const
+    {
+        return stalls;
+    }
+
+    unsigned getOrphans() const
+    {
+        return orphans;
+    }
+
+private:
+    GLenum target = GL_ARRAY_BUFFER;
+    GLuint buffer = 0;
+    size_t regionSize = 0;
+    bool persistent = false;
+    unsigned char* persistentMapping = nullptr;
+    unsigned char* transientMapping = nullptr;
+    size_t mappedStart = 0;
+
+    GLsync fences[REGION_COUNT];
+    int region = 0;
+    size_t used = 0;
+    unsigned stalls = 0, orphans = 0;
+};
+
+#endif
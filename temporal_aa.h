@@ -0,0 +1,374 @@
+#ifndef TEMPORAL_AA_H
+#define TEMPORAL_AA_H
+
+// Antialiasing temporal (TAA) sobre el destino de DynamicResolution.
+//
+// Cada fotograma la proyección de Camera se desplaza menos de un píxel
+// (secuencia de Halton 2,3 de JITTER_PHASES posiciones) y resolve() mezcla la
+// imagen nueva con la historia acumulada, así que los bordes, el pasto fino y
+// las líneas se promedian en el tiempo sin multisampling.
+//
+// Para saber dónde estaba cada píxel en la historia:
+//   - lo estático se reproyecta con su profundidad y la viewProj (sin jitter)
+//     del fotograma anterior;
+//   - lo que se mueve por su cuenta (la vaca, el OVNI) escribe su vector de
+//     movimiento entre beginMotion() y endMotion(), con su matriz de modelo de
+//     este fotograma y la del anterior, solo donde se ve (GL_LEQUAL contra la
+//     profundidad de la escena).
+// La historia se recorta a la media +- CLIP_SIGMA desviaciones del vecindario
+// 3x3 de la imagen nueva (en YCoCg) y pesa menos cuanto más rápido se mueve el
+// píxel; lo que sale de la pantalla o se destapa toma la imagen nueva.
+//
+// La historia se guarda a la resolución del destino en texturas RGBA16F del
+// tamaño máximo, con el tamaño con el que se escribió, así que sobrevive a los
+// cambios de escala de DynamicResolution. Necesita el destino sin
+// multisampling (getDepthTexture() != 0).
+//
+// Uso por fotograma: nextJitter() y Camera::beginFrame() al principio;
+// beginMotion(), drawMotion() por objeto y endMotion() después de la escena; y
+// resolve() antes de DynamicResolution::present().
+
+#include <iostream>
+
+#include "mesh_arena.h"
+#include "program_cache.h"
+
+inline const char* motionVertexShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) in vec3 aPos;
+
+    uniform mat4 model;
+    uniform mat4 previousModel;
+    uniform mat4 viewProj;         // la de la escena, con jitter
+    uniform mat4 currentViewProj;  // sin jitter
+    uniform mat4 previousViewProj; // sin jitter, del fotograma anterior
+
+    out vec4 Current;
+    out vec4 Previous;
+
+    void main()
+    {
+        vec4 world = model * vec4(aPos, 1.0);
+        gl_Position = viewProj * world;
+        Current = currentViewProj * world;
+        Previous = previousViewProj * previousModel * vec4(aPos, 1.0);
+    }
+)glsl";
+
+inline const char* motionFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 Motion;
+
+    in vec4 Current;
+    in vec4 Previous;
+
+    void main()
+    {
+        // Desplazamiento en coordenadas de textura; a = 1: vector explícito
+        Motion = vec4((Current.xy / Current.w - Previous.xy / Previous.w) * 0.5, 0.0, 1.0);
+    }
+)glsl";
+
+inline const char* taaVertexShaderSource = R"glsl(
+    #version 330 core
+
+    // Triángulo que cubre la pantalla, sin atributos
+    void main()
+    {
+        vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+        gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+    }
+)glsl";
+
+inline const char* taaFragmentShaderSource = R"glsl(
+    #version 330 core
+    layout (location = 0) out vec4 FragColor;
+
+    uniform sampler2D currentColor;
+    uniform sampler2D currentDepth;
+    uniform sampler2D motion;
+    uniform sampler2D history;
+
+    uniform vec2 renderSize;   // lo dibujado este fotograma, en texels
+    uniform vec2 historySize;  // lo que se escribió en history
+    uniform mat4 reprojection; // de NDC de este fotograma a clip del anterior, sin jitter
+    uniform vec2 jitter;       // en NDC
+    uniform bool historyValid;
+    uniform float feedback;
+    uniform float clipSigma;
+
+    vec3 toYCoCg(vec3 c)
+    {
+        return vec3(0.25 * c.r + 0.5 * c.g + 0.25 * c.b, 0.5 * c.r - 0.5 * c.b, -0.25 * c.r + 0.5 * c.g - 0.25 * c.b);
+    }
+
+    vec3 fromYCoCg(vec3 c)
+    {
+        return vec3(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z);
+    }
+
+    void main()
+    {
+        ivec2 pixel = ivec2(gl_FragCoord.xy);
+        ivec2 last = ivec2(renderSize) - 1;
+        vec3 current = toYCoCg(texelFetch(currentColor, pixel, 0).rgb);
+
+        // Vecindario 3x3: caja de colores posibles para la historia
+        vec3 mean = vec3(0.0), meanSquared = vec3(0.0), low = current, high = current;
+        for (int y = -1; y <= 1; ++y)
+            for (int x = -1; x <= 1; ++x)
+            {
+                vec3 c = toYCoCg(texelFetch(currentColor, clamp(pixel + ivec2(x, y), ivec2(0), last), 0).rgb);
+                mean += c;
+                meanSquared += c * c;
+                low = min(low, c);
+                high = max(high, c);
+            }
+        mean /= 9.0;
+        vec3 sigma = sqrt(max(meanSquared / 9.0 - mean * mean, 0.0));
+        low = max(low, mean - clipSigma * sigma);
+        high = min(high, mean + clipSigma * sigma);
+
+        vec2 uv = gl_FragCoord.xy / renderSize;
+        vec4 moved = texelFetch(motion, pixel, 0);
+        vec2 previousUv;
+        if (moved.a > 0.5)
+            previousUv = uv - moved.xy;
+        else
+        {
+            float depth = texelFetch(currentDepth, pixel, 0).r;
+            vec4 previous = reprojection * vec4(uv * 2.0 - 1.0 - jitter, depth * 2.0 - 1.0, 1.0);
+            previousUv = previous.xy / previous.w * 0.5 + 0.5;
+        }
+
+        if (!historyValid || any(lessThan(previousUv, vec2(0.0))) || any(greaterThan(previousUv, vec2(1.0))))
+        {
+            FragColor = vec4(fromYCoCg(current), 1.0);
+            return;
+        }
+
+        vec2 historyTexel = clamp(previousUv * historySize, vec2(0.5), historySize - 0.5);
+        vec3 previous = clamp(toYCoCg(texture(history, historyTexel / vec2(textureSize(history, 0))).rgb), low, high);
+
+        // Con movimiento rápido la historia está más desenfocada: pesa menos
+        float speed = length((uv - previousUv) * renderSize);
+        float weight = feedback * (1.0 - 0.25 * clamp(speed / 8.0, 0.0, 1.0));
+        FragColor = vec4(fromYCoCg(mix(current, previous, weight)), 1.0);
+    }
+)glsl";
+
+class TemporalAA
+{
+public:
+    static const int JITTER_PHASES = 8;
+    static constexpr float FEEDBACK = 0.9f;
+    static constexpr float CLIP_SIGMA = 1.25f;
+
+    // depthTexture: la de DynamicResolution; el tamaño, el máximo de su destino
+    void init(ProgramCache& cache, GLuint _depthTexture, int _maxWidth, int _maxHeight)
+    {
+        depthTexture = _depthTexture;
+        maxWidth = _maxWidth;
+        maxHeight = _maxHeight;
+
+        glGenTextures(3, textures);
+        for (int i = 0; i < 3; ++i)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, maxWidth, maxHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, i == MOTION ? GL_NEAREST : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, i == MOTION ? GL_NEAREST : GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        // Una historia se lee y la otra se escribe; el de movimiento comparte la profundidad de la escena
+        bool complete = true;
+        glGenFramebuffers(3, fbos);
+        for (int i = 0; i < 3; ++i)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+            if (i == MOTION)
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+            complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!complete)
+        {
+            std::cerr << "TAA: los destinos no están completos" << std::endl;
+            destroy();
+            return;
+        }
+
+        motionProgram = cache.getProgram({ { GL_VERTEX_SHADER, motionVertexShaderSource },
+                                           { GL_FRAGMENT_SHADER, motionFragmentShaderSource } });
+        resolveProgram = cache.getProgram({ { GL_VERTEX_SHADER, taaVertexShaderSource },
+                                            { GL_FRAGMENT_SHADER, taaFragmentShaderSource } });
+        glGenVertexArrays(1, &emptyVao);
+        historyValid = false;
+        initialized = true;
+    }
+
+    void destroy()
+    {
+        if (textures[0]) glDeleteTextures(3, textures);
+        if (fbos[0]) glDeleteFramebuffers(3, fbos);
+        if (emptyVao) glDeleteVertexArrays(1, &emptyVao);
+        // Los programas son de ProgramCache
+        textures[0] = fbos[0] = emptyVao = 0;
+        initialized = false;
+    }
+
+    bool isEnabled() const
+    {
+        return initialized;
+    }
+
+    // Desplazamiento de este fotograma en NDC para Camera::beginFrame(); sin init(), 0
+    glm::vec2 nextJitter(const glm::ivec2& renderSize)
+    {
+        if (!initialized)
+            return glm::vec2(0.0f);
+        phase = (phase + 1) % JITTER_PHASES;
+        glm::vec2 pixels(halton(phase + 1, 2) - 0.5f, halton(phase + 1, 3) - 0.5f);
+        jitter = pixels * 2.0f / glm::vec2(renderSize);
+        return jitter;
+    }
+
+    // Tras la escena, con su destino enlazado. viewProj es la de la escena (con
+    // jitter); las otras dos, sin jitter, las de Camera
+    void beginMotion(const glm::mat4x4& previousViewProj, const glm::mat4x4& currentViewProj, const glm::mat4x4& viewProj,
+                     const glm::ivec2& _renderSize, GLuint meshVao)
+    {
+        renderSize = _renderSize;
+        reprojection = previousViewProj * glm::inverse(currentViewProj);
+        if (!initialized)
+            return;
+
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[MOTION]);
+        const GLfloat none[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        glClearBufferfv(GL_COLOR, 0, none);
+
+        blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(-1.0f, -1.0f);
+
+        glUseProgram(motionProgram);
+        glUniformMatrix4fv(glGetUniformLocation(motionProgram, "viewProj"), 1, GL_FALSE, glm::value_ptr(viewProj));
+        glUniformMatrix4fv(glGetUniformLocation(motionProgram, "currentViewProj"), 1, GL_FALSE, glm::value_ptr(currentViewProj));
+        glUniformMatrix4fv(glGetUniformLocation(motionProgram, "previousViewProj"), 1, GL_FALSE, glm::value_ptr(previousViewProj));
+        glBindVertexArray(meshVao);
+    }
+
+    // Una malla de MeshArena que se ha movido por su cuenta
+    void drawMotion(const MeshRange& range, const glm::mat4x4& model, const glm::mat4x4& previousModel)
+    {
+        if (!initialized || range.indexCount == 0)
+            return;
+        glUniformMatrix4fv(glGetUniformLocation(motionProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(glGetUniformLocation(motionProgram, "previousModel"), 1, GL_FALSE, glm::value_ptr(previousModel));
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (void*)(range.firstIndex * sizeof(GLuint)), range.baseVertex);
+    }
+
+    // Vuelve al destino de la escena
+    void endMotion()
+    {
+        if (!initialized)
+            return;
+        glBindVertexArray(0);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        if (blend) glEnable(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)target);
+    }
+
+    // Mezcla colorTexture (lo dibujado, del tamaño máximo) con la historia y
+    // devuelve la nueva historia para DynamicResolution::present(); sin init(),
+    // colorTexture
+    GLuint resolve(GLuint colorTexture)
+    {
+        if (!initialized)
+            return colorTexture;
+        int read = HISTORY_A + historyIndex, write = HISTORY_A + 1 - historyIndex;
+
+        GLint viewport[4], previousTarget = 0;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousTarget);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[write]);
+        glViewport(0, 0, renderSize.x, renderSize.y);
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), wasBlending = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glUseProgram(resolveProgram);
+        const GLuint inputs[4] = { colorTexture, depthTexture, textures[MOTION], textures[read] };
+        const char* names[4] = { "currentColor", "currentDepth", "motion", "history" };
+        for (int i = 0; i < 4; ++i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, inputs[i]);
+            glUniform1i(glGetUniformLocation(resolveProgram, names[i]), i);
+        }
+        glUniform2f(glGetUniformLocation(resolveProgram, "renderSize"), (float)renderSize.x, (float)renderSize.y);
+        glUniform2f(glGetUniformLocation(resolveProgram, "historySize"), (float)historySize.x, (float)historySize.y);
+        glUniformMatrix4fv(glGetUniformLocation(resolveProgram, "reprojection"), 1, GL_FALSE, glm::value_ptr(reprojection));
+        glUniform2fv(glGetUniformLocation(resolveProgram, "jitter"), 1, glm::value_ptr(jitter));
+        glUniform1i(glGetUniformLocation(resolveProgram, "historyValid"), historyValid);
+        glUniform1f(glGetUniformLocation(resolveProgram, "feedback"), FEEDBACK);
+        glUniform1f(glGetUniformLocation(resolveProgram, "clipSigma"), CLIP_SIGMA);
+        glBindVertexArray(emptyVao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        for (int i = 3; i >= 0; --i)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+        if (depthTest) glEnable(GL_DEPTH_TEST);
+        if (wasBlending) glEnable(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousTarget);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        historySize = renderSize;
+        historyValid = true;
+        historyIndex = 1 - historyIndex;
+        return textures[write];
+    }
+
+private:
+    enum { HISTORY_A = 0, HISTORY_B = 1, MOTION = 2 };
+
+    GLuint textures[3] = {}, fbos[3] = {};
+    GLuint depthTexture = 0, motionProgram = 0, resolveProgram = 0, emptyVao = 0;
+    int maxWidth = 0, maxHeight = 0;
+    bool initialized = false, historyValid = false;
+    GLboolean blend = GL_TRUE;
+    GLint target = 0;
+
+    int phase = 0, historyIndex = 0;
+    glm::vec2 jitter = glm::vec2(0.0f);
+    glm::ivec2 renderSize = glm::ivec2(0), historySize = glm::ivec2(0);
+    glm::mat4x4 reprojection = glm::mat4x4(1.0f);
+
+    static float halton(int index, int base)
+    {
+        float fraction = 1.0f, result = 0.0f;
+        while (index > 0)
+        {
+            fraction /= base;
+            result += fraction * (index % base);
+            index /= base;
+        }
+        return result;
+    }
+};
+
+#endif
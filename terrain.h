@@ -0,0 +1,243 @@
+#ifndef TERRAIN_H
+#define TERRAIN_H
+
+// Terreno de alturas por chunks.
+//
+// build() muestrea una función de altura en una rejilla de celdas de
+// cellSize y la parte en chunks de CHUNK_QUADS x CHUNK_QUADS celdas. Cada
+// chunk se guarda en la MeshArena con LOD_COUNT niveles de detalle (cada
+// nivel usa una de cada dos filas y columnas del anterior) y con faldones:
+// una tira vertical de SKIRT_DEPTH bajo cada borde que tapa las grietas entre
+// chunks vecinos con distinto nivel.
+//
+// Cada fotograma submit() elige el nivel de cada chunk según la distancia de
+// la cámara a su caja (cada LOD_DISTANCE más se baja un nivel) y lo envía a la
+// cola como un dibujo más, así que los chunks con la misma textura acaban en
+// una sola llamada indirecta.
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
+
+#include "mesh_arena.h"
+#include "render_queue.h"
+#include "soft_raster.h"
+
+class Terrain
+{
+public:
+    static const int CHUNK_QUADS = 32;
+    static const int LOD_COUNT = 4;
+    static constexpr float SKIRT_DEPTH = 20.0f;
+    static constexpr float LOD_DISTANCE = 250.0f;
+    static constexpr float TEXTURE_SIZE = 50.0f; // unidades del mundo por repetición de la textura
+
+    // Antes de MeshArena::upload()
+    void build(MeshArena& _arena, const glm::vec2& minCorner, const glm::vec2& maxCorner, float cellSize,
+               const std::function<float(float, float)>& height)
+    {
+        arena = &_arena;
+        chunks.clear();
+        heightFunction = height;
+        boundsMin = minCorner;
+        boundsMax = maxCorner;
+
+        int cellsX = std::max(1, (int)std::ceil((maxCorner.x - minCorner.x) / cellSize));
+        int cellsZ = std::max(1, (int)std::ceil((maxCorner.y - minCorner.y) / cellSize));
+        int chunksX = (cellsX + CHUNK_QUADS - 1) / CHUNK_QUADS;
+        int chunksZ = (cellsZ + CHUNK_QUADS - 1) / CHUNK_QUADS;
+
+        for (int cz = 0; cz < chunksZ; ++cz)
+        {
+            for (int cx = 0; cx < chunksX; ++cx)
+            {
+                Chunk chunk;
+                glm::vec2 origin = minCorner + glm::vec2(cx * CHUNK_QUADS * cellSize, cz * CHUNK_QUADS * cellSize);
+
+                // Alturas de la rejilla completa del chunk; los niveles se saltan filas
+                std::vector<float> heights((CHUNK_QUADS + 1) * (CHUNK_QUADS + 1));
+                float minHeight = 1e30f, maxHeight = -1e30f;
+                for (int z = 0; z <= CHUNK_QUADS; ++z)
+                    for (int x = 0; x <= CHUNK_QUADS; ++x)
+                    {
+                        float h = height(origin.x + x * cellSize, origin.y + z * cellSize);
+                        heights[z * (CHUNK_QUADS + 1) + x] = h;
+                        minHeight = std::min(minHeight, h);
+                        maxHeight = std::max(maxHeight, h);
+                    }
+
+                float size = CHUNK_QUADS * cellSize;
+                chunk.minCorner = glm::vec3(origin.x, minHeight - SKIRT_DEPTH, origin.y);
+                chunk.maxCorner = glm::vec3(origin.x + size, maxHeight, origin.y + size);
+
+                for (int lod = 0; lod < LOD_COUNT; ++lod)
+                {
+                    ChunkMesh& mesh = chunk.meshes[lod];
+                    buildMesh(mesh, heights, origin, cellSize, 1 << lod);
+                    mesh.range = arena->add(mesh.positions, mesh.texcoords, mesh.indices);
+                }
+                chunks.push_back(chunk);
+            }
+        }
+    }
+
+    void setTexture(GLuint _texture)
+    {
+        texture = _texture;
+    }
+
+    void submit(RenderQueue& queue, GLuint program, const glm::vec3& eye, GLuint depthProgram = 0)
+    {
+        lastTriangles = 0;
+        for (const Chunk& chunk : chunks)
+        {
+            float distance = distanceTo(chunk, eye);
+            const ChunkMesh& mesh = chunk.meshes[selectLod(distance)];
+
+            DrawItem item;
+            item.program = program;
+            item.texture = texture;
+            item.vao = arena->getVao();
+            item.first = mesh.range.firstIndex;
+            item.count = mesh.range.indexCount;
+            item.baseVertex = mesh.range.baseVertex;
+            item.batchable = queue.isIndirect();
+            item.depthProgram = depthProgram;
+            item.depth = distance;
+            queue.submit(item);
+            lastTriangles += mesh.range.indexCount / 3;
+        }
+    }
+
+    // Con el mismo nivel de detalle que submit()
+    void rasterize(SoftRasterizer& raster, const glm::vec3& eye, const SoftTexture* softTexture) const
+    {
+        for (const Chunk& chunk : chunks)
+        {
+            const ChunkMesh& mesh = chunk.meshes[selectLod(distanceTo(chunk, eye))];
+            raster.submit(mesh.positions, mesh.texcoords, mesh.indices, glm::mat4x4(1.0f), softTexture);
+        }
+    }
+
+    // La función de build(); fuera del terreno, -infinito
+    float heightAt(float x, float z) const
+    {
+        if (!heightFunction || x < boundsMin.x || z < boundsMin.y || x > boundsMax.x || z > boundsMax.y)
+            return -std::numeric_limits<float>::infinity();
+        return heightFunction(x, z);
+    }
+
+    // Caja y nivel de detalle de cada chunk visto desde eye, para DebugViews
+    template <typename Visit>
+    void forEachChunkLod(const glm::vec3& eye, Visit visit) const
+    {
+        for (const Chunk& chunk : chunks)
+            visit(chunk.minCorner, chunk.maxCorner, selectLod(distanceTo(chunk, eye)));
+    }
+
+    size_t getChunkCount() const
+    {
+        return chunks.size();
+    }
+
+    // Triángulos enviados en el último submit()
+    unsigned getTriangleCount() const
+    {
+        return lastTriangles;
+    }
+
+private:
+    // Copia en la CPU para SoftRasterizer; en la GPU vive en la arena
+    struct ChunkMesh
+    {
+        std::vector<float> positions;
+        std::vector<float> texcoords;
+        std::vector<unsigned int> indices;
+        MeshRange range;
+    };
+
+    struct Chunk
+    {
+        glm::vec3 minCorner, maxCorner;
+        ChunkMesh meshes[LOD_COUNT];
+    };
+
+    MeshArena* arena = nullptr;
+    std::function<float(float, float)> heightFunction;
+    glm::vec2 boundsMin, boundsMax;
+    GLuint texture = 0;
+    std::vector<Chunk> chunks;
+    unsigned lastTriangles = 0;
+
+    static float distanceTo(const Chunk& chunk, const glm::vec3& eye)
+    {
+        glm::vec3 closest = glm::clamp(eye, chunk.minCorner, chunk.maxCorner);
+        return glm::length(eye - closest);
+    }
+
+    static int selectLod(float distance)
+    {
+        int lod = 0;
+        while (lod + 1 < LOD_COUNT && distance > LOD_DISTANCE * float(1 << lod))
+            ++lod;
+        return lod;
+    }
+
+    static void addVertex(ChunkMesh& mesh, float x, float y, float z)
+    {
+        mesh.positions.push_back(x);
+        mesh.positions.push_back(y);
+        mesh.positions.push_back(z);
+        mesh.texcoords.push_back(x / TEXTURE_SIZE);
+        mesh.texcoords.push_back(z / TEXTURE_SIZE);
+    }
+
+    static void addQuad(ChunkMesh& mesh, unsigned int a, unsigned int b, unsigned int c, unsigned int d)
+    {
+        unsigned int quad[6] = { a, b, c, a, c, d };
+        mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+    }
+
+    static void buildMesh(ChunkMesh& mesh, const std::vector<float>& heights, const glm::vec2& origin, float cellSize, int step)
+    {
+        int side = CHUNK_QUADS / step + 1;
+        auto heightAt = [&](int x, int z) { return heights[(z * step) * (CHUNK_QUADS + 1) + x * step]; };
+
+        for (int z = 0; z < side; ++z)
+            for (int x = 0; x < side; ++x)
+                addVertex(mesh, origin.x + x * step * cellSize, heightAt(x, z), origin.y + z * step * cellSize);
+        for (int z = 0; z + 1 < side; ++z)
+            for (int x = 0; x + 1 < side; ++x)
+            {
+                unsigned int corner = z * side + x;
+                addQuad(mesh, corner, corner + side, corner + side + 1, corner + 1);
+            }
+
+        // Faldones: cada borde se repite SKIRT_DEPTH más abajo
+        int edges[4][4] = {
+            { 0, 0, 1, 0 },        // z = 0
+            { 0, side - 1, 1, 0 }, // z = último
+            { 0, 0, 0, 1 },        // x = 0
+            { side - 1, 0, 0, 1 }  // x = último
+        };
+        for (const int* edge : edges)
+        {
+            unsigned int first = (unsigned int)(mesh.positions.size() / 3);
+            for (int i = 0; i < side; ++i)
+            {
+                int x = edge[0] + edge[2] * i, z = edge[1] + edge[3] * i;
+                addVertex(mesh, origin.x + x * step * cellSize, heightAt(x, z) - SKIRT_DEPTH, origin.y + z * step * cellSize);
+            }
+            for (int i = 0; i + 1 < side; ++i)
+            {
+                int x0 = edge[0] + edge[2] * i, z0 = edge[1] + edge[3] * i;
+                int x1 = x0 + edge[2], z1 = z0 + edge[3];
+                addQuad(mesh, z0 * side + x0, z1 * side + x1, first + i + 1, first + i);
+            }
+        }
+    }
+};
+
+#endif
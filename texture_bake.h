@@ -0,0 +1,599 @@
+#ifndef TEXTURE_BAKE_H
+#define TEXTURE_BAKE_H
+
+// Horneado de texturas: genera en CPU toda la cadena de mipmaps (filtro box o
+// Kaiser, filtrando en espacio lineal) y opcionalmente la comprime en bloques
+// BC1/BC3. El resultado se guarda en un contenedor ".vtex" junto a la imagen
+// original para que los siguientes arranques solo tengan que leer y subir.
+//
+// Este fichero no depende de OpenGL: la subida a la GPU la hace loadTexture().
+// Lee las imágenes con stbi_load(): stb_image.h va antes.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum TextureFormat : uint32_t
+{
+    TEXFMT_RGBA8 = 0,
+    TEXFMT_BC1 = 1, // RGB, 4 bpp
+    TEXFMT_BC3 = 2  // RGBA, 8 bpp
+};
+
+enum MipFilter : uint32_t
+{
+    MIP_FILTER_BOX = 0,
+    MIP_FILTER_KAISER = 1
+};
+
+struct TextureBakeOptions
+{
+    bool compress = true;
+    MipFilter filter = MIP_FILTER_KAISER;
+    bool srgb = true; // los texels están en sRGB: filtrar en lineal
+};
+
+struct BakedLevel
+{
+    uint32_t width = 0, height = 0;
+    std::vector<unsigned char> data;
+};
+
+struct BakedTexture
+{
+    uint32_t format = TEXFMT_RGBA8;
+    uint32_t channels = 4; // canales de la imagen original
+    std::vector<BakedLevel> levels;
+
+    size_t byteSize() const
+    {
+        size_t total = 0;
+        for (const auto& level : levels)
+            total += level.data.size();
+        return total;
+    }
+};
+
+namespace texbake
+{
+    const char MAGIC[4] = { 'V', 'T', 'E', 'X' };
+    const uint32_t VERSION = 1;
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t format;
+        uint32_t channels;
+        uint32_t levelCount;
+        uint32_t options; // compress | filter | srgb, para invalidar la caché
+        uint64_t sourceStamp;
+    };
+
+    inline uint32_t packOptions(const TextureBakeOptions& options)
+    {
+        return (options.compress ? 1u : 0u) | (uint32_t(options.filter) << 1) | (options.srgb ? 8u : 0u);
+    }
+
+    inline uint32_t blockBytes(uint32_t format)
+    {
+        return format == TEXFMT_BC1 ? 8u : 16u;
+    }
+
+    inline size_t levelSize(uint32_t format, uint32_t width, uint32_t height)
+    {
+        if (format == TEXFMT_RGBA8)
+            return size_t(width) * height * 4;
+        return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    // Tamaño y fecha de la imagen original: si cambian, hay que volver a hornear
+    inline uint64_t sourceStamp(const std::string& path)
+    {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec) return 0;
+        uint64_t time = (uint64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        return size * 0x9E3779B97F4A7C15ull ^ time;
+    }
+
+    // ------------------------------------------------------------------------
+    // Conversión sRGB <-> lineal
+
+    inline const float* srgbToLinearTable()
+    {
+        static float table[256];
+        static bool initialised = false;
+        if (!initialised)
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                float c = i / 255.0f;
+                table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+            initialised = true;
+        }
+        return table;
+    }
+
+    inline unsigned char linearToSrgb(float c)
+    {
+        c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+        float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return (unsigned char)(s * 255.0f + 0.5f);
+    }
+
+    inline unsigned char toUnorm8(float c)
+    {
+        c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+        return (unsigned char)(c * 255.0f + 0.5f);
+    }
+
+    // ------------------------------------------------------------------------
+    // Generación de mipmaps
+
+    struct FloatImage
+    {
+        int width = 0, height = 0;
+        std::vector<float> texels; // RGBA
+    };
+
+    inline double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0, q = x * x / 4.0;
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= q / (double(k) * k);
+            sum += term;
+            if (term < sum * 1e-12) break;
+        }
+        return sum;
+    }
+
+    // Ventana de Kaiser (alfa 4, ancho 3) sobre un sinc, como en NVTT
+    inline float kaiserWeight(float x)
+    {
+        const float width = 3.0f, alpha = 4.0f;
+        float t = x / (width * 0.5f);
+        if (t <= -1.0f || t >= 1.0f) return 0.0f;
+        float sinc = x == 0.0f ? 1.0f : std::sin(3.14159265f * x) / (3.14159265f * x);
+        return sinc * float(besselI0(alpha * std::sqrt(1.0 - double(t) * t)) / besselI0(alpha));
+    }
+
+    struct FilterTaps
+    {
+        int first;
+        std::vector<float> weights;
+    };
+
+    // Pesos (normalizados) para reducir srcSize -> dstSize en un eje
+    inline std::vector<FilterTaps> computeTaps(int srcSize, int dstSize, MipFilter filter)
+    {
+        std::vector<FilterTaps> result(dstSize);
+        float scale = float(srcSize) / float(dstSize);
+        float radius = (filter == MIP_FILTER_BOX ? 0.5f : 1.5f) * scale;
+
+        for (int x = 0; x < dstSize; ++x)
+        {
+            float center = (x + 0.5f) * scale;
+            int first = int(std::floor(center - radius));
+            int last = int(std::ceil(center + radius));
+            FilterTaps& taps = result[x];
+            taps.first = first;
+
+            float total = 0.0f;
+            for (int j = first; j < last; ++j)
+            {
+                float d = (j + 0.5f - center) / scale;
+                float w = filter == MIP_FILTER_BOX ? (std::fabs(d) < 0.5f ? 1.0f : 0.0f) : kaiserWeight(d);
+                taps.weights.push_back(w);
+                total += w;
+            }
+            for (auto& w : taps.weights)
+                w /= total;
+        }
+        return result;
+    }
+
+    inline FloatImage downsample(const FloatImage& src, MipFilter filter)
+    {
+        FloatImage dst;
+        dst.width = src.width > 1 ? src.width / 2 : 1;
+        dst.height = src.height > 1 ? src.height / 2 : 1;
+
+        std::vector<FilterTaps> tapsX = computeTaps(src.width, dst.width, filter);
+        std::vector<FilterTaps> tapsY = computeTaps(src.height, dst.height, filter);
+
+        // Pasada horizontal: src.width x src.height -> dst.width x src.height
+        std::vector<float> tmp(size_t(dst.width) * src.height * 4, 0.0f);
+        for (int y = 0; y < src.height; ++y)
+        {
+            const float* row = &src.texels[size_t(y) * src.width * 4];
+            for (int x = 0; x < dst.width; ++x)
+            {
+                float* out = &tmp[(size_t(y) * dst.width + x) * 4];
+                const FilterTaps& taps = tapsX[x];
+                for (size_t k = 0; k < taps.weights.size(); ++k)
+                {
+                    int sx = taps.first + int(k);
+                    sx = sx < 0 ? 0 : (sx >= src.width ? src.width - 1 : sx);
+                    for (int c = 0; c < 4; ++c)
+                        out[c] += row[sx * 4 + c] * taps.weights[k];
+                }
+            }
+        }
+
+        // Pasada vertical
+        dst.texels.assign(size_t(dst.width) * dst.height * 4, 0.0f);
+        for (int y = 0; y < dst.height; ++y)
+        {
+            const FilterTaps& taps = tapsY[y];
+            float* out = &dst.texels[size_t(y) * dst.width * 4];
+            for (size_t k = 0; k < taps.weights.size(); ++k)
+            {
+                int sy = taps.first + int(k);
+                sy = sy < 0 ? 0 : (sy >= src.height ? src.height - 1 : sy);
+                const float* row = &tmp[size_t(sy) * dst.width * 4];
+                float w = taps.weights[k];
+                for (int i = 0; i < dst.width * 4; ++i)
+                    out[i] += row[i] * w;
+            }
+        }
+        return dst;
+    }
+
+    // ------------------------------------------------------------------------
+    // Compresión BC1 / BC3
+
+    inline uint16_t packRgb565(const float* rgb)
+    {
+        int r = int(rgb[0] * 31.0f / 255.0f + 0.5f);
+        int g = int(rgb[1] * 63.0f / 255.0f + 0.5f);
+        int b = int(rgb[2] * 31.0f / 255.0f + 0.5f);
+        r = r < 0 ? 0 : (r > 31 ? 31 : r);
+        g = g < 0 ? 0 : (g > 63 ? 63 : g);
+        b = b < 0 ? 0 : (b > 31 ? 31 : b);
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpackRgb565(uint16_t c, int* rgb)
+    {
+        int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    inline void writeU16(unsigned char* out, uint16_t v)
+    {
+        out[0] = (unsigned char)(v & 0xFF);
+        out[1] = (unsigned char)(v >> 8);
+    }
+
+    // Extremos sobre el eje principal del bloque (ajuste de rango)
+    inline void encodeColorBlock(const unsigned char* block, unsigned char* out)
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                mean[c] += block[i * 4 + c] / 16.0f;
+
+        float cov[6] = { 0.0f }; // xx xy xz yy yz zz
+        for (int i = 0; i < 16; ++i)
+        {
+            float d[3] = { block[i * 4] - mean[0], block[i * 4 + 1] - mean[1], block[i * 4 + 2] - mean[2] };
+            cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+            cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+        }
+
+        float axis[3] = { 0.299f, 0.587f, 0.114f };
+        for (int iter = 0; iter < 8; ++iter)
+        {
+            float v[3] = {
+                cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+            };
+            float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+            if (len < 1e-6f) break;
+            axis[0] = v[0] / len; axis[1] = v[1] / len; axis[2] = v[2] / len;
+        }
+
+        int minIndex = 0, maxIndex = 0;
+        float minProj = 1e30f, maxProj = -1e30f;
+        for (int i = 0; i < 16; ++i)
+        {
+            float p = block[i * 4] * axis[0] + block[i * 4 + 1] * axis[1] + block[i * 4 + 2] * axis[2];
+            if (p < minProj) { minProj = p; minIndex = i; }
+            if (p > maxProj) { maxProj = p; maxIndex = i; }
+        }
+
+        float maxColor[3] = { float(block[maxIndex * 4]), float(block[maxIndex * 4 + 1]), float(block[maxIndex * 4 + 2]) };
+        float minColor[3] = { float(block[minIndex * 4]), float(block[minIndex * 4 + 1]), float(block[minIndex * 4 + 2]) };
+        uint16_t c0 = packRgb565(maxColor);
+        uint16_t c1 = packRgb565(minColor);
+        if (c0 < c1) std::swap(c0, c1);
+
+        writeU16(out, c0);
+        writeU16(out + 2, c1);
+        uint32_t indices = 0;
+
+        if (c0 != c1)
+        {
+            // Modo de 4 colores (c0 > c1)
+            int palette[4][3];
+            unpackRgb565(c0, palette[0]);
+            unpackRgb565(c1, palette[1]);
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestDist = 1 << 30;
+                for (int p = 0; p < 4; ++p)
+                {
+                    int dr = block[i * 4] - palette[p][0];
+                    int dg = block[i * 4 + 1] - palette[p][1];
+                    int db = block[i * 4 + 2] - palette[p][2];
+                    int dist = dr * dr + dg * dg + db * db;
+                    if (dist < bestDist) { bestDist = dist; best = p; }
+                }
+                indices |= uint32_t(best) << (2 * i);
+            }
+        }
+
+        out[4] = (unsigned char)(indices & 0xFF);
+        out[5] = (unsigned char)((indices >> 8) & 0xFF);
+        out[6] = (unsigned char)((indices >> 16) & 0xFF);
+        out[7] = (unsigned char)(indices >> 24);
+    }
+
+    inline void encodeAlphaBlock(const unsigned char* block, unsigned char* out)
+    {
+        int a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; ++i)
+        {
+            int a = block[i * 4 + 3];
+            a0 = a > a0 ? a : a0;
+            a1 = a < a1 ? a : a1;
+        }
+        out[0] = (unsigned char)a0;
+        out[1] = (unsigned char)a1;
+
+        uint64_t indices = 0;
+        if (a0 != a1)
+        {
+            // Modo de 8 valores (a0 > a1)
+            int palette[8] = { a0, a1 };
+            for (int k = 1; k < 7; ++k)
+                palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+
+            for (int i = 0; i < 16; ++i)
+            {
+                int a = block[i * 4 + 3];
+                int best = 0, bestDist = 1 << 30;
+                for (int p = 0; p < 8; ++p)
+                {
+                    int dist = (a - palette[p]) * (a - palette[p]);
+                    if (dist < bestDist) { bestDist = dist; best = p; }
+                }
+                indices |= uint64_t(best) << (3 * i);
+            }
+        }
+        for (int b = 0; b < 6; ++b)
+            out[2 + b] = (unsigned char)((indices >> (8 * b)) & 0xFF);
+    }
+
+    inline void compressLevel(const unsigned char* rgba, uint32_t width, uint32_t height, uint32_t format, unsigned char* out)
+    {
+        uint32_t blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        unsigned char block[64];
+
+        for (uint32_t by = 0; by < blocksY; ++by)
+        {
+            for (uint32_t bx = 0; bx < blocksX; ++bx)
+            {
+                // Los bloques del borde repiten el último texel
+                for (uint32_t y = 0; y < 4; ++y)
+                {
+                    uint32_t sy = by * 4 + y < height ? by * 4 + y : height - 1;
+                    for (uint32_t x = 0; x < 4; ++x)
+                    {
+                        uint32_t sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+                        std::memcpy(&block[(y * 4 + x) * 4], &rgba[(size_t(sy) * width + sx) * 4], 4);
+                    }
+                }
+
+                if (format == TEXFMT_BC3)
+                {
+                    encodeAlphaBlock(block, out);
+                    encodeColorBlock(block, out + 8);
+                    out += 16;
+                }
+                else
+                {
+                    encodeColorBlock(block, out);
+                    out += 8;
+                }
+            }
+        }
+    }
+}
+
+// Decodifica la imagen y genera todos los niveles en memoria
+inline bool bakeTexture(const std::string& sourcePath, const TextureBakeOptions& options, BakedTexture& out)
+{
+    int width, height, nrChannels;
+    unsigned char* data = stbi_load(sourcePath.c_str(), &width, &height, &nrChannels, 4);
+    if (!data)
+        return false;
+
+    // Con un solo canal la textura se subía como GL_RED: se conserva el aspecto
+    if (nrChannels == 1)
+    {
+        for (size_t i = 0; i < size_t(width) * height; ++i)
+        {
+            data[i * 4 + 1] = 0;
+            data[i * 4 + 2] = 0;
+        }
+    }
+
+    bool hasAlpha = false;
+    if (nrChannels == 4)
+    {
+        for (size_t i = 0; i < size_t(width) * height && !hasAlpha; ++i)
+            hasAlpha = data[i * 4 + 3] != 255;
+    }
+
+    out.channels = nrChannels;
+    out.format = !options.compress ? TEXFMT_RGBA8 : (hasAlpha ? TEXFMT_BC3 : TEXFMT_BC1);
+    out.levels.clear();
+
+    const float* toLinear = texbake::srgbToLinearTable();
+    texbake::FloatImage image;
+    image.width = width;
+    image.height = height;
+    image.texels.resize(size_t(width) * height * 4);
+    for (size_t i = 0; i < size_t(width) * height; ++i)
+    {
+        for (int c = 0; c < 3; ++c)
+            image.texels[i * 4 + c] = options.srgb ? toLinear[data[i * 4 + c]] : data[i * 4 + c] / 255.0f;
+        image.texels[i * 4 + 3] = data[i * 4 + 3] / 255.0f;
+    }
+    stbi_image_free(data);
+
+    std::vector<unsigned char> rgba;
+    while (true)
+    {
+        rgba.resize(size_t(image.width) * image.height * 4);
+        for (size_t i = 0; i < size_t(image.width) * image.height; ++i)
+        {
+            for (int c = 0; c < 3; ++c)
+                rgba[i * 4 + c] = options.srgb ? texbake::linearToSrgb(image.texels[i * 4 + c]) : texbake::toUnorm8(image.texels[i * 4 + c]);
+            rgba[i * 4 + 3] = texbake::toUnorm8(image.texels[i * 4 + 3]);
+        }
+
+        BakedLevel level;
+        level.width = image.width;
+        level.height = image.height;
+        if (out.format == TEXFMT_RGBA8)
+        {
+            level.data.swap(rgba);
+        }
+        else
+        {
+            level.data.resize(texbake::levelSize(out.format, level.width, level.height));
+            texbake::compressLevel(rgba.data(), level.width, level.height, out.format, level.data.data());
+        }
+        out.levels.push_back(std::move(level));
+
+        if (image.width == 1 && image.height == 1)
+            break;
+        image = texbake::downsample(image, options.filter);
+    }
+    return true;
+}
+
+inline bool writeBakedTexture(const std::string& path, const BakedTexture& texture, const TextureBakeOptions& options, uint64_t sourceStamp)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    texbake::FileHeader header;
+    std::memcpy(header.magic, texbake::MAGIC, 4);
+    header.version = texbake::VERSION;
+    header.format = texture.format;
+    header.channels = texture.channels;
+    header.levelCount = (uint32_t)texture.levels.size();
+    header.options = texbake::packOptions(options);
+    header.sourceStamp = sourceStamp;
+    file.write((const char*)&header, sizeof(header));
+
+    for (const auto& level : texture.levels)
+    {
+        uint32_t dims[2] = { level.width, level.height };
+        file.write((const char*)dims, sizeof(dims));
+        file.write((const char*)level.data.data(), level.data.size());
+    }
+    return bool(file);
+}
+
+// Lee solo la cabecera y las dimensiones; los datos de cada nivel quedan en
+// levelOffsets para poder leerlos más tarde por separado.
+inline bool readBakedTextureHeader(std::ifstream& file, BakedTexture& texture, std::vector<std::streamoff>& levelOffsets,
+                                   const TextureBakeOptions& options, uint64_t sourceStamp)
+{
+    texbake::FileHeader header;
+    if (!file.read((char*)&header, sizeof(header)))
+        return false;
+    if (std::memcmp(header.magic, texbake::MAGIC, 4) != 0 || header.version != texbake::VERSION ||
+        header.options != texbake::packOptions(options) || header.sourceStamp != sourceStamp || header.levelCount == 0)
+        return false;
+
+    texture.format = header.format;
+    texture.channels = header.channels;
+    texture.levels.assign(header.levelCount, BakedLevel());
+    levelOffsets.assign(header.levelCount, 0);
+
+    for (size_t i = 0; i < texture.levels.size(); ++i)
+    {
+        BakedLevel& level = texture.levels[i];
+        uint32_t dims[2];
+        if (!file.read((char*)dims, sizeof(dims)))
+            return false;
+        level.width = dims[0];
+        level.height = dims[1];
+        levelOffsets[i] = file.tellg();
+        file.seekg(texbake::levelSize(texture.format, level.width, level.height), std::ios::cur);
+    }
+    return bool(file);
+}
+
+inline bool readBakedTexture(const std::string& path, BakedTexture& texture, const TextureBakeOptions& options, uint64_t sourceStamp)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::vector<std::streamoff> offsets;
+    if (!file || !readBakedTextureHeader(file, texture, offsets, options, sourceStamp))
+        return false;
+
+    for (size_t i = 0; i < texture.levels.size(); ++i)
+    {
+        BakedLevel& level = texture.levels[i];
+        level.data.resize(texbake::levelSize(texture.format, level.width, level.height));
+        file.seekg(offsets[i]);
+        if (!file.read((char*)level.data.data(), level.data.size()))
+            return false;
+    }
+    return true;
+}
+
+inline std::string bakedTexturePath(const std::string& sourcePath)
+{
+    return sourcePath + ".vtex";
+}
+
+// Usa el contenedor horneado si está al día; si no, hornea y lo guarda
+inline bool loadOrBakeTexture(const std::string& sourcePath, const TextureBakeOptions& options, BakedTexture& out)
+{
+    uint64_t stamp = texbake::sourceStamp(sourcePath);
+    std::string cachePath = bakedTexturePath(sourcePath);
+    if (stamp != 0 && readBakedTexture(cachePath, out, options, stamp))
+        return true;
+
+    if (!bakeTexture(sourcePath, options, out))
+        return false;
+    if (stamp != 0 && !writeBakedTexture(cachePath, out, options, stamp))
+        std::cerr << "No se pudo guardar la textura horneada: " << cachePath << std::endl;
+    return true;
+}
+
+#endif
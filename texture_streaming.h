@@ -0,0 +1,473 @@
+#ifndef TEXTURE_STREAMING_H
+#define TEXTURE_STREAMING_H
+
+// Streaming de texturas por niveles de mipmap.
+//
+// Cada textura empieza como un texel gris. Un hilo de fondo hornea o abre su
+// contenedor .vtex y lee la cola de mipmaps (los niveles de TAIL_SIZE o menos),
+// que se sube de golpe para que la escena se vea desde el primer fotograma.
+// Después, según el tamaño en pantalla de los objetos que la usan, se piden
+// niveles más detallados de uno en uno; el hilo los lee del disco y se suben a
+// través de un anillo de PBOs. Si la memoria residente pasa del presupuesto se
+// descartan los niveles superiores de las texturas que menos los necesitan
+// (el nivel se redefine como 0x0 y se sube GL_TEXTURE_BASE_LEVEL).
+
+#include <climits>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "gl_ext.h"
+#include "texture_bake.h"
+
+inline GLenum textureInternalFormat(uint32_t format)
+{
+    if (format == TEXFMT_BC1) return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    if (format == TEXFMT_BC3) return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    return GL_RGBA8;
+}
+
+// Sube un nivel ya horneado a la textura enlazada; pixels puede ser un
+// desplazamiento dentro del GL_PIXEL_UNPACK_BUFFER enlazado.
+inline void uploadTextureLevel(uint32_t format, GLint level, uint32_t width, uint32_t height, size_t size, const void* pixels)
+{
+    if (format == TEXFMT_RGBA8)
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    else
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, textureInternalFormat(format), width, height, 0, (GLsizei)size, pixels);
+}
+
+class TextureStreamer
+{
+public:
+    static const uint32_t TAIL_SIZE = 64;
+    static const int PBO_COUNT = 4;
+    static const size_t PBO_SIZE = 8 * 1024 * 1024;
+    static const size_t UPLOAD_BYTES_PER_FRAME = 8 * 1024 * 1024;
+
+    ~TextureStreamer()
+    {
+        shutdown();
+    }
+
+    void init(const TextureBakeOptions& _options, size_t _budget)
+    {
+        options = _options;
+        budget = _budget;
+
+        glGenBuffers(PBO_COUNT, pbos);
+        for (int i = 0; i < PBO_COUNT; ++i)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, PBO_SIZE, NULL, GL_STREAM_DRAW);
+            fences[i] = 0;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        running = true;
+        worker = std::thread(&TextureStreamer::workerLoop, this);
+    }
+
+    void shutdown()
+    {
+        if (!running) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        jobAvailable.notify_all();
+        worker.join();
+
+        for (int i = 0; i < PBO_COUNT; ++i)
+            if (fences[i]) glDeleteSync(fences[i]);
+        glDeleteBuffers(PBO_COUNT, pbos);
+    }
+
+    // Devuelve enseguida una textura válida (de momento un texel gris)
+    GLuint request(const std::string& path)
+    {
+        auto found = texturesByPath.find(path);
+        if (found != texturesByPath.end())
+            return textures[found->second].id;
+
+        StreamedTexture texture;
+        texture.path = path;
+        glGenTextures(1, &texture.id);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        size_t index = textures.size();
+        textures.push_back(texture);
+        texturesByPath[path] = index;
+        texturesById[texture.id] = index;
+
+        pushJob(Job{ index, -1, path, 0, 0 });
+        return texture.id;
+    }
+
+    void setBudget(size_t _budget)
+    {
+        budget = _budget;
+    }
+
+    size_t getResidentBytes() const
+    {
+        return residentBytes;
+    }
+
+    // Al principio de cada fotograma, antes de los noteUsage()
+    void beginFrame()
+    {
+        for (auto& texture : textures)
+            texture.wantedLevel = INT_MAX;
+    }
+
+    // La textura se ve en pantalla con unos screenPixels de diámetro
+    void noteUsage(GLuint textureID, float screenPixels)
+    {
+        auto found = texturesById.find(textureID);
+        if (found == texturesById.end()) return;
+        StreamedTexture& texture = textures[found->second];
+        if (!texture.ready || screenPixels <= 0.0f) return;
+
+        float texels = float(texture.widths[0] > texture.heights[0] ? texture.widths[0] : texture.heights[0]);
+        int level = int(std::floor(std::log2(texels / screenPixels)));
+        level = level < 0 ? 0 : level;
+        if (level < texture.wantedLevel)
+            texture.wantedLevel = level;
+    }
+
+    void update()
+    {
+        std::vector<Result> finished;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.swap(results);
+        }
+
+        for (auto& result : finished)
+        {
+            if (result.level < 0)
+                finishOpen(result);
+            else
+                pendingUploads.push_back(std::move(result));
+        }
+
+        uploadPending();
+        scheduleLevels();
+
+        // El presupuesto puede haber bajado: descartar hasta cumplirlo
+        while (residentBytes > budget && evictOne(INT_MAX, SIZE_MAX)) {}
+    }
+
+private:
+    struct StreamedTexture
+    {
+        GLuint id = 0;
+        std::string path;
+        bool ready = false;
+        uint32_t format = TEXFMT_RGBA8;
+        std::vector<uint32_t> widths, heights;
+        std::vector<std::streamoff> offsets;
+        int tailLevel = 0;     // a partir de aquí siempre residente
+        int residentTop = 0;   // nivel más detallado residente
+        int wantedLevel = INT_MAX;
+        bool levelInFlight = false;
+
+        size_t levelBytes(int level) const
+        {
+            return texbake::levelSize(format, widths[level], heights[level]);
+        }
+    };
+
+    struct Job
+    {
+        size_t texture;
+        int level; // -1: abrir el contenedor y leer la cola
+        std::string path;
+        std::streamoff offset;
+        size_t size;
+    };
+
+    struct Result
+    {
+        size_t texture;
+        int level;
+        bool ok = false;
+        BakedTexture baked; // al abrir: dimensiones de todos los niveles y datos de la cola
+        std::vector<std::streamoff> offsets;
+        int tailLevel = 0;
+        std::vector<unsigned char> data; // al leer un nivel
+    };
+
+    TextureBakeOptions options;
+    size_t budget = 0;
+    size_t residentBytes = 0;
+
+    std::vector<StreamedTexture> textures;
+    std::unordered_map<std::string, size_t> texturesByPath;
+    std::unordered_map<GLuint, size_t> texturesById;
+    std::deque<Result> pendingUploads;
+
+    GLuint pbos[PBO_COUNT];
+    GLsync fences[PBO_COUNT];
+    int nextPbo = 0;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable jobAvailable;
+    std::deque<Job> jobs;
+    std::vector<Result> results;
+    bool running = false;
+
+    void pushJob(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        jobAvailable.notify_one();
+    }
+
+    // ------------------------------------------------------------------------
+    // Hilo de fondo: solo disco y CPU, nunca OpenGL
+
+    void workerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this] { return !running || !jobs.empty(); });
+                if (!running) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+
+            Result result;
+            result.texture = job.texture;
+            result.level = job.level;
+            result.ok = job.level < 0 ? openContainer(job.path, result) : readLevel(job, result);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            results.push_back(std::move(result));
+        }
+    }
+
+    bool openContainer(const std::string& path, Result& result)
+    {
+        uint64_t stamp = texbake::sourceStamp(path);
+        std::string cachePath = bakedTexturePath(path);
+
+        std::ifstream file(cachePath, std::ios::binary);
+        if (!file || !readBakedTextureHeader(file, result.baked, result.offsets, options, stamp))
+        {
+            file.close();
+            BakedTexture baked;
+            if (!bakeTexture(path, options, baked) || !writeBakedTexture(cachePath, baked, options, stamp))
+            {
+                std::cerr << "Error al hornear la textura: " << path << std::endl;
+                return false;
+            }
+            file.open(cachePath, std::ios::binary);
+            if (!file || !readBakedTextureHeader(file, result.baked, result.offsets, options, stamp))
+                return false;
+        }
+
+        int levels = (int)result.baked.levels.size();
+        result.tailLevel = levels - 1;
+        while (result.tailLevel > 0 &&
+               result.baked.levels[result.tailLevel - 1].width <= TAIL_SIZE &&
+               result.baked.levels[result.tailLevel - 1].height <= TAIL_SIZE)
+            --result.tailLevel;
+
+        for (int level = result.tailLevel; level < levels; ++level)
+        {
+            BakedLevel& baked = result.baked.levels[level];
+            baked.data.resize(texbake::levelSize(result.baked.format, baked.width, baked.height));
+            file.seekg(result.offsets[level]);
+            if (!file.read((char*)baked.data.data(), baked.data.size()))
+                return false;
+        }
+        return true;
+    }
+
+    bool readLevel(const Job& job, Result& result)
+    {
+        std::ifstream file(bakedTexturePath(job.path), std::ios::binary);
+        result.data.resize(job.size);
+        file.seekg(job.offset);
+        return bool(file.read((char*)result.data.data(), job.size));
+    }
+
+    // ------------------------------------------------------------------------
+    // Hilo principal
+
+    void finishOpen(Result& result)
+    {
+        StreamedTexture& texture = textures[result.texture];
+        if (!result.ok)
+        {
+            std::cerr << "Error al cargar la textura: " << texture.path << std::endl;
+            return;
+        }
+
+        texture.format = result.baked.format;
+        texture.offsets = result.offsets;
+        texture.tailLevel = result.tailLevel;
+        texture.residentTop = result.tailLevel;
+        for (const auto& level : result.baked.levels)
+        {
+            texture.widths.push_back(level.width);
+            texture.heights.push_back(level.height);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        if (texture.tailLevel > 0)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (int level = texture.tailLevel; level < (int)result.baked.levels.size(); ++level)
+        {
+            const BakedLevel& baked = result.baked.levels[level];
+            uploadTextureLevel(texture.format, level, baked.width, baked.height, baked.data.size(), baked.data.data());
+            residentBytes += baked.data.size();
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.tailLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)result.baked.levels.size() - 1);
+        texture.ready = true;
+    }
+
+    // Siguiente PBO del anillo, solo si la GPU ya terminó de leerlo
+    bool acquirePbo(GLuint& pbo)
+    {
+        GLsync& fence = fences[nextPbo];
+        if (fence)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                return false;
+            glDeleteSync(fence);
+            fence = 0;
+        }
+        pbo = pbos[nextPbo];
+        return true;
+    }
+
+    void uploadPending()
+    {
+        size_t uploaded = 0;
+        while (!pendingUploads.empty() && uploaded < UPLOAD_BYTES_PER_FRAME)
+        {
+            Result& result = pendingUploads.front();
+            StreamedTexture& texture = textures[result.texture];
+
+            // Si mientras tanto se descartó el nivel de abajo, ya no encaja
+            if (!result.ok || texture.residentTop != result.level + 1)
+            {
+                texture.levelInFlight = false;
+                pendingUploads.pop_front();
+                continue;
+            }
+
+            glBindTexture(GL_TEXTURE_2D, texture.id);
+            uint32_t width = texture.widths[result.level], height = texture.heights[result.level];
+            if (result.data.size() > PBO_SIZE)
+            {
+                uploadTextureLevel(texture.format, result.level, width, height, result.data.size(), result.data.data());
+            }
+            else
+            {
+                GLuint pbo;
+                if (!acquirePbo(pbo))
+                    break;
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+                void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, result.data.size(),
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                if (!mapped)
+                {
+                    // Sigue en la cola: se reintenta el fotograma siguiente
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    break;
+                }
+                std::memcpy(mapped, result.data.data(), result.data.size());
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                uploadTextureLevel(texture.format, result.level, width, height, result.data.size(), (void*)0);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                fences[nextPbo] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+                nextPbo = (nextPbo + 1) % PBO_COUNT;
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, result.level);
+
+            texture.residentTop = result.level;
+            texture.levelInFlight = false;
+            residentBytes += result.data.size();
+            uploaded += result.data.size();
+            pendingUploads.pop_front();
+        }
+    }
+
+    void scheduleLevels()
+    {
+        for (size_t i = 0; i < textures.size(); ++i)
+        {
+            StreamedTexture& texture = textures[i];
+            if (!texture.ready || texture.levelInFlight || texture.wantedLevel >= texture.residentTop)
+                continue;
+
+            int level = texture.residentTop - 1;
+            size_t size = texture.levelBytes(level);
+            int deficit = texture.residentTop - texture.wantedLevel;
+            while (residentBytes + size > budget && evictOne(deficit, i)) {}
+            if (residentBytes + size > budget)
+                continue;
+
+            texture.levelInFlight = true;
+            pushJob(Job{ i, level, texture.path, texture.offsets[level], size });
+        }
+    }
+
+    // Descarta el nivel superior de la textura que menos lo necesita, siempre
+    // que tras descartarlo le falte menos detalle que maxDeficit
+    bool evictOne(int maxDeficit, size_t exclude)
+    {
+        size_t victim = SIZE_MAX;
+        int victimDeficit = maxDeficit;
+        for (size_t i = 0; i < textures.size(); ++i)
+        {
+            const StreamedTexture& texture = textures[i];
+            if (i == exclude || !texture.ready || texture.levelInFlight || texture.residentTop >= texture.tailLevel)
+                continue;
+            int wanted = texture.wantedLevel < texture.tailLevel ? texture.wantedLevel : texture.tailLevel;
+            int deficit = texture.residentTop + 1 - wanted;
+            if (deficit < victimDeficit)
+            {
+                victimDeficit = deficit;
+                victim = i;
+            }
+        }
+        if (victim == SIZE_MAX)
+            return false;
+
+        StreamedTexture& texture = textures[victim];
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.residentTop + 1);
+        glTexImage2D(GL_TEXTURE_2D, texture.residentTop, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        residentBytes -= texture.levelBytes(texture.residentTop);
+        ++texture.residentTop;
+        return true;
+    }
+};
+
+#endif